@@ -0,0 +1,13 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Linking alloc_counter.cc replaces the global operator new, so a test can count the heap
+ * allocations of the code it drives. The count covers every thread of the process.
+ */
+extern std::atomic<size_t> host_alloc_count;
+
+#endif // ALLOC_COUNTER_H
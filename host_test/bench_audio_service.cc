@@ -0,0 +1,263 @@
+#include "host_test.h"
+#include "alloc_counter.h"
+#include "audio_service.h"
+#include "audio_uploader.h"
+#include "latency_trace.h"
+#include "wav_audio_codec.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * The whole AudioService on a free-running WavAudioCodec: its input, output, encode and
+ * decode tasks run as threads, with the real processor (NoAudioProcessor), Opus codecs,
+ * jitter buffer and mixer. This file stands in for the uploader and for the latency trace
+ * sink.
+ *
+ * The uplink phase reads a looped 16 kHz tone as fast as the CPU allows and encodes it.
+ * The downlink phase pushes pre-encoded 24 kHz Opus packets through the decode queue to the
+ * speaker. Each phase reports frames/s, operator new calls per frame once warmed up, and
+ * the per-stage latency from the frames' latency traces. Without a real-time clock the
+ * queues sit at their bounds, so the latencies are those of a pipeline running at full
+ * load, dominated by the wait for the next stage.
+ */
+
+#define BENCH_INPUT_RATE 16000
+#define BENCH_OUTPUT_RATE 24000
+#define BENCH_FRAME_MS 60
+#define BENCH_WARMUP_MS 500
+#define BENCH_PHASE_MS 2000
+// Downlink packets queued ahead of the decoder, within the packet pool
+#define BENCH_PACKETS_IN_FLIGHT 4
+#define BENCH_MAX_TRACES 100000
+
+using Clock = std::chrono::steady_clock;
+
+struct TraceLog {
+    std::mutex mutex;
+    std::vector<latency_trace_t> traces;
+};
+
+static TraceLog trace_logs[kLatencyTraceDirectionCount];
+static std::atomic<uint32_t> uplink_packets{0};
+static uint8_t uplink_slot[MAX_OPUS_PACKET_SIZE];
+
+/* The uploader: every packet is sent as soon as it is committed */
+
+void audio_uploader_send_traced(const uint8_t* data, size_t len, const latency_trace_t* trace, int frame_ms) {
+    (void)data;
+    (void)len;
+    (void)trace;
+    (void)frame_ms;
+}
+
+uint8_t* audio_uploader_reserve(size_t max_len) {
+    return max_len <= sizeof(uplink_slot) ? uplink_slot : nullptr;
+}
+
+void audio_uploader_commit(size_t len, const latency_trace_t* trace, int frame_ms) {
+    (void)len;
+    (void)frame_ms;
+    uplink_packets++;
+    if (trace != nullptr) {
+        latency_trace_t sent = *trace;
+        sent.stamps[LATENCY_TRACE_UP_ENQUEUED] = latency_trace_now();
+        sent.stamps[LATENCY_TRACE_UP_SENT] = sent.stamps[LATENCY_TRACE_UP_ENQUEUED];
+        latency_trace_commit(kLatencyTraceUplink, &sent);
+    }
+}
+
+void audio_uploader_cancel(void) {
+}
+
+void audio_uploader_get_stats(audio_uploader_stats_t* stats) {
+    *stats = {};
+}
+
+void latency_trace_commit(latency_trace_direction_t direction, const latency_trace_t* trace) {
+    TraceLog& log = trace_logs[direction];
+    std::lock_guard<std::mutex> lock(log.mutex);
+    // Reserved up front, so recording does not show up in the allocation count
+    if (log.traces.size() < log.traces.capacity()) {
+        log.traces.push_back(*trace);
+    }
+}
+
+struct Stage {
+    const char* name;
+    int from;
+    int to;
+};
+
+static const Stage kUplinkStages[] = {
+    { "captured -> processed", LATENCY_TRACE_UP_CAPTURED, LATENCY_TRACE_UP_PROCESSED },
+    { "processed -> encoded", LATENCY_TRACE_UP_PROCESSED, LATENCY_TRACE_UP_ENCODED },
+    { "captured -> sent", LATENCY_TRACE_UP_CAPTURED, LATENCY_TRACE_UP_SENT },
+};
+
+static const Stage kDownlinkStages[] = {
+    { "received -> dequeued", LATENCY_TRACE_DOWN_RECEIVED, LATENCY_TRACE_DOWN_DEQUEUED },
+    { "dequeued -> decoded", LATENCY_TRACE_DOWN_DEQUEUED, LATENCY_TRACE_DOWN_DECODED },
+    { "decoded -> written", LATENCY_TRACE_DOWN_DECODED, LATENCY_TRACE_DOWN_WRITTEN },
+    { "received -> written", LATENCY_TRACE_DOWN_RECEIVED, LATENCY_TRACE_DOWN_WRITTEN },
+};
+
+static void ClearTraces() {
+    for (auto& log : trace_logs) {
+        std::lock_guard<std::mutex> lock(log.mutex);
+        log.traces.clear();
+    }
+}
+
+template <size_t N>
+static void PrintStages(latency_trace_direction_t direction, const Stage (&stages)[N]) {
+    TraceLog& log = trace_logs[direction];
+    std::lock_guard<std::mutex> lock(log.mutex);
+    CHECK(!log.traces.empty());
+    for (const auto& stage : stages) {
+        std::vector<uint32_t> us;
+        for (const auto& trace : log.traces) {
+            if (trace.stamps[stage.from] != 0 && trace.stamps[stage.to] != 0) {
+                us.push_back(trace.stamps[stage.to] - trace.stamps[stage.from]);
+            }
+        }
+        if (us.empty()) {
+            continue;
+        }
+        std::sort(us.begin(), us.end());
+        printf("  %-24s %10u %10u\n", stage.name, us[us.size() / 2], us[us.size() * 99 / 100]);
+    }
+}
+
+static void PrintPhase(const char* name, uint32_t frames, double seconds, size_t allocs) {
+    printf("%-10s %10u frames %10.1f frames/s %8.2f new/frame\n", name, frames, frames / seconds,
+        frames > 0 ? static_cast<double>(allocs) / frames : 0.0);
+    printf("  %-24s %10s %10s\n", "stage", "p50 us", "p99 us");
+}
+
+static void Sleep(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static double Seconds(Clock::duration elapsed) {
+    return std::chrono::duration<double>(elapsed).count();
+}
+
+static std::vector<int16_t> Tone(int sample_rate, size_t samples) {
+    std::vector<int16_t> pcm(samples);
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = static_cast<int16_t>(std::lround(8000 * std::sin(2 * M_PI * 440.0 * i / sample_rate)));
+    }
+    return pcm;
+}
+
+// One second of server packets, looped by the downlink phase
+static std::vector<std::vector<uint8_t>> EncodePackets() {
+    const size_t frame_samples = BENCH_OUTPUT_RATE * BENCH_FRAME_MS / 1000;
+    auto pcm = Tone(BENCH_OUTPUT_RATE, BENCH_OUTPUT_RATE);
+    OpusStreamEncoder encoder(BENCH_OUTPUT_RATE, 1, BENCH_FRAME_MS);
+    encoder.SetDtx(false);
+    std::vector<std::vector<uint8_t>> packets;
+    for (size_t offset = 0; offset + frame_samples <= pcm.size(); offset += frame_samples) {
+        std::vector<int16_t> frame(pcm.begin() + offset, pcm.begin() + offset + frame_samples);
+        std::vector<uint8_t> packet;
+        CHECK(encoder.Encode(frame, packet));
+        packets.push_back(std::move(packet));
+    }
+    return packets;
+}
+
+static void BenchUplink(AudioService& service) {
+    service.EnableVoiceProcessing(true);
+    Sleep(BENCH_WARMUP_MS);
+
+    ClearTraces();
+    uint32_t packets = uplink_packets;
+    size_t allocs = host_alloc_count;
+    auto start = Clock::now();
+    Sleep(BENCH_PHASE_MS);
+    uint32_t frames = uplink_packets - packets;
+    allocs = host_alloc_count - allocs;
+    double seconds = Seconds(Clock::now() - start);
+    service.EnableVoiceProcessing(false);
+
+    PrintPhase("uplink", frames, seconds, allocs);
+    PrintStages(kLatencyTraceUplink, kUplinkStages);
+    CHECK(frames > 0);
+    // The frame and packet pools cover the steady state
+    CHECK(allocs == 0);
+}
+
+static void BenchDownlink(AudioService& service, WavAudioCodec& codec) {
+    const auto packets = EncodePackets();
+    size_t next = 0;
+    auto push = [&] {
+        auto packet = service.AcquirePacket();
+        packet->sample_rate = BENCH_OUTPUT_RATE;
+        packet->frame_duration = BENCH_FRAME_MS;
+        packet->payload.assign(packets[next].begin(), packets[next].end());
+        packet->receive_time = latency_trace_now();
+        next = (next + 1) % packets.size();
+        CHECK(service.PushPacketToDecodeQueue(std::move(packet), true));
+    };
+    // Keeps the decode queue topped up like a fast link, without outgrowing the packet pool
+    auto run = [&](int ms) {
+        auto until = Clock::now() + std::chrono::milliseconds(ms);
+        while (Clock::now() < until) {
+            if (service.packet_pool().in_use() < BENCH_PACKETS_IN_FLIGHT) {
+                push();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    run(BENCH_WARMUP_MS);
+    ClearTraces();
+    uint32_t frames = service.GetDecodeStatistics().frames;
+    uint64_t samples = codec.output_samples();
+    size_t allocs = host_alloc_count;
+    auto start = Clock::now();
+    run(BENCH_PHASE_MS);
+    frames = service.GetDecodeStatistics().frames - frames;
+    allocs = host_alloc_count - allocs;
+    double seconds = Seconds(Clock::now() - start);
+    samples = codec.output_samples() - samples;
+
+    PrintPhase("downlink", frames, seconds, allocs);
+    PrintStages(kLatencyTraceDownlink, kDownlinkStages);
+    printf("  %-24s %10.1f x real time\n", "speaker output", samples / seconds / BENCH_OUTPUT_RATE);
+    CHECK(frames > 0);
+    CHECK(allocs == 0);
+    CHECK(service.GetJitterStatistics().late_packets == 0);
+}
+
+int main() {
+    for (auto& log : trace_logs) {
+        log.traces.reserve(BENCH_MAX_TRACES);
+    }
+    const auto input = Tone(BENCH_INPUT_RATE, BENCH_INPUT_RATE);
+    WavAudioCodec codec(BENCH_INPUT_RATE, BENCH_OUTPUT_RATE, kWavCodecFreeRunning);
+    codec.SetInput(input.data(), input.size(), true);
+    Board::GetInstance().SetAudioCodec(&codec);
+
+    {
+        AudioService service;
+        service.Initialize(&codec);
+        service.Start();
+        BenchUplink(service);
+        BenchDownlink(service, codec);
+        service.Stop();
+        // The tasks hold the service until they return
+        while (host_task_count() > 0) {
+            Sleep(1);
+        }
+    }
+    return HOST_TEST_RESULT();
+}
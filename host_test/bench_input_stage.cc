@@ -0,0 +1,120 @@
+#include "host_test.h"
+#include "alloc_counter.h"
+#include "polyphase_resampler.h"
+#include "stereo_pcm.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Cost of the stereo branch of AudioService::ReadAudioData per 60 ms frame: split mic and
+ * reference, resample both to 16 kHz, merge them back.
+ *
+ * "before" is the code this replaced: four vectors per frame and indexed copy loops.
+ * "after" is the current code, stage by stage, with one scratch buffer. Both use the same
+ * resampler, so the rows differ only in the split / merge and the allocations. The share
+ * column shows how much of the frame a faster split / merge could save at most.
+ */
+
+#define BENCH_FRAMES 2000
+#define BENCH_FRAME_MS 60
+
+using Clock = std::chrono::steady_clock;
+
+static double Nanoseconds(Clock::duration elapsed) {
+    return std::chrono::duration<double, std::nano>(elapsed).count();
+}
+
+static std::vector<int16_t> StereoInput(int sample_rate) {
+    std::vector<int16_t> pcm(sample_rate * BENCH_FRAME_MS / 1000 * 2);
+    for (size_t i = 0; i < pcm.size() / 2; i++) {
+        pcm[2 * i] = static_cast<int16_t>(std::lround(8000 * std::sin(2 * M_PI * 1009.7 * i / sample_rate)));
+        pcm[2 * i + 1] = static_cast<int16_t>(std::lround(4000 * std::sin(2 * M_PI * 211.3 * i / sample_rate)));
+    }
+    return pcm;
+}
+
+// The pre-scratch ReadAudioData stereo branch
+static void Before(std::vector<int16_t>& data, PolyphaseResampler& mic_resampler, PolyphaseResampler& reference_resampler) {
+    auto mic_channel = std::vector<int16_t>(data.size() / 2);
+    auto reference_channel = std::vector<int16_t>(data.size() / 2);
+    for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
+        mic_channel[i] = data[j];
+        reference_channel[i] = data[j + 1];
+    }
+    auto resampled_mic = std::vector<int16_t>(mic_resampler.GetOutputSamples(mic_channel.size()));
+    auto resampled_reference = std::vector<int16_t>(reference_resampler.GetOutputSamples(reference_channel.size()));
+    mic_resampler.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
+    reference_resampler.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
+    data.resize(resampled_mic.size() + resampled_reference.size());
+    for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
+        data[j] = resampled_mic[i];
+        data[j + 1] = resampled_reference[i];
+    }
+}
+
+static void Bench(int sample_rate) {
+    const auto input = StereoInput(sample_rate);
+    const int frames = input.size() / 2;
+    std::vector<int16_t> data;
+    data.reserve(input.size());
+
+    PolyphaseResampler mic_resampler, reference_resampler;
+    mic_resampler.Configure(sample_rate, 16000);
+    reference_resampler.Configure(sample_rate, 16000);
+    size_t allocs = host_alloc_count;
+    auto start = Clock::now();
+    for (int n = 0; n < BENCH_FRAMES; n++) {
+        data.assign(input.begin(), input.end());
+        Before(data, mic_resampler, reference_resampler);
+    }
+    double before_ns = Nanoseconds(Clock::now() - start) / BENCH_FRAMES;
+    double before_allocs = static_cast<double>(host_alloc_count - allocs) / BENCH_FRAMES;
+
+    mic_resampler.Configure(sample_rate, 16000);
+    reference_resampler.Configure(sample_rate, 16000);
+    int resampled_frames = mic_resampler.GetOutputSamples(frames);
+    std::vector<int16_t> scratch(2 * (frames + resampled_frames));
+    int16_t* mic = scratch.data();
+    int16_t* reference = mic + frames;
+    int16_t* resampled_mic = reference + frames;
+    int16_t* resampled_reference = resampled_mic + resampled_frames;
+    Clock::duration split{}, resample{}, merge{};
+    allocs = host_alloc_count;
+    for (int n = 0; n < BENCH_FRAMES; n++) {
+        data.assign(input.begin(), input.end());
+        auto t0 = Clock::now();
+        DeinterleaveStereo(data.data(), mic, reference, frames);
+        auto t1 = Clock::now();
+        mic_resampler.Process(mic, frames, resampled_mic);
+        reference_resampler.Process(reference, frames, resampled_reference);
+        auto t2 = Clock::now();
+        data.resize(resampled_frames * 2);
+        InterleaveStereo(resampled_mic, resampled_reference, data.data(), resampled_frames);
+        auto t3 = Clock::now();
+        split += t1 - t0;
+        resample += t2 - t1;
+        merge += t3 - t2;
+    }
+    double after_allocs = static_cast<double>(host_alloc_count - allocs) / BENCH_FRAMES;
+    double split_ns = Nanoseconds(split) / BENCH_FRAMES;
+    double resample_ns = Nanoseconds(resample) / BENCH_FRAMES;
+    double merge_ns = Nanoseconds(merge) / BENCH_FRAMES;
+    double after_ns = split_ns + resample_ns + merge_ns;
+
+    printf("%5d Hz  before     %10.0f %7s %8.1f\n", sample_rate, before_ns, "", before_allocs);
+    printf("%5d Hz  split      %10.0f %6.1f%%\n", sample_rate, split_ns, 100 * split_ns / after_ns);
+    printf("%5d Hz  resample   %10.0f %6.1f%%\n", sample_rate, resample_ns, 100 * resample_ns / after_ns);
+    printf("%5d Hz  merge      %10.0f %6.1f%%\n", sample_rate, merge_ns, 100 * merge_ns / after_ns);
+    printf("%5d Hz  after      %10.0f %7s %8.1f\n", sample_rate, after_ns, "", after_allocs);
+    CHECK(after_allocs == 0);
+}
+
+int main() {
+    printf("%-19s %10s %7s %8s\n", "per 60 ms frame", "ns", "share", "allocs");
+    Bench(24000);
+    Bench(48000);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,76 @@
+#include "host_test.h"
+#include "audio_mixer.h"
+#include "audio_codec.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Cost of AudioMixer::Mix() per DMA block for the source mixes the output task sees, next
+ * to the real-time period of the block at 24 kHz. Only Mix() is timed; the rings are
+ * refilled outside the clock.
+ *
+ * The rows cover each branch of MixSegment: the unity-gain add, a fixed gain, and a gain
+ * ramp. Ramping runs while a source ducks or recovers, or after SetGain().
+ */
+
+#define BENCH_BLOCKS 20000
+#define BENCH_OUTPUT_RATE 24000
+
+using Clock = std::chrono::steady_clock;
+
+struct Scenario {
+    const char* name;
+    int sources;
+    int32_t gain;       // applied to every source
+    bool ramp;          // change the gain of every source every block
+};
+
+static const Scenario kScenarios[] = {
+    { "1 source, unity", 1, AUDIO_MIXER_UNITY_GAIN, false },
+    { "1 source, gain", 1, AUDIO_MIXER_UNITY_GAIN / 2, false },
+    { "1 source, ramp", 1, AUDIO_MIXER_UNITY_GAIN / 2, true },
+    { "3 sources, ducked", 3, AUDIO_MIXER_UNITY_GAIN, false },
+    { "3 sources, ramp", 3, AUDIO_MIXER_UNITY_GAIN / 2, true },
+};
+
+int main() {
+    const size_t block = AUDIO_CODEC_DMA_FRAME_NUM;
+    const double period_ns = 1e9 * block / BENCH_OUTPUT_RATE;
+    std::vector<int16_t> pcm(block);
+    for (size_t i = 0; i < block; i++) {
+        pcm[i] = static_cast<int16_t>(std::lround(8000 * std::sin(2 * M_PI * 1009.7 * i / BENCH_OUTPUT_RATE)));
+    }
+    std::vector<int16_t> out(block);
+
+    printf("%-20s %12s %12s %10s\n", "per block", "ns/block", "ns/sample", "of period");
+    for (const auto& scenario : kScenarios) {
+        AudioMixer mixer;
+        CHECK(mixer.Initialize(block));
+        // Priorities as in AudioService: music under voice under alerts
+        int32_t duck_gains[] = { AUDIO_MIXER_UNITY_GAIN / 8, AUDIO_MIXER_UNITY_GAIN / 2, AUDIO_MIXER_UNITY_GAIN };
+        for (int i = 0; i < scenario.sources; i++) {
+            CHECK(mixer.AddSource("bench", i, block * 4, duck_gains[i]) == i);
+            mixer.SetGain(i, scenario.gain);
+        }
+
+        Clock::duration elapsed{};
+        for (int n = 0; n < BENCH_BLOCKS; n++) {
+            for (int i = 0; i < scenario.sources; i++) {
+                mixer.Write(i, pcm.data(), block);
+                if (scenario.ramp) {
+                    mixer.SetGain(i, (n & 1) ? scenario.gain : scenario.gain / 2);
+                }
+            }
+            auto start = Clock::now();
+            CHECK(mixer.Mix(out.data()));
+            elapsed += Clock::now() - start;
+        }
+        double block_ns = std::chrono::duration<double, std::nano>(elapsed).count() / BENCH_BLOCKS;
+        printf("%-20s %12.0f %12.2f %9.3f%%\n", scenario.name, block_ns, block_ns / block, 100 * block_ns / period_ns);
+        CHECK(mixer.GetStatistics().partial_blocks == 0);
+    }
+    return HOST_TEST_RESULT();
+}
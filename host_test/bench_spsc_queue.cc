@@ -0,0 +1,201 @@
+#include "host_test.h"
+#include "spsc_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Hand-off cost of the audio queues before and after the per-queue SPSC rings.
+ *
+ * Before: every queue of AudioService shared one mutex and one condition variable, and
+ * every push called notify_all(), so the tasks waiting for other queues woke up too.
+ * After: each ring is paired with a task notification to the one task that consumes it.
+ *
+ * One producer feeds one consumer while two bystander tasks wait for queues that stay
+ * empty, as the encode and output tasks do during playback. The table shows the wakeups
+ * of all three waiting tasks per item and the push-to-pop latency. The producer paces
+ * its pushes so the latency is the hand-off itself, not queueing.
+ */
+
+#define BENCH_ITEMS 20000
+#define BENCH_PACING_US 20
+#define BENCH_BYSTANDERS 2
+
+using Clock = std::chrono::steady_clock;
+
+struct Item {
+    Clock::time_point pushed;
+    bool last = false;
+};
+
+struct Result {
+    double wakeups_per_item;
+    double p50_us;
+    double p99_us;
+};
+
+// xTaskNotifyGive() / ulTaskNotifyTake(pdTRUE, portMAX_DELAY)
+class TaskNotification {
+public:
+    void Give() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            count_++;
+        }
+        cv_.notify_one();
+    }
+    // Returns how often the task had to be woken up
+    int Take() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        int wakeups = 0;
+        while (count_ == 0) {
+            cv_.wait(lock);
+            wakeups++;
+        }
+        count_ = 0;
+        return wakeups;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    uint32_t count_ = 0;
+};
+
+static void Pace(Clock::time_point since) {
+    while (Clock::now() - since < std::chrono::microseconds(BENCH_PACING_US)) {
+    }
+}
+
+static Result Summarize(std::vector<double>& latencies_us, uint64_t wakeups) {
+    std::sort(latencies_us.begin(), latencies_us.end());
+    return {
+        static_cast<double>(wakeups) / BENCH_ITEMS,
+        latencies_us[latencies_us.size() / 2],
+        latencies_us[latencies_us.size() * 99 / 100],
+    };
+}
+
+static Result RunSharedCondition() {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Item> queue;
+    std::deque<Item> idle_queues[BENCH_BYSTANDERS];
+    bool stopped = false;
+    std::atomic<uint64_t> wakeups{0};
+    std::vector<double> latencies_us;
+    latencies_us.reserve(BENCH_ITEMS);
+
+    std::thread consumer([&] {
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (queue.empty()) {
+                cv.wait(lock);
+                wakeups++;
+            }
+            Item item = queue.front();
+            queue.pop_front();
+            cv.notify_all();
+            lock.unlock();
+            if (item.last) {
+                break;
+            }
+            latencies_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - item.pushed).count());
+        }
+    });
+    std::vector<std::thread> bystanders;
+    for (int i = 0; i < BENCH_BYSTANDERS; i++) {
+        bystanders.emplace_back([&, i] {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (idle_queues[i].empty() && !stopped) {
+                cv.wait(lock);
+                wakeups++;
+            }
+        });
+    }
+
+    for (int i = 0; i <= BENCH_ITEMS; i++) {
+        auto now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back({ now, i == BENCH_ITEMS });
+        }
+        cv.notify_all();
+        Pace(now);
+    }
+    consumer.join();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    cv.notify_all();
+    for (auto& thread : bystanders) {
+        thread.join();
+    }
+    // The wakeups of the shutdown itself are not part of the hand-off
+    return Summarize(latencies_us, wakeups - BENCH_BYSTANDERS);
+}
+
+static Result RunSpscRing() {
+    SpscQueue<Item, 40> queue;
+    TaskNotification consumer_notification;
+    TaskNotification bystander_notifications[BENCH_BYSTANDERS];
+    std::atomic<uint64_t> wakeups{0};
+    std::vector<double> latencies_us;
+    latencies_us.reserve(BENCH_ITEMS);
+
+    std::thread consumer([&] {
+        Item item;
+        while (true) {
+            if (!queue.Pop(item)) {
+                wakeups += consumer_notification.Take();
+                continue;
+            }
+            if (item.last) {
+                break;
+            }
+            latencies_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - item.pushed).count());
+        }
+    });
+    std::vector<std::thread> bystanders;
+    for (int i = 0; i < BENCH_BYSTANDERS; i++) {
+        bystanders.emplace_back([&, i] {
+            wakeups += bystander_notifications[i].Take();
+        });
+    }
+
+    for (int i = 0; i <= BENCH_ITEMS; i++) {
+        auto now = Clock::now();
+        while (!queue.Push({ now, i == BENCH_ITEMS })) {
+            std::this_thread::yield();
+        }
+        consumer_notification.Give();
+        Pace(now);
+    }
+    consumer.join();
+    for (auto& notification : bystander_notifications) {
+        notification.Give();
+    }
+    for (auto& thread : bystanders) {
+        thread.join();
+    }
+    return Summarize(latencies_us, wakeups - BENCH_BYSTANDERS);
+}
+
+int main() {
+    printf("%-28s %14s %10s %10s\n", "", "wakeups/item", "p50 us", "p99 us");
+    Result shared = RunSharedCondition();
+    printf("%-28s %14.2f %10.1f %10.1f\n", "deque + mutex + notify_all", shared.wakeups_per_item, shared.p50_us, shared.p99_us);
+    Result ring = RunSpscRing();
+    printf("%-28s %14.2f %10.1f %10.1f\n", "SpscQueue + notification", ring.wakeups_per_item, ring.p50_us, ring.p99_us);
+    // Only the consumer is woken, the bystanders sleep through the run
+    CHECK(ring.wakeups_per_item < shared.wakeups_per_item);
+    return HOST_TEST_RESULT();
+}
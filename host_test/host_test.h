@@ -0,0 +1,22 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <cstdio>
+
+/*
+ * Minimal checks for the host tests: a failed CHECK prints the location and marks the
+ * test failed, the test keeps running so one run reports every failure.
+ */
+
+inline int host_test_failures = 0;
+
+#define CHECK(condition) do {                                                   \
+        if (!(condition)) {                                                     \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            host_test_failures++;                                               \
+        }                                                                       \
+    } while (0)
+
+#define HOST_TEST_RESULT() (host_test_failures == 0 ? 0 : 1)
+
+#endif // HOST_TEST_H
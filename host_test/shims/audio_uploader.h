@@ -0,0 +1,39 @@
+#pragma once
+// Host build shim: there is no server link. The uplink calls of AudioService are declared
+// here and defined by the test that drives it, which stands in for the WebSocket uploader.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "latency_trace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t queued;
+    uint32_t awaiting_ack;
+    uint32_t queued_bytes;
+    uint32_t capacity_bytes;
+    uint32_t send_failures;
+    uint32_t dropped;
+    uint32_t sent;
+    uint16_t sequence;
+    uint8_t header_version;
+} audio_uploader_stats_t;
+
+void audio_uploader_send_traced(const uint8_t* data, size_t len, const latency_trace_t* trace, int frame_ms);
+uint8_t* audio_uploader_reserve(size_t max_len);
+void audio_uploader_commit(size_t len, const latency_trace_t* trace, int frame_ms);
+void audio_uploader_cancel(void);
+void audio_uploader_get_stats(audio_uploader_stats_t* stats);
+
+static inline bool audio_uploader_send_text(const char* text) {
+    (void)text;
+    return false;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+// Host build shim: the board only provides the codec, set by the test that drives AudioService
+
+class AudioCodec;
+
+class Board {
+public:
+    static Board& GetInstance() {
+        static Board instance;
+        return instance;
+    }
+
+    AudioCodec* GetAudioCodec() { return audio_codec_; }
+    void SetAudioCodec(AudioCodec* codec) { audio_codec_ = codec; }
+
+private:
+    AudioCodec* audio_codec_ = nullptr;
+};
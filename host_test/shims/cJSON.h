@@ -0,0 +1,4 @@
+#pragma once
+// Host build shim: protocol.h only passes cJSON pointers around
+
+typedef struct cJSON cJSON;
@@ -0,0 +1,10 @@
+#pragma once
+// Host build shim
+
+#include "esp_err.h"
+#include "i2s_std.h"
+
+static inline esp_err_t i2s_channel_enable(i2s_chan_handle_t handle) {
+    (void)handle;
+    return ESP_OK;
+}
@@ -0,0 +1,4 @@
+#pragma once
+// Host build shim: no I2S channels on the host
+
+typedef struct i2s_channel_obj_t* i2s_chan_handle_t;
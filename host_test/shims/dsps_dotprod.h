@@ -0,0 +1,26 @@
+#pragma once
+// Host build shim: the portable esp-dsp kernel, with the alignment rules of the ESP32-S3 one
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t dsps_dotprod_s16_ansi(const int16_t* src1, const int16_t* src2, int16_t* dest, int len, int8_t shift);
+
+// Calls that would have broken the MAC16 kernel: an unaligned operand or a length not a multiple of 4
+extern int dsps_dotprod_s16_misaligned_calls;
+
+static inline esp_err_t dsps_dotprod_s16(const int16_t* src1, const int16_t* src2, int16_t* dest, int len, int8_t shift) {
+    if (((uintptr_t)src1 & 3) != 0 || ((uintptr_t)src2 & 3) != 0 || (len & 3) != 0) {
+        dsps_dotprod_s16_misaligned_calls++;
+    }
+    return dsps_dotprod_s16_ansi(src1, src2, dest, len, shift);
+}
+
+#ifdef __cplusplus
+}
+#endif
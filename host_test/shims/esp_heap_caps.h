@@ -0,0 +1,22 @@
+#pragma once
+// Host build shim: every capability is plain heap memory
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+static inline void* heap_caps_malloc(size_t size, unsigned int caps) {
+    (void)caps;
+    return malloc(size);
+}
+
+static inline void* heap_caps_calloc(size_t count, size_t size, unsigned int caps) {
+    (void)caps;
+    return calloc(count, size);
+}
+
+static inline void heap_caps_free(void* ptr) {
+    free(ptr);
+}
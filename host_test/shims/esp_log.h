@@ -0,0 +1,9 @@
+#pragma once
+// Host build shim: warnings and errors go to stderr, info and debug are dropped
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) do { (void)(tag); } while (0)
+#define ESP_LOGD(tag, format, ...) do { (void)(tag); } while (0)
@@ -0,0 +1,14 @@
+#pragma once
+// Host build shim, implemented in host_shims.cc
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
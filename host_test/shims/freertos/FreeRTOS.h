@@ -0,0 +1,23 @@
+#pragma once
+// Host build shim: a 1 kHz tick, critical sections are a spinlock
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define configTICK_RATE_HZ 1000
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+
+typedef struct {
+    int locked;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portENTER_CRITICAL(mux) while (__atomic_exchange_n(&(mux)->locked, 1, __ATOMIC_ACQUIRE)) { }
+#define portEXIT_CRITICAL(mux) __atomic_store_n(&(mux)->locked, 0, __ATOMIC_RELEASE)
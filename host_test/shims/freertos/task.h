@@ -0,0 +1,32 @@
+#pragma once
+// Host build shim, implemented in host_shims.cc: every task is a thread, there are no
+// priorities or cores, notifications are a counting semaphore per task
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* arg);
+typedef unsigned int UBaseType_t;
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+// Only vTaskDelete(NULL) from the task itself, as the tasks in main/ end
+void vTaskDelete(TaskHandle_t task);
+void xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+BaseType_t xPortGetCoreID(void);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+
+// Host only: tasks created and not yet returned, a test waits for 0 after stopping a service
+int host_task_count(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,171 @@
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "dsps_dotprod.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static const auto kStart = std::chrono::steady_clock::now();
+
+static std::chrono::milliseconds TicksToDuration(TickType_t ticks) {
+    return std::chrono::milliseconds(static_cast<int64_t>(ticks) * 1000 / configTICK_RATE_HZ);
+}
+
+int64_t esp_timer_get_time(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - kStart).count();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(TicksToDuration(ticks));
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return static_cast<TickType_t>(esp_timer_get_time() / (1000000 / configTICK_RATE_HZ));
+}
+
+/*
+ * Tasks. A handle stays valid after its task returned, because the services notify their
+ * tasks without knowing whether they already stopped; the few handles a test creates are
+ * never freed.
+ */
+struct HostTask {
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notifications = 0;
+};
+
+static thread_local HostTask* current_task = nullptr;
+static std::atomic<int> live_tasks{0};
+
+// Threads the test started itself (main) get a handle the first time they wait
+static HostTask* CurrentTask() {
+    if (current_task == nullptr) {
+        current_task = new HostTask();
+    }
+    return current_task;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle) {
+    (void)name;
+    (void)stack_size;
+    (void)priority;
+    HostTask* task = new HostTask();
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    live_tasks++;
+    std::thread([function, arg, task] {
+        current_task = task;
+        function(arg);
+        live_tasks--;
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    (void)core;
+    return xTaskCreate(function, name, stack_size, arg, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    // The thread ends when the task function returns
+    (void)task;
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifications++;
+    }
+    task->cv.notify_one();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    HostTask* task = CurrentTask();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    auto notified = [task] { return task->notifications > 0; };
+    if (ticks == portMAX_DELAY) {
+        task->cv.wait(lock, notified);
+    } else {
+        task->cv.wait_for(lock, TicksToDuration(ticks), notified);
+    }
+    uint32_t count = task->notifications;
+    if (count > 0) {
+        task->notifications = clear_on_exit ? 0 : count - 1;
+    }
+    return count;
+}
+
+BaseType_t xPortGetCoreID(void) {
+    return 0;
+}
+
+int host_task_count(void) {
+    return live_tasks.load();
+}
+
+struct HostEventGroup {
+    std::mutex mutex;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    return new HostEventGroup();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t result;
+    {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        group->bits |= bits;
+        result = group->bits;
+    }
+    group->cv.notify_all();
+    return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+    BaseType_t wait_for_all, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto ready = [group, bits, wait_for_all] {
+        return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    bool satisfied;
+    if (ticks == portMAX_DELAY) {
+        group->cv.wait(lock, ready);
+        satisfied = true;
+    } else {
+        satisfied = group->cv.wait_for(lock, TicksToDuration(ticks), ready);
+    }
+    // Like FreeRTOS: the bits as they were before the clear
+    EventBits_t result = group->bits;
+    if (satisfied && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    return result;
+}
+
+int dsps_dotprod_s16_misaligned_calls = 0;
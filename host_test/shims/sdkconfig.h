@@ -0,0 +1,6 @@
+#pragma once
+// Host build shim: the menuconfig defaults that matter to the voice pipeline. Options left
+// out are off, so AudioService runs with NoAudioProcessor and without the audio debugger.
+
+#define CONFIG_AUDIO_FRAME_DURATION_60MS 1
+#define CONFIG_AUDIO_DEBUG_UDP_SERVER "127.0.0.1:8000"
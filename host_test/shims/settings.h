@@ -0,0 +1,21 @@
+#pragma once
+// Host build shim: nothing is persisted, reads return the default
+
+#include <cstdint>
+#include <string>
+
+class Settings {
+public:
+    Settings(const std::string& ns, bool read_write = false) {
+        (void)ns;
+        (void)read_write;
+    }
+    int32_t GetInt(const std::string& key, int32_t default_value = 0) {
+        (void)key;
+        return default_value;
+    }
+    void SetInt(const std::string& key, int32_t value) {
+        (void)key;
+        (void)value;
+    }
+};
@@ -0,0 +1,150 @@
+#include "host_test.h"
+#include "alloc_counter.h"
+#include "frame_assembler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Frames of 20, 40 and 60 ms at 16 kHz
+static const size_t kFrameSamples[] = { 320, 640, 960 };
+// AFE fetch sizes, plus odd ones that split every frame differently
+static const size_t kFetchSamples[] = { 1, 160, 256, 512, 1000, 2048 };
+
+/*
+ * The consumer side of AudioService: every frame is swapped with an empty reserved buffer
+ * from a small pool, the way PushTaskToEncodeQueue trades buffers with its frame pool.
+ */
+class Consumer {
+public:
+    explicit Consumer(size_t frame_samples) {
+        for (auto& buffer : pool_) {
+            buffer.reserve(frame_samples);
+        }
+    }
+
+    void operator()(std::vector<int16_t>&& frame) {
+        auto& buffer = pool_[next_++ % pool_.size()];
+        sizes.push_back(frame.size());
+        if (frame.size() > 0) {
+            // The stream is a running counter, so a lost, repeated or reordered sample shows up
+            correct = correct && frame.front() == expected && frame.back() == static_cast<int16_t>(expected + frame.size() - 1);
+            expected += frame.size();
+        }
+        buffer.swap(frame);
+        frame.clear();
+    }
+
+    std::vector<size_t> sizes;
+    int16_t expected = 0;
+    bool correct = true;
+
+private:
+    std::vector<std::vector<int16_t>> pool_ = std::vector<std::vector<int16_t>>(4);
+    size_t next_ = 0;
+};
+
+static std::vector<int16_t> Counter(size_t samples) {
+    std::vector<int16_t> pcm(samples);
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = static_cast<int16_t>(i);
+    }
+    return pcm;
+}
+
+// Every fetch size against every frame size: whole frames only, in order, no allocation
+static void TestSteadyState() {
+    auto stream = Counter(96000);
+    for (size_t frame_samples : kFrameSamples) {
+        for (size_t fetch : kFetchSamples) {
+            FrameAssembler assembler;
+            assembler.Initialize(frame_samples);
+            Consumer consumer(frame_samples);
+            consumer.sizes.reserve(stream.size() / frame_samples);
+            FrameAssembler::Output output = std::ref(consumer);
+
+            size_t allocs = host_alloc_count;
+            for (size_t offset = 0; offset + fetch <= stream.size(); offset += fetch) {
+                assembler.Append(stream.data() + offset, fetch, output);
+            }
+            CHECK(host_alloc_count == allocs);
+
+            size_t fed = stream.size() / fetch * fetch;
+            CHECK(consumer.sizes.size() == fed / frame_samples);
+            CHECK(std::all_of(consumer.sizes.begin(), consumer.sizes.end(), [&](size_t n) { return n == frame_samples; }));
+            CHECK(consumer.correct);
+        }
+    }
+}
+
+// Changing the frame size mid-frame cuts the buffered samples at the new size, nothing is lost
+static void TestFrameDurationChange() {
+    auto stream = Counter(20000);
+    FrameAssembler assembler;
+    assembler.Initialize(960);
+    Consumer consumer(960);
+    FrameAssembler::Output output = std::ref(consumer);
+
+    size_t offset = 0;
+    assembler.Append(stream.data(), 700, output);
+    offset += 700;
+    CHECK(consumer.sizes.empty());
+    // 700 samples buffered, more than a 20 ms frame: two frames and a 60-sample remainder
+    assembler.SetFrameSamples(320);
+    assembler.Append(stream.data() + offset, 0, output);
+    CHECK(consumer.sizes.size() == 2);
+    assembler.Append(stream.data() + offset, 260, output);
+    offset += 260;
+    CHECK(consumer.sizes.size() == 3);
+
+    assembler.SetFrameSamples(640);
+    assembler.Append(stream.data() + offset, 1280, output);
+    offset += 1280;
+    CHECK(consumer.sizes.size() == 5);
+    CHECK(consumer.sizes == std::vector<size_t>({ 320, 320, 320, 640, 640 }));
+    CHECK(consumer.correct);
+    CHECK(consumer.expected == static_cast<int16_t>(offset));
+}
+
+/*
+ * The work per fetch must not depend on how much has passed through: no erase of a growing
+ * buffer. The first and last tenth of a long run are timed per sample and must be close.
+ */
+static void TestConstantCostPerFetch() {
+    const size_t fetch = 512;
+    const size_t fetches = 40000;
+    auto chunk = Counter(fetch);
+    FrameAssembler assembler;
+    assembler.Initialize(960);
+    std::vector<int16_t> spare;
+    spare.reserve(960);
+    FrameAssembler::Output output = [&](std::vector<int16_t>&& frame) {
+        spare.swap(frame);
+        frame.clear();
+    };
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<double> ns(fetches);
+    for (size_t n = 0; n < fetches; n++) {
+        auto start = Clock::now();
+        assembler.Append(chunk.data(), fetch, output);
+        ns[n] = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+    // Medians, so a preempted fetch does not decide the result
+    auto median = [](std::vector<double> v) {
+        std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+        return v[v.size() / 2];
+    };
+    double first = median(std::vector<double>(ns.begin(), ns.begin() + fetches / 10));
+    double last = median(std::vector<double>(ns.end() - fetches / 10, ns.end()));
+    printf("%zu-sample fetch into 960-sample frames: %.0f ns early, %.0f ns late\n", fetch, first, last);
+    CHECK(last < 2 * first + 100);
+}
+
+int main() {
+    TestSteadyState();
+    TestFrameDurationChange();
+    TestConstantCostPerFetch();
+    return HOST_TEST_RESULT();
+}
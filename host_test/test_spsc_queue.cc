@@ -0,0 +1,138 @@
+#include "host_test.h"
+#include "spsc_queue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#define STRESS_ITEMS 1000000
+
+// Counts live items, so a lost or doubly destroyed item shows up as a non-zero balance
+static std::atomic<int> live_items{0};
+
+struct Item {
+    explicit Item(uint32_t value) : value(value) { live_items++; }
+    ~Item() { live_items--; }
+    uint32_t value;
+};
+
+using ItemPtr = std::unique_ptr<Item>;
+
+// RequestClear() drops what was queued before it; ApplyRequestedClear() does it without a Pop()
+static void TestRequestClear() {
+    SpscQueue<ItemPtr, 8> queue;
+    for (uint32_t i = 0; i < 3; i++) {
+        CHECK(queue.Push(std::make_unique<Item>(i)));
+    }
+    queue.RequestClear();
+    CHECK(queue.Push(std::make_unique<Item>(3)));
+    CHECK(queue.Push(std::make_unique<Item>(4)));
+    CHECK(queue.Size() == 5);
+    queue.ApplyRequestedClear();
+    CHECK(queue.Size() == 2);
+    CHECK(live_items == 2);
+
+    ItemPtr item;
+    CHECK(queue.Pop(item) && item->value == 3);
+    CHECK(queue.Pop(item) && item->value == 4);
+    CHECK(!queue.Pop(item));
+    item.reset();
+    CHECK(live_items == 0);
+
+    // Full at the capacity, not at the rounded-up slot count
+    SpscQueue<ItemPtr, 5> small;
+    for (uint32_t i = 0; i < 5; i++) {
+        CHECK(small.Push(std::make_unique<Item>(i)));
+    }
+    ItemPtr rejected = std::make_unique<Item>(5);
+    CHECK(!small.Push(std::move(rejected)));
+    CHECK(small.Full());
+}
+
+/*
+ * One producer, one consumer and a third task that keeps requesting clears. The consumer
+ * must see the values in order, with gaps only from clears, and the last value pushed after
+ * the final clear must arrive.
+ */
+static void TestStress(bool with_clears) {
+    SpscQueue<ItemPtr, 8> queue;
+    std::atomic<bool> producer_done{false};
+    std::atomic<bool> clearer_done{!with_clears};
+    std::atomic<uint32_t> received{0};
+    std::atomic<uint32_t> out_of_order{0};
+    uint32_t last_value = 0;
+
+    std::thread consumer([&] {
+        ItemPtr item;
+        bool first = true;
+        while (true) {
+            if (queue.Pop(item)) {
+                if (!first && item->value <= last_value) {
+                    out_of_order++;
+                }
+                if (!with_clears && item->value != (first ? 0 : last_value + 1)) {
+                    out_of_order++;
+                }
+                first = false;
+                last_value = item->value;
+                item.reset();
+                received++;
+                if (last_value == STRESS_ITEMS) {
+                    break;
+                }
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    std::thread clearer;
+    if (with_clears) {
+        clearer = std::thread([&] {
+            while (!producer_done) {
+                queue.RequestClear();
+                std::this_thread::yield();
+            }
+            clearer_done = true;
+        });
+    }
+
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < STRESS_ITEMS; i++) {
+            ItemPtr item = std::make_unique<Item>(i);
+            while (!queue.Push(std::move(item))) {
+                std::this_thread::yield();
+            }
+        }
+        producer_done = true;
+        // The end marker goes in after the last clear request, so it must not be dropped
+        while (!clearer_done) {
+            std::this_thread::yield();
+        }
+        ItemPtr end = std::make_unique<Item>(STRESS_ITEMS);
+        while (!queue.Push(std::move(end))) {
+            std::this_thread::yield();
+        }
+    });
+
+    producer.join();
+    if (clearer.joinable()) {
+        clearer.join();
+    }
+    consumer.join();
+
+    CHECK(out_of_order == 0);
+    if (!with_clears) {
+        CHECK(received == STRESS_ITEMS + 1);
+    }
+    CHECK(queue.Empty());
+    CHECK(live_items == 0);
+}
+
+int main() {
+    TestRequestClear();
+    TestStress(false);
+    TestStress(true);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,144 @@
+#include "host_test.h"
+#include "wav_audio_codec.h"
+
+#include <esp_timer.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::string TempPath(const char* name) {
+    const char* dir = getenv("TMPDIR");
+    return std::string(dir != nullptr ? dir : "/tmp") + "/" + name;
+}
+
+static std::vector<int16_t> Ramp(size_t samples) {
+    std::vector<int16_t> pcm(samples);
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = static_cast<int16_t>((i * 37) % 65536 - 32768);
+    }
+    return pcm;
+}
+
+static void WriteStereoWav(const std::string& path, int sample_rate, const std::vector<int16_t>& interleaved) {
+    uint32_t data_bytes = interleaved.size() * sizeof(int16_t);
+    uint32_t riff_size = 36 + data_bytes;
+    uint32_t format_size = 16;
+    uint16_t format[2] = { 1, 2 };
+    uint32_t rates[2] = { static_cast<uint32_t>(sample_rate), static_cast<uint32_t>(sample_rate) * 4 };
+    uint16_t layout[2] = { 4, 16 };
+    FILE* file = fopen(path.c_str(), "wb");
+    fwrite("RIFF", 1, 4, file);
+    fwrite(&riff_size, 4, 1, file);
+    fwrite("WAVEfmt ", 1, 8, file);
+    fwrite(&format_size, 4, 1, file);
+    fwrite(format, 2, 2, file);
+    fwrite(rates, 4, 2, file);
+    fwrite(layout, 2, 2, file);
+    fwrite("data", 1, 4, file);
+    fwrite(&data_bytes, 4, 1, file);
+    fwrite(interleaved.data(), sizeof(int16_t), interleaved.size(), file);
+    fclose(file);
+}
+
+// Output written to a WAV file reads back unchanged, then the input reports its end
+static void TestFileRoundTrip() {
+    const std::string path = TempPath("wav_codec_round_trip.wav");
+    const auto pcm = Ramp(16000);
+
+    WavAudioCodec writer(16000, 16000, kWavCodecFreeRunning);
+    writer.Start();
+    CHECK(writer.OpenOutput(path.c_str()));
+    for (size_t i = 0; i < pcm.size(); i += 320) {
+        std::vector<int16_t> frame(pcm.begin() + i, pcm.begin() + i + 320);
+        writer.OutputData(frame);
+    }
+    writer.CloseOutput();
+    CHECK(writer.output_samples() == pcm.size());
+
+    WavAudioCodec reader(16000, 16000, kWavCodecFreeRunning);
+    reader.Start();
+    CHECK(reader.OpenInput(path.c_str()));
+    std::vector<int16_t> read_back;
+    std::vector<int16_t> frame(480);
+    while (!reader.input_finished()) {
+        CHECK(reader.InputData(frame));
+        read_back.insert(read_back.end(), frame.begin(), frame.end());
+    }
+    CHECK(read_back.size() >= pcm.size());
+    CHECK(memcmp(read_back.data(), pcm.data(), pcm.size() * sizeof(int16_t)) == 0);
+    // Past the end the microphone reads silence
+    for (size_t i = pcm.size(); i < read_back.size(); i++) {
+        CHECK(read_back[i] == 0);
+    }
+    remove(path.c_str());
+}
+
+// Stereo files are averaged down to mono, files at another rate are rejected
+static void TestStereoInput() {
+    const std::string path = TempPath("wav_codec_stereo.wav");
+    std::vector<int16_t> interleaved;
+    for (int i = 0; i < 1000; i++) {
+        interleaved.push_back(static_cast<int16_t>(i * 10));
+        interleaved.push_back(static_cast<int16_t>(-i * 4));
+    }
+    WriteStereoWav(path, 16000, interleaved);
+
+    WavAudioCodec codec(16000, 24000, kWavCodecFreeRunning);
+    codec.Start();
+    CHECK(codec.OpenInput(path.c_str()));
+    std::vector<int16_t> frame(1000);
+    CHECK(codec.InputData(frame));
+    for (int i = 0; i < 1000; i++) {
+        CHECK(frame[i] == (i * 10 - i * 4) / 2);
+    }
+
+    WavAudioCodec wrong_rate(24000, 24000, kWavCodecFreeRunning);
+    CHECK(!wrong_rate.OpenInput(path.c_str()));
+    remove(path.c_str());
+}
+
+// A looping buffer wraps around, the capture keeps at most its limit
+static void TestBufferLoopAndCapture() {
+    const auto pcm = Ramp(100);
+    WavAudioCodec codec(16000, 16000, kWavCodecFreeRunning);
+    codec.Start();
+    codec.SetInput(pcm.data(), pcm.size(), true);
+    std::vector<int16_t> frame(250);
+    CHECK(codec.InputData(frame));
+    for (size_t i = 0; i < frame.size(); i++) {
+        CHECK(frame[i] == pcm[i % pcm.size()]);
+    }
+    CHECK(!codec.input_finished());
+
+    codec.CaptureOutput(300);
+    codec.OutputData(frame);
+    codec.OutputData(frame);
+    std::vector<int16_t> captured;
+    codec.TakeCapturedOutput(captured);
+    CHECK(captured.size() == 300);
+    CHECK(memcmp(captured.data(), frame.data(), frame.size() * sizeof(int16_t)) == 0);
+}
+
+// In real time a read returns once its last sample would have been captured
+static void TestRealTimeClock() {
+    WavAudioCodec codec(16000, 16000, kWavCodecRealTime);
+    codec.Start();
+    std::vector<int16_t> frame(320);     // 20 ms
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < 10; i++) {
+        codec.InputData(frame);
+    }
+    int64_t elapsed_ms = (esp_timer_get_time() - start) / 1000;
+    CHECK(elapsed_ms >= 170);
+    CHECK(elapsed_ms < 1000);
+}
+
+int main() {
+    TestFileRoundTrip();
+    TestStereoInput();
+    TestBufferLoopAndCapture();
+    TestRealTimeClock();
+    return HOST_TEST_RESULT();
+}
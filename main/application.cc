@@ -21,10 +21,37 @@ extern "C" {
 #include "rtc_service.h"
 #include "xl9555_keys.h"
 #include "alarm_music.h"
+#include "audio_hw.h"
 }
 
 #define TAG "Application"
 
+/* C 接口：供 SD 卡播放器 (audio_hw.c) 把 PCM 送入混音器的音乐通道或提示通道（闹钟） */
+static AudioOutputSource AudioOutputOf(int output) {
+    return output == AUDIO_HW_OUTPUT_ALERT ? kAudioOutputAlert : kAudioOutputMusic;
+}
+
+extern "C" int audio_output_sample_rate(void) {
+    return Application::GetInstance().GetAudioService().output_sample_rate();
+}
+
+extern "C" size_t audio_output_write(int output, const int16_t* pcm, size_t samples, TickType_t wait) {
+    return Application::GetInstance().GetAudioService().WriteOutput(AudioOutputOf(output), pcm, samples, wait);
+}
+
+extern "C" void audio_output_set_gain(int output, int32_t gain) {
+    Application::GetInstance().GetAudioService().SetOutputGain(AudioOutputOf(output), gain);
+}
+
+extern "C" void audio_output_clear(int output) {
+    Application::GetInstance().GetAudioService().ClearOutput(AudioOutputOf(output));
+}
+
+/* C 接口：闹钟即将响起时提前打开扬声器输出 */
+extern "C" void audio_output_prewarm(uint32_t hold_ms) {
+    Application::GetInstance().GetAudioService().PrewarmCodec(kCodecPowerOutput, hold_ms);
+}
+
 static const char* const STATE_STRINGS[] = {
     "unknown",
     "starting",
@@ -196,7 +223,7 @@ void Application::Start() {
 
     esp_timer_start_periodic(clock_timer_handle_, 1000000);
 
-    SystemInfo::PrintHeapStats();
+    SystemInfo::UpdateHeapMetrics();
     SetDeviceState(kDeviceStateIdle);
     display->ShowNotification(Lang::Strings::STANDBY);
     
@@ -278,7 +305,9 @@ void Application::MainEventLoop() {
             display->UpdateStatusBar();
         
             if (clock_ticks_ % 10 == 0) {
-                SystemInfo::PrintHeapStats();
+                SystemInfo::UpdateHeapMetrics();
+                audio_service_.UpdateCodecStatistics();
+                latency_trace_publish();
             }
         }
     }
@@ -11,14 +11,27 @@
 #include "audio_player.h"
 #include "audio_hw.h"
 #include "xl9555_keys.h"
+#include "metrics.h"
 
 static const char *TAG = "alarm_music";
 
+/* 提前唤醒扬声器输出：闹钟响起时 DAC 已经打开，第一段音乐不会被截掉 */
+#define ALARM_MUSIC_PREWARM_LEAD_S   3
+#define ALARM_MUSIC_PREWARM_HOLD_MS  ((ALARM_MUSIC_PREWARM_LEAD_S + 5) * 1000)
+
+/* 由 application.cc 提供：AudioService 的编解码器电源管理 */
+extern void audio_output_prewarm(uint32_t hold_ms);
+
+METRICS_COUNTER(metric_alarm_rings, "alarm.rings");
+METRICS_GAUGE(metric_alarm_volume, "alarm.volume");
+
 static TaskHandle_t s_alarm_music_task = NULL;
 static SemaphoreHandle_t s_alarm_music_sem = NULL;
 static volatile bool s_alarm_music_stop = false;
 static volatile uint8_t s_last_key_code = XL9555_KEY_NONE;
 
+static void alarm_music_upcoming_callback(const alarm_info_t *alarm, uint32_t seconds_left, void *ctx);
+
 /**
  * @brief 闹钟音乐任务：从低音量逐渐增大，每30秒增大一次，直到按KEY2停止
  */
@@ -43,8 +56,8 @@ static void alarm_music_task_fn(void *arg)
             current_volume = min_volume;
             last_increase_time = xTaskGetTickCount();
 
-            /* 启动音乐播放 */
-            if (audio_player_start() != ESP_OK)
+            /* 启动音乐播放：走混音器的提示通道，不会被语音压低 */
+            if (audio_player_start_on(AUDIO_HW_OUTPUT_ALERT) != ESP_OK)
             {
                 ESP_LOGE(TAG, "启动音乐播放失败");
                 continue;
@@ -52,6 +65,8 @@ static void alarm_music_task_fn(void *arg)
 
             /* 设置初始音量 */
             audio_hw_set_volume(current_volume);
+            metrics_counter_add(&metric_alarm_rings, 1);
+            metrics_gauge_set(&metric_alarm_volume, current_volume);
 
             /* 音乐持续播放并逐渐增大音量 */
             while (!s_alarm_music_stop)
@@ -68,6 +83,7 @@ static void alarm_music_task_fn(void *arg)
                         current_volume = max_volume;
                     }
                     audio_hw_set_volume(current_volume);
+                    metrics_gauge_set(&metric_alarm_volume, current_volume);
                     ESP_LOGI(TAG, "音量增大到 %u", current_volume);
                     last_increase_time = now;
                 }
@@ -88,8 +104,9 @@ static void alarm_music_task_fn(void *arg)
             /* 停止音乐播放 */
             audio_player_stop();
             
-            /* 恢复音量到默认值 */
-            audio_hw_set_volume(20);
+            /* 恢复提示通道音量，测试音等按原始电平播放 */
+            audio_hw_set_volume(AUDIO_HW_VOLUME_MAX);
+            metrics_gauge_set(&metric_alarm_volume, 0);
             ESP_LOGI(TAG, "闹钟音乐结束");
         }
     }
@@ -102,6 +119,9 @@ esp_err_t alarm_music_init(void)
         return ESP_OK;  /* 已初始化 */
     }
 
+    metrics_register(&metric_alarm_rings);
+    metrics_register(&metric_alarm_volume);
+
     s_alarm_music_sem = xSemaphoreCreateBinary();
     if (!s_alarm_music_sem)
     {
@@ -110,6 +130,7 @@ esp_err_t alarm_music_init(void)
     }
 
     s_alarm_music_stop = false;
+    alarm_service_set_upcoming_cb(ALARM_MUSIC_PREWARM_LEAD_S, alarm_music_upcoming_callback, NULL);
     return ESP_OK;
 }
 
@@ -148,6 +169,14 @@ void alarm_music_stop(void)
     }
 }
 
+static void alarm_music_upcoming_callback(const alarm_info_t *alarm, uint32_t seconds_left, void *ctx)
+{
+    (void)alarm;
+    (void)ctx;
+    (void)seconds_left;
+    audio_output_prewarm(ALARM_MUSIC_PREWARM_HOLD_MS);
+}
+
 void alarm_music_ring_callback(const alarm_info_t *alarm, void *ctx)
 {
     (void)ctx;
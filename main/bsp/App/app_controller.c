@@ -12,9 +12,14 @@
 #include "http_request.h"
 #include "sleep_analysis.h"
 #include "uart.h"
+#include "metrics.h"
 
 static const char *TAG = "app_ctrl";
 
+METRICS_COUNTER(metric_health_uploads, "health.uploads");
+METRICS_COUNTER(metric_health_upload_failures, "health.upload_failures");
+METRICS_GAUGE(metric_health_queue_depth, "health.queue_depth");
+
 static int g_heart_rate = 0;
 static int g_breathing_rate = 0;
 static float g_motion_index = 0.0f;
@@ -131,6 +136,8 @@ static void upload_data_task(void *pvParameters)
             }
             printf("正在上传数据 - 心率:%d 呼吸:%d 阶段:%s\n", data.heart_rate, data.breathing_rate, data.sleep_status);
             esp_err_t err = http_send_health_data(&data);
+            metrics_counter_add(err == ESP_OK ? &metric_health_uploads : &metric_health_upload_failures, 1);
+            metrics_gauge_set(&metric_health_queue_depth, uxQueueMessagesWaiting(s_health_queue));
             if (err != ESP_OK)
             {
                 vTaskDelay(pdMS_TO_TICKS(10000));
@@ -545,6 +552,10 @@ esp_err_t app_controller_start(void)
         return ESP_OK;
     }
 
+    metrics_register(&metric_health_uploads);
+    metrics_register(&metric_health_upload_failures);
+    metrics_register(&metric_health_queue_depth);
+
     s_health_queue = xQueueCreate(HEALTH_QUEUE_LEN, sizeof(health_data_t));
     if (!s_health_queue)
     {
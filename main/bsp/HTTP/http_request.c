@@ -59,6 +59,9 @@ static TaskHandle_t s_alarm_fetch_task = NULL;
 static TaskHandle_t s_alarm_monitor_task = NULL;
 static alarm_trigger_cb_t s_alarm_cb = NULL;
 static void *s_alarm_cb_ctx = NULL;
+static alarm_upcoming_cb_t s_alarm_upcoming_cb = NULL;
+static void *s_alarm_upcoming_ctx = NULL;
+static uint32_t s_alarm_upcoming_lead_s = 0;
 
 static void log_alarm_snapshot(const alarm_list_t *list)
 {
@@ -866,6 +869,11 @@ static void alarm_monitor_task_fn(void *arg)
                     alarm->next_trigger = alarm_compute_next_trigger(alarm, &now_tm);
                 }
 
+                if (s_alarm_upcoming_cb && alarm->next_trigger > now_ts &&
+                    alarm->next_trigger - now_ts <= (time_t)s_alarm_upcoming_lead_s) {
+                    s_alarm_upcoming_cb(alarm, (uint32_t)(alarm->next_trigger - now_ts), s_alarm_upcoming_ctx);
+                }
+
                 if (alarm_is_due(alarm, &now_tm)) {
                     if (s_alarm_cb) {
                         s_alarm_cb(alarm, s_alarm_cb_ctx);
@@ -898,6 +906,13 @@ static void alarm_monitor_task_fn(void *arg)
     }
 }
 
+void alarm_service_set_upcoming_cb(uint32_t lead_s, alarm_upcoming_cb_t cb, void *cb_ctx)
+{
+    s_alarm_upcoming_lead_s = lead_s;
+    s_alarm_upcoming_ctx = cb_ctx;
+    s_alarm_upcoming_cb = cb;
+}
+
 esp_err_t alarm_service_start(uint32_t fetch_interval_ms, alarm_trigger_cb_t cb, void *cb_ctx)
 {
     if (fetch_interval_ms >= 5000) {
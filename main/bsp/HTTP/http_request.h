@@ -40,6 +40,8 @@ typedef struct {
 } alarm_list_t;
 
 typedef void (*alarm_trigger_cb_t)(const alarm_info_t *alarm, void *user_ctx);
+/* seconds_left: 闹钟还有多少秒触发，在提前量内每次轮询都会调用 */
+typedef void (*alarm_upcoming_cb_t)(const alarm_info_t *alarm, uint32_t seconds_left, void *user_ctx);
 
 void wifi_init_sta(void);
 bool wifi_is_connected(void);
@@ -52,5 +54,7 @@ esp_err_t http_update_alarm_status(int alarm_id, int status);
 time_t alarm_compute_next_trigger(const alarm_info_t *alarm, const struct tm *now_local);
 bool alarm_is_due(const alarm_info_t *alarm, const struct tm *now_local);
 esp_err_t alarm_service_start(uint32_t fetch_interval_ms, alarm_trigger_cb_t cb, void *cb_ctx);
+/* 闹钟即将触发（lead_s 秒内）时回调，用于提前唤醒音频输出等 */
+void alarm_service_set_upcoming_cb(uint32_t lead_s, alarm_upcoming_cb_t cb, void *cb_ctx);
 
 #endif // HTTP_REQUEST_H
@@ -3,26 +3,61 @@
  * @brief 音频硬件接口实现
  * 
  * 本文件提供 I2C 总线访问接口供 XL9555 等外设使用。
- * 音频播放功能由 main 项目的 ES8388 驱动处理。
+ * 播放的 PCM 经格式转换后送入 main 项目 AudioService 混音器的音乐或提示通道，
+ * 由其与语音、提示音一起输出到 ES8388。
  */
 
 #include "audio_hw.h"
+#include <math.h>
+#include <string.h>
+#include <stdbool.h>
 #include "esp_check.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
+#include "freertos/task.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 extern void* board_get_i2c_bus(void);  // 从 board.cc 获取 I2C 总线
+// 由 application.cc 提供：AudioService 混音器的音乐/提示通道，output 为 audio_hw_output_t
+extern int audio_output_sample_rate(void);
+extern size_t audio_output_write(int output, const int16_t* pcm, size_t samples, TickType_t wait);
+extern void audio_output_set_gain(int output, int32_t gain);
+extern void audio_output_clear(int output);
 #ifdef __cplusplus
 }
 #endif
 
+#define AUDIO_HW_OUT_SAMPLES  512
+/* 降采样前的抗混叠低通 FIR：偶数阶、对称，系数 Q14（累加不会溢出 int32） */
+#define AUDIO_HW_AA_TAPS      48
+#define AUDIO_HW_AA_SHIFT     14
+
 static const char *TAG = "audio_hw";
 
 static i2c_master_bus_handle_t s_i2c_bus = NULL;
-static uint8_t s_volume = 20;
+static audio_hw_output_t s_output = AUDIO_HW_OUTPUT_MUSIC;
+static uint8_t s_volume[AUDIO_HW_OUTPUT_COUNT] = {
+    [AUDIO_HW_OUTPUT_MUSIC] = 20,
+    [AUDIO_HW_OUTPUT_ALERT] = AUDIO_HW_VOLUME_MAX,
+};
+
+/* 当前曲目的格式与转换状态，只由播放任务访问 */
+static uint8_t s_bits = 0;
+static uint8_t s_channels = 0;
+static size_t s_frame_bytes = 0;
+static uint8_t s_carry[32];             // 跨两次写入的半帧
+static size_t s_carry_len = 0;
+static uint32_t s_step = 0;             // 输入/输出采样率之比，Q16
+static uint32_t s_phase = 0;            // 输出点在 s_prev 与当前输入之间的位置，Q16
+static int16_t s_prev = 0;
+static int16_t s_out[AUDIO_HW_OUT_SAMPLES];
+static size_t s_out_len = 0;
+static bool s_aa_enabled = false;       // 输入采样率高于输出时才滤波
+static int16_t s_aa_taps[AUDIO_HW_AA_TAPS / 2];         // 对称，只存前一半
+static int16_t s_aa_history[2 * AUDIO_HW_AA_TAPS];      // 每个样本写两份，读取时不用回绕
+static size_t s_aa_pos = 0;
 
 esp_err_t audio_hw_i2c_init(void)
 {
@@ -46,33 +81,230 @@ i2c_master_bus_handle_t audio_hw_get_i2c_bus(void)
     return s_i2c_bus;
 }
 
-/* 以下为兼容性存根函数，实际音频播放由 main 项目音频系统处理 */
+/*
+ * 播放接口：把 WAV 的 PCM 转换为单声道 16 位、main 项目的输出采样率，
+ * 再写入 AudioService 混音器的音乐或提示通道。混音器缓冲满时写入会阻塞，
+ * 由此控制 SD 卡的读取速度。
+ */
+
+static int32_t volume_to_gain(uint8_t volume)
+{
+    /* ES8388 刻度：每级 1.5 dB，33 为 0 dB，0 为静音；由混音器按增益渐变 */
+    if (volume == 0) {
+        return 0;
+    }
+    return (int32_t)(32768.0f * powf(10.0f, (volume - AUDIO_HW_VOLUME_MAX) * 1.5f / 20.0f));
+}
 
 esp_err_t audio_hw_init(void)
 {
     ESP_LOGI(TAG, "音频播放使用 main 项目 ES8388 驱动");
+    for (int output = 0; output < AUDIO_HW_OUTPUT_COUNT; output++) {
+        audio_output_set_gain(output, volume_to_gain(s_volume[output]));
+    }
     return audio_hw_i2c_init();
 }
 
+void audio_hw_set_output(audio_hw_output_t output)
+{
+    if (output < AUDIO_HW_OUTPUT_COUNT) {
+        s_output = output;
+    }
+}
+
+/*
+ * 抗混叠低通：Hamming 窗 sinc，截止频率为输出采样率的 0.45 倍。
+ * 48 kHz / 44.1 kHz -> 24 kHz 时，通带（到 0.38 倍输出采样率）纹波约 0.05 dB，
+ * 会折叠进 0.45 倍输出采样率以下的频率衰减 53 dB 以上。每首曲目配置时按采样率比算一次。
+ */
+static void design_anti_alias(uint32_t input_rate, int output_rate)
+{
+    float cutoff = 0.45f * output_rate / input_rate;     // 相对输入采样率
+    float taps[AUDIO_HW_AA_TAPS / 2];
+    float sum = 0;
+    for (int i = 0; i < AUDIO_HW_AA_TAPS / 2; i++) {
+        float t = i - (AUDIO_HW_AA_TAPS - 1) / 2.0f;     // 偶数阶，t 不为 0
+        float window = 0.54f - 0.46f * cosf(2.0f * (float)M_PI * i / (AUDIO_HW_AA_TAPS - 1));
+        taps[i] = sinf(2.0f * (float)M_PI * cutoff * t) / ((float)M_PI * t) * window;
+        sum += 2 * taps[i];
+    }
+    /* 直流增益归一到 1 */
+    for (int i = 0; i < AUDIO_HW_AA_TAPS / 2; i++) {
+        s_aa_taps[i] = (int16_t)lrintf(taps[i] / sum * (1 << AUDIO_HW_AA_SHIFT));
+    }
+}
+
 esp_err_t audio_hw_configure(uint32_t sample_rate_hz, uint8_t bits_per_sample, uint8_t channels)
 {
-    /* 实际配置由 main 项目音频系统处理 */
+    int output_rate = audio_output_sample_rate();
+    if (sample_rate_hz == 0 || channels == 0 || output_rate <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (bits_per_sample != 8 && bits_per_sample != 16 && bits_per_sample != 24 && bits_per_sample != 32) {
+        ESP_LOGW(TAG, "Unsupported bit depth: %u", bits_per_sample);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (channels * (bits_per_sample / 8) > sizeof(s_carry)) {
+        ESP_LOGW(TAG, "Unsupported channel count: %u", channels);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    s_bits = bits_per_sample;
+    s_channels = channels;
+    s_frame_bytes = channels * (bits_per_sample / 8);
+    s_step = (uint32_t)(((uint64_t)sample_rate_hz << 16) / (uint32_t)output_rate);
+    s_aa_enabled = sample_rate_hz > (uint32_t)output_rate;
+    if (s_aa_enabled) {
+        design_anti_alias(sample_rate_hz, output_rate);
+    }
+    ESP_LOGI(TAG, "PCM %lu Hz %u bit %u ch -> %d Hz mono", (unsigned long)sample_rate_hz,
+             bits_per_sample, channels, output_rate);
     return ESP_OK;
 }
 
 esp_err_t audio_hw_start(void)
 {
-    return ESP_OK;
+    s_carry_len = 0;
+    s_out_len = 0;
+    s_phase = 0;
+    s_prev = 0;
+    s_aa_pos = 0;
+    memset(s_aa_history, 0, sizeof(s_aa_history));
+    return s_frame_bytes > 0 ? ESP_OK : ESP_ERR_INVALID_STATE;
 }
 
 void audio_hw_stop(void)
 {
+    s_frame_bytes = 0;
+}
+
+void audio_hw_flush(void)
+{
+    s_out_len = 0;
+    audio_output_clear(s_output);
+}
+
+/* 一帧多声道 PCM 混为单声道 16 位 */
+static int16_t frame_to_mono(const uint8_t *frame)
+{
+    int32_t sum = 0;
+    for (uint8_t ch = 0; ch < s_channels; ch++) {
+        switch (s_bits) {
+        case 8:
+            sum += ((int32_t)frame[0] - 128) << 8;
+            break;
+        case 16:
+            sum += (int16_t)(frame[0] | (frame[1] << 8));
+            break;
+        case 24:
+            sum += (int16_t)(frame[1] | (frame[2] << 8));
+            break;
+        default:
+            sum += (int16_t)(frame[2] | (frame[3] << 8));
+            break;
+        }
+        frame += s_bits / 8;
+    }
+    return (int16_t)(sum / s_channels);
+}
+
+/* 抗混叠低通，每个输入样本一次 */
+static int16_t anti_alias(int16_t sample)
+{
+    s_aa_history[s_aa_pos] = sample;
+    s_aa_history[s_aa_pos + AUDIO_HW_AA_TAPS] = sample;
+    s_aa_pos = (s_aa_pos + 1) % AUDIO_HW_AA_TAPS;
+    /* 从最旧到最新连续 AUDIO_HW_AA_TAPS 个样本，对称系数两端配对相加 */
+    const int16_t *x = s_aa_history + s_aa_pos;
+    int32_t acc = 1 << (AUDIO_HW_AA_SHIFT - 1);
+    for (int i = 0; i < AUDIO_HW_AA_TAPS / 2; i++) {
+        acc += ((int32_t)x[i] + x[AUDIO_HW_AA_TAPS - 1 - i]) * s_aa_taps[i];
+    }
+    acc >>= AUDIO_HW_AA_SHIFT;
+    if (acc > INT16_MAX) {
+        acc = INT16_MAX;
+    } else if (acc < INT16_MIN) {
+        acc = INT16_MIN;
+    }
+    return (int16_t)acc;
+}
+
+/* 混音器缓冲满时在这里等待，最多等到 deadline；未写完的留到下次 */
+static bool flush_output(TickType_t deadline)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t wait = (int32_t)(deadline - now) > 0 ? deadline - now : 0;
+    size_t written = audio_output_write(s_output, s_out, s_out_len, wait);
+    if (written < s_out_len) {
+        memmove(s_out, s_out + written, (s_out_len - written) * sizeof(int16_t));
+    }
+    s_out_len -= written;
+    return s_out_len == 0;
+}
+
+/*
+ * 线性插值重采样到输出采样率，输出缓冲放不下时先写入混音器。降采样时先经过抗混叠低通，
+ * 否则线性插值会把输出奈奎斯特频率以上的成分折叠进可听频段。
+ * 要么整帧处理完，要么什么都不改（返回 false），失败后可以用同一帧重试。
+ */
+static bool push_frame(const uint8_t *frame, TickType_t deadline)
+{
+    size_t outputs = s_phase < 0x10000 ? (0x10000 - s_phase + s_step - 1) / s_step : 0;
+    if (s_out_len + outputs > AUDIO_HW_OUT_SAMPLES && !flush_output(deadline) &&
+        s_out_len + outputs > AUDIO_HW_OUT_SAMPLES) {
+        return false;
+    }
+
+    int16_t sample = frame_to_mono(frame);
+    if (s_aa_enabled) {
+        sample = anti_alias(sample);
+    }
+    while (s_phase < 0x10000) {
+        s_out[s_out_len++] = (int16_t)(s_prev + (((int32_t)(sample - s_prev) * (int32_t)s_phase) >> 16));
+        s_phase += s_step;
+    }
+    s_phase -= 0x10000;
+    s_prev = sample;
+    return true;
 }
 
 size_t audio_hw_write(const uint8_t *data, size_t len, TickType_t timeout_ticks)
 {
-    /* 实际写入由 main 项目音频系统处理 */
-    return len;
+    if (s_frame_bytes == 0 || data == NULL) {
+        return 0;
+    }
+    TickType_t deadline = xTaskGetTickCount() + timeout_ticks;
+    size_t used = 0;
+
+    /* 上次剩下的半帧，或上次超时没送出去的整帧：送出去之后才清空 */
+    if (s_carry_len > 0) {
+        size_t n = s_frame_bytes - s_carry_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(s_carry + s_carry_len, data, n);
+        s_carry_len += n;
+        used += n;
+        if (s_carry_len < s_frame_bytes || !push_frame(s_carry, deadline)) {
+            return used;
+        }
+        s_carry_len = 0;
+    }
+
+    while (len - used >= s_frame_bytes) {
+        if (!push_frame(data + used, deadline)) {
+            return used;
+        }
+        used += s_frame_bytes;
+    }
+
+    if (used < len) {
+        s_carry_len = len - used;
+        memcpy(s_carry, data + used, s_carry_len);
+        used = len;
+    }
+    flush_output(deadline);
+    return used;
 }
 
 void audio_hw_deinit(void)
@@ -81,15 +313,15 @@ void audio_hw_deinit(void)
 
 esp_err_t audio_hw_set_volume(uint8_t volume)
 {
-    if (volume > 33) {
-        volume = 33;
+    if (volume > AUDIO_HW_VOLUME_MAX) {
+        volume = AUDIO_HW_VOLUME_MAX;
     }
-    s_volume = volume;
-    /* 实际音量控制由 main 项目音频系统处理 */
+    s_volume[s_output] = volume;
+    audio_output_set_gain(s_output, volume_to_gain(volume));
     return ESP_OK;
 }
 
 uint8_t audio_hw_get_volume(void)
 {
-    return s_volume;
+    return s_volume[s_output];
 }
@@ -23,6 +23,15 @@
 
 #define AUDIO_CODEC_ADDR      0x10
 
+#define AUDIO_HW_VOLUME_MAX   33
+
+/* 播放送入的混音器通道：音乐优先级最低，会被语音压低；提示通道优先级最高 */
+typedef enum {
+    AUDIO_HW_OUTPUT_MUSIC = 0,
+    AUDIO_HW_OUTPUT_ALERT,
+    AUDIO_HW_OUTPUT_COUNT,
+} audio_hw_output_t;
+
 /**
  * @brief 初始化共享 I2C 总线
  * @return ESP_OK 成功
@@ -39,8 +48,12 @@ esp_err_t audio_hw_init(void);
 esp_err_t audio_hw_configure(uint32_t sample_rate_hz, uint8_t bits_per_sample, uint8_t channels);
 esp_err_t audio_hw_start(void);
 void audio_hw_stop(void);
+void audio_hw_flush(void);  /* 丢弃已写入但尚未播放的音频，切歌/停止时使用 */
+/* 选择之后写入的混音器通道，只在没有播放时切换 */
+void audio_hw_set_output(audio_hw_output_t output);
+/* 阻塞直到数据交给混音器或超时，返回已处理的字节数 */
 size_t audio_hw_write(const uint8_t *data, size_t len, TickType_t timeout_ticks);
 void audio_hw_deinit(void);
-esp_err_t audio_hw_set_volume(uint8_t volume); /* 0-33 (ES8388 scale) */
+esp_err_t audio_hw_set_volume(uint8_t volume); /* 当前通道，0-33 (ES8388 scale, 1.5 dB/step, 33 = 0 dB) */
 uint8_t audio_hw_get_volume(void);
 i2c_master_bus_handle_t audio_hw_get_i2c_bus(void);
@@ -46,6 +46,7 @@ static size_t s_track_index = 0;
 static volatile bool s_skip_next = false;
 static volatile bool s_skip_prev = false;
 static size_t s_track_count = 0;
+static audio_hw_output_t s_output = AUDIO_HW_OUTPUT_MUSIC;
 
 static bool is_wav_file(const char *name)
 {
@@ -146,9 +147,13 @@ static esp_err_t play_single(const char *path)
         return ESP_FAIL;
     }
 
-    /* 配置音频参数（兼容性接口） */
-    audio_hw_configure(info.sample_rate, info.bits_per_sample, info.channels);
-    audio_hw_start();
+    /* 配置格式转换：转为单声道 16 位、输出采样率 */
+    if (audio_hw_configure(info.sample_rate, info.bits_per_sample, info.channels) != ESP_OK ||
+        audio_hw_start() != ESP_OK) {
+        ESP_LOGW(TAG, "skip unsupported format: %s", path);
+        f_close(&file);
+        return ESP_FAIL;
+    }
 
     uint8_t *buf = (uint8_t *)heap_caps_malloc(AUDIO_IO_BUF_SIZE, MALLOC_CAP_DEFAULT);
     if (!buf) {
@@ -160,17 +165,27 @@ static esp_err_t play_single(const char *path)
     ESP_LOGI(TAG, "play %s (%lu Hz, %u bit, %u ch)", path, 
              (unsigned long)info.sample_rate, info.bits_per_sample, info.channels);
 
-    while (!s_stop && !s_skip_next && !s_skip_prev) {
+    uint32_t remaining = info.data_size ? info.data_size : UINT32_MAX;   /* 0：流式写出的 WAV，读到文件尾 */
+    while (!s_stop && !s_skip_next && !s_skip_prev && remaining > 0) {
         UINT br = 0;
-        fr = f_read(&file, buf, AUDIO_IO_BUF_SIZE, &br);
+        UINT to_read = remaining < AUDIO_IO_BUF_SIZE ? remaining : AUDIO_IO_BUF_SIZE;
+        fr = f_read(&file, buf, to_read, &br);
         if (fr != FR_OK || br == 0) {
             break;
         }
+        remaining -= br;
 
-        audio_hw_write(buf, br, pdMS_TO_TICKS(500));
+        /* 混音器缓冲满时阻塞，SD 卡按播放速度读取；超时未写完的部分继续写，直到写完或停止/切歌 */
+        size_t written = 0;
+        while (written < br && !s_stop && !s_skip_next && !s_skip_prev) {
+            written += audio_hw_write(buf + written, br - written, pdMS_TO_TICKS(500));
+        }
     }
 
     free(buf);
+    if (s_stop || s_skip_next || s_skip_prev) {
+        audio_hw_flush();
+    }
     audio_hw_stop();
     f_close(&file);
     return ESP_OK;
@@ -268,15 +283,26 @@ esp_err_t audio_player_init(void)
 }
 
 esp_err_t audio_player_start(void)
+{
+    return audio_player_start_on(AUDIO_HW_OUTPUT_MUSIC);
+}
+
+esp_err_t audio_player_start_on(audio_hw_output_t output)
 {
     if (!s_inited) {
         ESP_RETURN_ON_ERROR(audio_player_init(), TAG, "init before start");
     }
 
     if (s_audio_task) {
-        return ESP_OK;
+        if (s_output == output) {
+            return ESP_OK;
+        }
+        /* 例如助眠音乐播放中闹钟响起：换到提示通道重新开始 */
+        audio_player_stop();
     }
 
+    s_output = output;
+    audio_hw_set_output(output);
     s_stop = false;
     BaseType_t res = xTaskCreate(audio_task, "audio_player", AUDIO_TASK_STACK, NULL, AUDIO_TASK_PRIO, &s_audio_task);
     return (res == pdPASS) ? ESP_OK : ESP_FAIL;
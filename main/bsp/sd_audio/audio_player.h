@@ -11,9 +11,13 @@ extern "C" {
 
 #include <stdbool.h>
 #include "esp_err.h"
+#include "audio_hw.h"
 
 esp_err_t audio_player_init(void);
+/* 在音乐通道播放（助眠音乐） */
 esp_err_t audio_player_start(void);
+/* 在指定通道播放；正在别的通道播放时先停止再重新开始 */
+esp_err_t audio_player_start_on(audio_hw_output_t output);
 void audio_player_stop(void);
 bool audio_player_is_running(void);
 void audio_player_next(void);
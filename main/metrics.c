@@ -0,0 +1,97 @@
+#include "metrics.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "metrics";
+
+// Prepended under the lock, readers walk the list without it
+static metric_t* s_head = NULL;
+static portMUX_TYPE s_register_mux = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct {
+    char* buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+} writer_t;
+
+static void append(writer_t* w, const char* format, ...)
+{
+    if (w->overflow) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(w->buffer + w->length, w->size - w->length, format, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= w->size - w->length) {
+        w->overflow = true;
+        return;
+    }
+    w->length += n;
+}
+
+void metrics_register(metric_t* metric)
+{
+    portENTER_CRITICAL(&s_register_mux);
+    if (!metric->registered) {
+        metric->registered = true;
+        metric->next = s_head;
+        __atomic_store_n(&s_head, metric, __ATOMIC_RELEASE);
+    }
+    portEXIT_CRITICAL(&s_register_mux);
+}
+
+void metrics_histogram_record(metric_t* metric, uint32_t value)
+{
+    uint8_t i = 0;
+    while (i < metric->bucket_count - 1 && value > metric->bounds[i]) {
+        i++;
+    }
+    __atomic_fetch_add(&metric->buckets[i], 1, __ATOMIC_RELAXED);
+}
+
+size_t metrics_snapshot(char* buffer, size_t size)
+{
+    writer_t w = { .buffer = buffer, .size = size, .length = 0, .overflow = size == 0 };
+    append(&w, "{\"type\":\"metrics\",\"uptime_ms\":%lu,\"metrics\":{",
+        (unsigned long)(esp_timer_get_time() / 1000));
+
+    bool first = true;
+    for (metric_t* m = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE); m != NULL; m = m->next) {
+        append(&w, "%s\"%s\":", first ? "" : ",", m->name);
+        first = false;
+        int32_t value = __atomic_load_n(&m->value, __ATOMIC_RELAXED);
+        switch (m->type) {
+        case kMetricCounter:
+            append(&w, "%lu", (unsigned long)(uint32_t)value);
+            break;
+        case kMetricGauge:
+            append(&w, "%ld", (long)value);
+            break;
+        case kMetricHistogram:
+            append(&w, "{\"le\":[");
+            for (uint8_t i = 0; i + 1 < m->bucket_count; i++) {
+                append(&w, "%s%lu", i == 0 ? "" : ",", (unsigned long)m->bounds[i]);
+            }
+            append(&w, "],\"n\":[");
+            for (uint8_t i = 0; i < m->bucket_count; i++) {
+                append(&w, "%s%lu", i == 0 ? "" : ",",
+                    (unsigned long)__atomic_load_n(&m->buckets[i], __ATOMIC_RELAXED));
+            }
+            append(&w, "]}");
+            break;
+        }
+    }
+    append(&w, "}}");
+
+    if (w.overflow) {
+        ESP_LOGW(TAG, "Snapshot does not fit in %u bytes", (unsigned int)size);
+        return 0;
+    }
+    return w.length;
+}
@@ -0,0 +1,82 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Allocation-free metrics registry.
+ *
+ * A module defines its metrics statically with the METRICS_* macros and registers them once
+ * at init. Updates are single atomic operations and can be made from any task or ISR.
+ * metrics_snapshot() serializes every registered metric into a compact JSON object:
+ *
+ *   {"type":"metrics","uptime_ms":123,"metrics":{"audio.decode_frames":42,
+ *    "audio.decode_us":{"le":[1000,5000],"n":[40,2,0]}}}
+ *
+ * Histogram buckets are not cumulative: n[i] counts values in (le[i - 1], le[i]], and
+ * the last count is everything above the last bound.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_SNAPSHOT_MAX_SIZE   2048
+
+typedef enum {
+    kMetricCounter = 0,
+    kMetricGauge,
+    kMetricHistogram,
+} metric_type_t;
+
+typedef struct metric {
+    const char* name;
+    metric_type_t type;
+    int32_t value;                  // counter (as uint32_t) or gauge
+    const uint32_t* bounds;         // histogram upper bounds, ascending
+    uint32_t* buckets;              // bucket_count counts, one more than bounds
+    uint8_t bucket_count;
+    bool registered;
+    struct metric* next;
+} metric_t;
+
+#define METRICS_COUNTER(var, metric_name) \
+    static metric_t var = { metric_name, kMetricCounter, 0, NULL, NULL, 0, false, NULL }
+
+#define METRICS_GAUGE(var, metric_name) \
+    static metric_t var = { metric_name, kMetricGauge, 0, NULL, NULL, 0, false, NULL }
+
+// METRICS_HISTOGRAM(decode_us, "audio.decode_us", 1000, 5000, 20000)
+#define METRICS_HISTOGRAM(var, metric_name, ...) \
+    static const uint32_t var##_bounds[] = { __VA_ARGS__ }; \
+    static uint32_t var##_buckets[sizeof(var##_bounds) / sizeof(uint32_t) + 1]; \
+    static metric_t var = { metric_name, kMetricHistogram, 0, var##_bounds, var##_buckets, \
+        sizeof(var##_bounds) / sizeof(uint32_t) + 1, false, NULL }
+
+// Idempotent, metrics are never unregistered so they must have static storage
+void metrics_register(metric_t* metric);
+
+static inline void metrics_counter_add(metric_t* metric, uint32_t n) {
+    __atomic_fetch_add((uint32_t*)&metric->value, n, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_gauge_set(metric_t* metric, int32_t value) {
+    __atomic_store_n(&metric->value, value, __ATOMIC_RELAXED);
+}
+
+static inline int32_t metrics_value(const metric_t* metric) {
+    return __atomic_load_n(&metric->value, __ATOMIC_RELAXED);
+}
+
+void metrics_histogram_record(metric_t* metric, uint32_t value);
+
+// Writes the JSON snapshot, returns its length or 0 if it did not fit
+size_t metrics_snapshot(char* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H
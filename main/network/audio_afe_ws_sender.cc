@@ -5,7 +5,9 @@
 #include "pwm_test.h"
 #include "assets/lang_config.h"
 #include "audio_player.h"
+#include "metrics.h"
 #include <esp_log.h>
+#include <opus.h>
 #include <memory>
 #include <string>
 #include <algorithm>
@@ -22,10 +24,20 @@ extern "C" void audio_afe_ws_sender_init(void) {
         return;
     }
     
-    // 无论 ws_ready 状态如何，都要确保回调已设置
-    // 设置连接状态回调
-    audio_uploader_set_connected_cb([]() {
+    // 无论 ws_ready 状态如何，都要确保回调已注册（重复注册同一个函数只算一次）
+    // 连接状态监听，灯光等其他模块另行注册
+    audio_uploader_add_connected_cb([]() {
         ESP_LOGI(TAG, "WebSocket connected to server");
+        // 上报当前使用的上行帧长，服务端可回复 (frame_duration,N) 改用其他帧长
+        // 重连后沿用上次协商的帧长，和编码器实际输出保持一致
+        int frame_ms = g_service ? g_service->frame_duration_ms() : OPUS_FRAME_DURATION_MS;
+        char payload[32];
+        int len = snprintf(payload, sizeof(payload), "(frame_duration,%d)", frame_ms);
+        if (len > 0 && len < (int)sizeof(payload)) {
+            audio_uploader_send_text(payload);
+        }
+        // 提议上行帧头（序号、采集时间、帧长），服务端回复 (uplink_header,1) 后启用
+        audio_uploader_offer_header();
         auto display = Board::GetInstance().GetDisplay();
         if (display) {
             display->ShowNotification("已连接服务器", 2000);
@@ -33,7 +45,7 @@ extern "C" void audio_afe_ws_sender_init(void) {
     });
     
     // 设置断开连接回调
-    audio_uploader_set_disconnected_cb([]() {
+    audio_uploader_add_disconnected_cb([]() {
         ESP_LOGW(TAG, "WebSocket disconnected from server");
         auto display = Board::GetInstance().GetDisplay();
         if (display) {
@@ -62,7 +74,7 @@ void audio_afe_ws_send(const int16_t *data, int samples) {
 // 挂载到 AudioService 的 AFE输出回调
 void audio_afe_ws_hook(AudioService* service) {
     g_service = service;
-    service->SetAfeOutputCallback([](std::vector<int16_t>&& pcm) {
+    service->SetAfeOutputCallback([](const std::vector<int16_t>& pcm) {
         audio_afe_ws_send(pcm.data(), pcm.size());
     });
 }
@@ -80,23 +92,45 @@ void audio_afe_ws_attach_send_callbacks(AudioService* service, AudioServiceCallb
     };
 }
 
-// 将服务端推送的 Opus 二进制数据放入解码队列
-void audio_afe_ws_attach_downlink(AudioService* service) {
-    g_service = service;
-    audio_uploader_set_binary_cb([](const uint8_t* data, size_t len) {
-        if (!g_service || !data || len == 0) {
+// 正在接收的下行包，只在 WebSocket 事件任务中访问
+// 从 AudioService 的包池取对象，分片直接写进 payload，收齐后整包送去解码，中间不再拷贝
+static AudioStreamPacketPtr g_downlink_packet;
+
+static const audio_uploader_binary_sink_t kDownlinkSink = {
+    .begin = [](size_t len, void** frame) -> uint8_t* {
+        if (!g_service) {
+            return nullptr;
+        }
+        g_downlink_packet = g_service->AcquirePacket();
+        g_downlink_packet->receive_time = latency_trace_now();
+        // payload 复用预留容量，常见大小的包不产生堆分配
+        g_downlink_packet->payload.resize(len);
+        *frame = g_downlink_packet.get();
+        return g_downlink_packet->payload.data();
+    },
+    .complete = [](void* frame, size_t len) {
+        auto packet = std::move(g_downlink_packet);
+        if (!packet || !g_service) {
             return;
         }
-
-        auto packet = std::make_unique<AudioStreamPacket>();
         packet->sample_rate = 24000;                 // 匹配硬件输出采样率，避免重采样
-        packet->frame_duration = OPUS_FRAME_DURATION_MS;
-        packet->payload.assign(data, data + len);
-
+        // 帧长从 Opus TOC 读取，服务端切换帧长时解码器和抖动缓冲随之调整
+        int samples = opus_packet_get_nb_samples(packet->payload.data(), len, packet->sample_rate);
+        packet->frame_duration = samples > 0 ? samples * 1000 / packet->sample_rate : g_service->frame_duration_ms();
         if (!g_service->PushPacketToDecodeQueue(std::move(packet), false)) {
             ESP_LOGW(TAG, "decode queue full, drop downstream audio len=%d", (int)len);
         }
-    });
+    },
+    .discard = [](void* frame) {
+        // 包回到池里
+        g_downlink_packet.reset();
+    },
+};
+
+// 将服务端推送的 Opus 二进制数据放入解码队列
+void audio_afe_ws_attach_downlink(AudioService* service) {
+    g_service = service;
+    audio_uploader_set_binary_sink(&kDownlinkSink);
 
     audio_uploader_set_text_cb([](const char* data, size_t len) {
         ESP_LOGI(TAG, "WS text: %.*s", (int)len, data);
@@ -133,6 +167,68 @@ void audio_afe_ws_attach_downlink(AudioService* service) {
             amplitude = 100;
         }
 
+        if (cmd == "metrics") {
+            // 拉取指标快照（JSON），用于远程监控
+            static char snapshot[METRICS_SNAPSHOT_MAX_SIZE];
+            if (metrics_snapshot(snapshot, sizeof(snapshot)) > 0) {
+                audio_uploader_send_text_on(WS_CHANNEL_TELEMETRY, snapshot);
+            }
+            return;
+        }
+
+        if (cmd == "latency_dump") {
+            // 把最近的逐帧延迟打点输出到日志，供 scripts/latency_timeline.py 解析
+            latency_trace_dump();
+            return;
+        }
+
+        if (cmd == "audio_debug") {
+            // 运行时选择音频调试抓取点（AudioDebugTap 位掩码，0 关闭），数据经 UDP 发往调试主机
+            if (g_service) {
+                g_service->SetAudioDebugTaps(comma == std::string::npos ? 0 : amplitude);
+            }
+            return;
+        }
+
+        if (cmd == "uplink_header") {
+            // 服务端接受的上行帧头版本，0 表示继续发送裸 Opus
+            audio_uploader_set_header_version(comma == std::string::npos ? 0 : amplitude);
+            return;
+        }
+
+        if (cmd == "uplink_ack" || cmd == "uplink_resume") {
+            // 序号和毫秒值都可能超出 amplitude 的范围，单独解析
+            char* end = nullptr;
+            unsigned long value = strtoul(amp_str.c_str(), &end, 10);
+            if (amp_str.empty() || *end != '\0') {
+                return;
+            }
+            if (cmd == "uplink_ack") {
+                // 服务端已收到该序号及之前的上行包
+                audio_uploader_ack((uint16_t)value);
+            } else {
+                // 断线补发的新鲜度上限 (ms)
+                audio_uploader_set_resume_max_age((uint32_t)value);
+            }
+            return;
+        }
+
+        if (cmd == "tts_stop") {
+            // 服务端发完了本次回复，抖动缓冲放空后直接结束，不再做丢包隐藏
+            if (g_service) {
+                g_service->EndDownlinkStream();
+            }
+            return;
+        }
+
+        if (cmd == "frame_duration") {
+            // 服务端协商的帧长 (20/40/60ms)，编码器和 AFE 分帧在下一帧生效
+            if (g_service) {
+                g_service->SetFrameDuration(amplitude);
+            }
+            return;
+        }
+
         if (cmd == "brightness_down" ||
             cmd == "brightness_up" ||
             cmd == "tem_down" ||
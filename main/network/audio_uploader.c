@@ -1,39 +1,216 @@
 #include "audio_uploader.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "esp_websocket_client.h"
+#include "sdkconfig.h"
+#include "metrics.h"
+#include "record_ring.h"
 
 // ---------------- 配置 ----------------
 #define WEBSOCKET_URI           "ws://118.195.133.25:6060/esp32"
 #define TAG                     "WS_UPLOADER"
 
-#define SEND_QUEUE_LEN          150        // Opus 60ms帧，约9秒缓冲
+#define SEND_RING_BYTES         (64 * 1024) // 20ms帧约100字节/条（含记录头），约12秒缓冲
+#define SEND_MAX_PACKET         1024       // 单包上限，避免触发WebSocket分片
+#define PRODUCER_WAIT_MS        20         // 生产者之间等待预留的最长时间
 #define WS_SEND_TIMEOUT_MS      1000
+#define WS_BUFFER_BYTES         4096       // 客户端收发缓冲各一块；更大的下行帧分片到达后重组，上行单包 ≤ SEND_MAX_PACKET
+#define CONTROL_RING_BYTES      2048       // 控制通道：灯光、音量、协商，每条几十字节
+#define TELEMETRY_RING_BYTES    8192       // 遥测通道：指标快照（≤ METRICS_SNAPSHOT_MAX_SIZE）、延迟统计
+#define MIN_SEND_INTERVAL_MS    5          // 最小发送间隔，避免过于频繁导致帧问题
+#define MAX_SEND_FAILURES       5          // 连续失败这么多次认为断开
+#define DOWNLINK_MAX_FRAME      8192       // 下行二进制帧上限，超过整帧丢弃
+
+// 断线续传：保留窗口内的包，重连后按序补发服务端未确认的部分
+#define RESUME_WINDOW_MS        CONFIG_AUDIO_UPLINK_RESUME_WINDOW_MS    // 0 关闭，断线即清空
+#define RESUME_MAX_AGE_MS       CONFIG_AUDIO_UPLINK_RESUME_MAX_AGE_MS   // 发送时超过这个年龄的包直接丢弃
+#define RESUME_HANDSHAKE_MS     500        // 重连后等待帧头协商的最长时间，协商前不补发
+#define RESUME_POLL_MS          200        // 断连期间检查过期包的间隔
 
 // ---------------- 状态管理 ----------------
 static esp_websocket_client_handle_t ws_client = NULL;
-static QueueHandle_t send_queue = NULL;
+// 发送环中的一条记录：记录头之后紧跟 len 字节数据，编码器可以直接写入
+// 线上帧头 wire 紧贴数据，协商后两者作为一个连续的二进制包发出，不需要再拷贝
+typedef struct {
+    uint32_t traced;
+    latency_trace_t trace;
+    uint8_t sent;                   // 发出过一次，再发就是补发
+    uint8_t reserved;               // 让数据保持 4 字节对齐
+    audio_uplink_header_t wire;
+} send_record_t;
+
+_Static_assert(offsetof(send_record_t, wire) + sizeof(audio_uplink_header_t) == sizeof(send_record_t),
+               "wire header must sit directly before the record data");
+_Static_assert(sizeof(send_record_t) % 4 == 0, "record data must stay aligned");
+
+static record_ring_t send_ring;
+static SemaphoreHandle_t producer_mutex = NULL;  // 生产者串行化，发送任务一侧无锁
 static TaskHandle_t send_task_handle = NULL;
-static SemaphoreHandle_t ws_mutex = NULL;
+static record_ring_t control_ring;
+static record_ring_t telemetry_ring;
+static SemaphoreHandle_t text_mutex = NULL;      // 文本生产者串行化，两个文本环共用
 
 static volatile bool is_connected = false;
-
-static audio_uploader_binary_cb_t binary_cb = NULL;
+static volatile bool clear_requested = false;   // 断连：保留窗口为 0 时清空，否则从头补发
+static send_record_t* reserved_record = NULL;   // 持有 producer_mutex 的生产者预留的记录
+static uint16_t reserved_sequence = 0;
+static uint16_t next_sequence = 0;              // 生产者持有 producer_mutex 时递增，跨连接连续
+static volatile uint8_t header_version = 0;
+static volatile bool header_negotiated = false; // 本连接服务端已回复 uplink_header
+static volatile bool header_offered = false;    // 本连接已发出 uplink_header 提议，没发就不等协商
+static volatile bool connect_pending = false;   // 连接监听还在执行，提议可能马上入队
+static volatile TickType_t connected_tick = 0;
+
+// 环中 [head, send_pos) 是已发出、等待确认的包，[send_pos, tail) 是未发送的包
+// send_pos 和 retained 只由发送任务修改
+static uint32_t send_pos = 0;
+static volatile uint32_t retained = 0;          // [head, send_pos) 中的包数
+static volatile bool acks_active = false;       // 本连接收到过确认，之后发出的包留到确认为止
+static volatile bool ack_pending = false;
+static volatile uint16_t acked_sequence = 0;
+static volatile uint32_t resume_max_age_ms = RESUME_MAX_AGE_MS;
+
+// 发送任务私有
+static TickType_t last_send_time = 0;
+static int consecutive_failures = 0;
+
+static const audio_uploader_binary_sink_t *binary_sink = NULL;
 static audio_uploader_text_cb_t text_cb = NULL;
-static audio_uploader_connected_cb_t connected_cb = NULL;
-static audio_uploader_disconnected_cb_t disconnected_cb = NULL;
-
+// 注册在初始化阶段完成；先写槽位再发布计数，事件任务只读已发布的部分
 typedef struct {
-    size_t len;
-    uint8_t* buf; 
-} queue_item_t;
+    void (*cbs[AUDIO_UPLOADER_MAX_LISTENERS])(void);
+    volatile int count;
+} listener_list_t;
+
+static listener_list_t connected_listeners;
+static listener_list_t disconnected_listeners;
+
+// 正在接收的下行二进制帧，只在 WebSocket 事件任务中访问
+// 客户端缓冲放不下的帧分多次 DATA 事件到达（payload_offset / payload_len），按偏移直接写进 sink 给的缓冲
+static struct {
+    uint8_t *buf;
+    void *frame;
+    size_t len;             // 整帧长度
+    size_t received;
+    bool active;
+} downlink;
 
 static void clear_queue(void);
+static void request_clear_queue(void);
+static void downlink_discard(void);
+
+METRICS_COUNTER(metric_sent_packets, "ws.sent_packets");
+METRICS_COUNTER(metric_dropped_packets, "ws.dropped_packets");
+METRICS_COUNTER(metric_send_failures, "ws.send_failures");
+METRICS_COUNTER(metric_sent_text, "ws.sent_text");
+METRICS_COUNTER(metric_text_dropped, "ws.text_dropped");
+METRICS_COUNTER(metric_disconnects, "ws.disconnects");
+METRICS_COUNTER(metric_resent_packets, "ws.resent_packets");
+METRICS_COUNTER(metric_expired_packets, "ws.expired_packets");
+METRICS_COUNTER(metric_downlink_fragmented, "ws.downlink_fragmented");
+METRICS_COUNTER(metric_downlink_reassembled, "ws.downlink_reassembled");
+METRICS_COUNTER(metric_downlink_discarded, "ws.downlink_discarded");
+METRICS_GAUGE(metric_connected, "ws.connected");
+METRICS_HISTOGRAM(metric_uplink_delay_ms, "ws.uplink_delay_ms", 20, 50, 100, 200, 500, 1000);
+
+static bool listener_add(listener_list_t *list, void (*cb)(void)) {
+    if (cb == NULL) {
+        return false;
+    }
+    int count = list->count;
+    for (int i = 0; i < count; i++) {
+        if (list->cbs[i] == cb) {
+            return true;
+        }
+    }
+    if (count >= AUDIO_UPLOADER_MAX_LISTENERS) {
+        ESP_LOGE(TAG, "连接事件监听已满");
+        return false;
+    }
+    list->cbs[count] = cb;
+    __atomic_store_n(&list->count, count + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void listeners_notify(listener_list_t *list) {
+    int count = __atomic_load_n(&list->count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        list->cbs[i]();
+    }
+}
+
+// ---------------- 下行重组 ----------------
+static void downlink_discard(void) {
+    if (!downlink.active) {
+        return;
+    }
+    if (binary_sink && binary_sink->discard) {
+        binary_sink->discard(downlink.frame);
+    }
+    downlink.active = false;
+    metrics_counter_add(&metric_downlink_discarded, 1);
+}
+
+static void downlink_receive(const esp_websocket_event_data_t *data) {
+    if (binary_sink == NULL || data->data_len <= 0) {
+        return;
+    }
+    size_t offset = data->payload_offset;
+    size_t chunk = data->data_len;
+    size_t total = data->payload_len > 0 ? data->payload_len : chunk;
+
+    if (offset == 0) {
+        // 新帧开始；上一帧没收齐说明中间丢了事件，整帧作废
+        downlink_discard();
+        if (data->op_code == WS_TRANSPORT_OPCODES_CONT) {
+            // 消息级分片（多个 WebSocket 帧组成一条消息）服务端不应使用，不支持
+            metrics_counter_add(&metric_downlink_discarded, 1);
+            return;
+        }
+        if (total > DOWNLINK_MAX_FRAME) {
+            ESP_LOGW(TAG, "下行帧过大 (%d bytes)，丢弃", (int)total);
+            metrics_counter_add(&metric_downlink_discarded, 1);
+            return;
+        }
+        downlink.buf = binary_sink->begin(total, &downlink.frame);
+        if (downlink.buf == NULL) {
+            metrics_counter_add(&metric_downlink_discarded, 1);
+            return;
+        }
+        downlink.len = total;
+        downlink.received = 0;
+        downlink.active = true;
+        if (chunk < total) {
+            metrics_counter_add(&metric_downlink_fragmented, 1);
+        }
+    } else if (!downlink.active || offset != downlink.received || total != downlink.len) {
+        // 接不上的后续分片：帧头已经丢了，只能等下一帧
+        if (downlink.active) {
+            downlink_discard();
+        }
+        return;
+    }
+
+    if (chunk > downlink.len - downlink.received) {
+        downlink_discard();
+        return;
+    }
+    memcpy(downlink.buf + offset, data->data_ptr, chunk);
+    downlink.received += chunk;
+    if (downlink.received == downlink.len) {
+        downlink.active = false;
+        if (downlink.len > chunk) {
+            metrics_counter_add(&metric_downlink_reassembled, 1);
+        }
+        binary_sink->complete(downlink.frame, downlink.len);
+    }
+}
 
 // ---------------- WebSocket 事件处理 ----------------
 static void websocket_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data) {
@@ -42,26 +219,46 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base, i
     switch (event_id) {
         case WEBSOCKET_EVENT_CONNECTED:
             ESP_LOGI(TAG, "WebSocket Connected!");
+            // 新连接重新协商帧头和确认；序号延续，服务端据此去掉补发的重复包
+            header_version = 0;
+            header_negotiated = false;
+            header_offered = false;
+            acks_active = false;
+            connected_tick = xTaskGetTickCount();
+            connect_pending = true;
             is_connected = true;
-            if (connected_cb) {
-                connected_cb();
+            metrics_gauge_set(&metric_connected, 1);
+            listeners_notify(&connected_listeners);
+            connect_pending = false;
+            if (send_task_handle) {
+                xTaskNotifyGive(send_task_handle);
             }
             break;
 
         case WEBSOCKET_EVENT_DISCONNECTED:
             ESP_LOGW(TAG, "WebSocket Disconnected!");
             is_connected = false;
-            clear_queue();
-            if (disconnected_cb) {
-                disconnected_cb();
-            }
+            metrics_gauge_set(&metric_connected, 0);
+            metrics_counter_add(&metric_disconnects, 1);
+            request_clear_queue();
+            downlink_discard();
+            listeners_notify(&disconnected_listeners);
             break;
 
         case WEBSOCKET_EVENT_DATA:
-            if (data->op_code == WS_TRANSPORT_OPCODES_BINARY) {
-                if (binary_cb) binary_cb((const uint8_t*)data->data_ptr, data->data_len);
+            if (data->op_code == WS_TRANSPORT_OPCODES_BINARY ||
+                (data->op_code == WS_TRANSPORT_OPCODES_CONT && data->payload_offset == 0) ||
+                (data->payload_offset > 0 && downlink.active)) {
+                downlink_receive(data);
             } else if (data->op_code == WS_TRANSPORT_OPCODES_TEXT) {
-                if (text_cb) text_cb((const char*)data->data_ptr, data->data_len);
+                // 文本命令都很短，放不进一个缓冲的直接丢弃
+                if (data->payload_offset != 0 || data->payload_len > data->data_len) {
+                    if (data->payload_offset == 0) {
+                        ESP_LOGW(TAG, "下行文本过长 (%d bytes)，丢弃", data->payload_len);
+                    }
+                } else if (text_cb) {
+                    text_cb((const char*)data->data_ptr, data->data_len);
+                }
             }
             break;
 
@@ -73,89 +270,322 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base, i
 
 // 新增：清空队列
 // 当网络断开时，必须清空积压的旧数据，否则重连后你会听到几秒前的录音，产生巨大延迟
+// 只在发送任务（环的消费者）中调用，其他任务通过 request_clear_queue() 请求
+// 开启续传（RESUME_WINDOW_MS > 0）时改为 rewind_queue()，延迟由新鲜度上限控制
 static void clear_queue() {
-    queue_item_t item;
+    size_t len;
     int dropped_count = 0;
-    while (xQueueReceive(send_queue, &item, 0) == pdTRUE) {
-        if (item.buf) free(item.buf);
+    while (record_ring_peek(&send_ring, &len) != NULL) {
+        record_ring_consume(&send_ring);
         dropped_count++;
     }
+    send_pos = record_ring_head(&send_ring);
+    retained = 0;
+    metrics_counter_add(&metric_dropped_packets, dropped_count);
     if (dropped_count > 0) {
         ESP_LOGW(TAG, "网络中断，丢弃积压音频包: %d 个", dropped_count);
     }
 }
 
+static void request_clear_queue(void) {
+    clear_requested = true;
+    if (send_task_handle) {
+        xTaskNotifyGive(send_task_handle);
+    }
+}
+
+// 以下只在发送任务中调用
+static inline bool is_sent(uint32_t position) {
+    return (int32_t)(send_pos - position) > 0;
+}
+
+// 释放 head 处的记录；head 追上 send_pos 时（跳过回绕标记后）send_pos 跟着前移
+static void release_head(void) {
+    if (is_sent(record_ring_head(&send_ring))) {
+        retained--;
+    }
+    record_ring_consume(&send_ring);
+    if ((int32_t)(send_pos - record_ring_head(&send_ring)) < 0) {
+        send_pos = record_ring_head(&send_ring);
+    }
+}
+
+// 断连：已发未确认的包从头再发一遍
+static void rewind_queue(void) {
+    size_t len;
+    record_ring_peek(&send_ring, &len);
+    send_pos = record_ring_head(&send_ring);
+    if (retained > 0) {
+        ESP_LOGI(TAG, "网络中断，%u 个未确认的音频包待重连后补发", (unsigned)retained);
+    }
+    retained = 0;
+}
+
+// 服务端确认了 sequence 及之前的包（同一 TCP 连接内按序到达）
+static void release_acked(uint16_t sequence) {
+    size_t len;
+    uint8_t* record;
+    while ((record = record_ring_peek(&send_ring, &len)) != NULL && is_sent(record_ring_head(&send_ring))) {
+        const send_record_t* header = (const send_record_t*)record;
+        if ((int16_t)(header->wire.sequence - sequence) > 0) {
+            break;
+        }
+        release_head();
+    }
+}
+
+// 没有确认时发出即释放；有确认时留到确认或超出保留窗口
+static void release_sent(void) {
+    size_t len;
+    bool keep = RESUME_WINDOW_MS > 0 && acks_active;
+    while (record_ring_peek(&send_ring, &len) != NULL && is_sent(record_ring_head(&send_ring))) {
+        if (keep) {
+            break;
+        }
+        release_head();
+    }
+}
+
+// 超出保留窗口的包无论发没发都释放，未发的计为丢弃
+static void trim_expired(void) {
+    size_t len;
+    uint8_t* record;
+    uint32_t now = latency_trace_now();
+    int expired = 0;
+    while ((record = record_ring_peek(&send_ring, &len)) != NULL) {
+        const send_record_t* header = (const send_record_t*)record;
+        if ((now - header->wire.capture_us) / 1000 <= RESUME_WINDOW_MS) {
+            break;
+        }
+        if (!is_sent(record_ring_head(&send_ring))) {
+            expired++;
+        }
+        release_head();
+    }
+    if (expired > 0) {
+        metrics_counter_add(&metric_dropped_packets, expired);
+        metrics_counter_add(&metric_expired_packets, expired);
+        ESP_LOGW(TAG, "超出续传窗口，丢弃音频包: %d 个", expired);
+    }
+}
+
+// send_pos 处的包已处理（发出或过期），移到下一个
+static void advance_send_pos(void) {
+    record_ring_advance(&send_ring, &send_pos);
+    retained++;
+    release_sent();
+}
+
+// ---------------- 文本通道 ----------------
+static void clear_text_rings(void) {
+    size_t len;
+    while (record_ring_peek(&control_ring, &len) != NULL) {
+        record_ring_consume(&control_ring);
+    }
+    while (record_ring_peek(&telemetry_ring, &len) != NULL) {
+        record_ring_consume(&telemetry_ring);
+    }
+}
+
 // ---------------- 发送任务 (消费者) ----------------
+// 连接上唯一的发送者，所以不需要 WebSocket 锁。失败时返回 false，
+// 连续失败达到上限时标记断开，由主循环按断连处理
+static bool ws_send(bool text, const uint8_t *data, size_t len) {
+    // 确保发送间隔，避免帧合并或异常
+    TickType_t elapsed = xTaskGetTickCount() - last_send_time;
+    if (elapsed < pdMS_TO_TICKS(MIN_SEND_INTERVAL_MS)) {
+        vTaskDelay(pdMS_TO_TICKS(MIN_SEND_INTERVAL_MS) - elapsed);
+    }
+    int ret;
+    if (text) {
+        ret = esp_websocket_client_send_text(ws_client, (const char*)data, len, pdMS_TO_TICKS(WS_SEND_TIMEOUT_MS));
+    } else {
+        ret = esp_websocket_client_send_bin(ws_client, (const char*)data, len, pdMS_TO_TICKS(WS_SEND_TIMEOUT_MS));
+    }
+    last_send_time = xTaskGetTickCount();
+    if (ret >= 0) {
+        consecutive_failures = 0;
+        return true;
+    }
+
+    metrics_counter_add(&metric_send_failures, 1);
+    consecutive_failures++;
+    if (consecutive_failures == 1) {
+        ESP_LOGW(TAG, "发送失败 (ret=%d)，将重试", ret);
+    }
+    // 只有连续多次失败才认为断开
+    if (consecutive_failures >= MAX_SEND_FAILURES) {
+        ESP_LOGE(TAG, "连续%d次发送失败，标记为断开", consecutive_failures);
+        is_connected = false;
+        consecutive_failures = 0;
+        clear_requested = true;
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    } else {
+        // 短暂延迟后重试
+        vTaskDelay(pdMS_TO_TICKS(50));
+    }
+    return false;
+}
+
+// 取出一条文本发送，没有时返回 false
+static bool send_text_from(record_ring_t *ring) {
+    size_t len;
+    uint8_t *text = record_ring_peek(ring, &len);
+    if (text == NULL) {
+        return false;
+    }
+    // 控制和遥测消息失败不重发，状态类消息在重连时会整体重报
+    if (ws_send(true, text, len)) {
+        metrics_counter_add(&metric_sent_text, 1);
+    }
+    record_ring_consume(ring);
+    return true;
+}
+
+// send_pos 处的一条音频
+static void send_audio_record(uint8_t *record, size_t record_len) {
+    send_record_t* header = (send_record_t*)record;
+    uint32_t delay_ms = (latency_trace_now() - header->wire.capture_us) / 1000;
+    if (delay_ms > resume_max_age_ms) {
+        // 太旧的包发出去只会拉高延迟
+        metrics_counter_add(&metric_dropped_packets, 1);
+        metrics_counter_add(&metric_expired_packets, 1);
+        advance_send_pos();
+        return;
+    }
+    const uint8_t* payload = record + sizeof(send_record_t);
+    size_t len = record_len - sizeof(send_record_t);
+    if (header_version != 0) {
+        // 帧头就在数据前面，一起发出
+        header->wire.send_delay_ms = delay_ms > UINT16_MAX ? UINT16_MAX : delay_ms;
+        metrics_histogram_record(&metric_uplink_delay_ms, delay_ms);
+        payload = (const uint8_t*)&header->wire;
+        len += sizeof(audio_uplink_header_t);
+    }
+
+    if (!ws_send(false, payload, len)) {
+        // 续传时同一个包留在 send_pos 上重发；不续传时丢弃，断开时整个环稍后清空
+        if (RESUME_WINDOW_MS == 0 && !clear_requested) {
+            metrics_counter_add(&metric_dropped_packets, 1);
+            advance_send_pos();
+        }
+        return;
+    }
+
+    if (header->sent) {
+        metrics_counter_add(&metric_resent_packets, 1);
+    } else if (header->traced) {
+        // 补发的包只记第一次发送
+        header->trace.stamps[LATENCY_TRACE_UP_SENT] = latency_trace_now();
+        latency_trace_commit(kLatencyTraceUplink, &header->trace);
+    }
+    header->sent = 1;
+    metrics_counter_add(&metric_sent_packets, 1);
+    advance_send_pos();
+}
+
+// 调度顺序：控制 > 音频 > 遥测。音频包和控制消息都很短，控制消息最多等一个音频包；
+// 遥测只在音频环发空的间隙发出，不会挤占实时音频
 static void audio_send_task(void* arg) {
-    queue_item_t item;
-    TickType_t last_send_time = 0;
-    const TickType_t MIN_SEND_INTERVAL_MS = 5; // 最小发送间隔，避免过于频繁导致帧问题
-    int consecutive_failures = 0;  // 连续发送失败计数
-    const int MAX_SEND_FAILURES = 5;  // 最大连续失败次数
-    
+    // 续传时断连期间也要定期醒来释放过期的包
+    const TickType_t idle_wait = RESUME_WINDOW_MS > 0 ? pdMS_TO_TICKS(RESUME_POLL_MS) : portMAX_DELAY;
+
     while (true) {
-        if (xQueueReceive(send_queue, &item, portMAX_DELAY) != pdTRUE) continue;
-        
-        // 检查连接状态
-        if (is_connected && ws_client != NULL && esp_websocket_client_is_connected(ws_client)) {
-            // 确保发送间隔，避免帧合并或异常
-            TickType_t now = xTaskGetTickCount();
-            TickType_t elapsed = now - last_send_time;
-            if (elapsed < pdMS_TO_TICKS(MIN_SEND_INTERVAL_MS)) {
-                vTaskDelay(pdMS_TO_TICKS(MIN_SEND_INTERVAL_MS) - elapsed);
+        if (clear_requested) {
+            clear_requested = false;
+            clear_text_rings();
+            if (RESUME_WINDOW_MS > 0) {
+                rewind_queue();
+            } else {
+                clear_queue();
             }
-            
-            if (ws_mutex && xSemaphoreTake(ws_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-                int ret = esp_websocket_client_send_bin(ws_client, (const char*)item.buf, item.len, pdMS_TO_TICKS(WS_SEND_TIMEOUT_MS));
-                xSemaphoreGive(ws_mutex);
-                last_send_time = xTaskGetTickCount();
-                
-                if (ret < 0) {
-                    consecutive_failures++;
-                    if (consecutive_failures == 1) {
-                        ESP_LOGW(TAG, "发送失败 (ret=%d)，将重试", ret);
-                    }
-                    
-                    // 只有连续多次失败才认为断开
-                    if (consecutive_failures >= MAX_SEND_FAILURES) {
-                        ESP_LOGE(TAG, "连续%d次发送失败，标记为断开", consecutive_failures);
-                        is_connected = false;
-                        consecutive_failures = 0;
-                        clear_queue();
-                        vTaskDelay(pdMS_TO_TICKS(1000));
-                    } else {
-                        // 短暂延迟后重试
-                        vTaskDelay(pdMS_TO_TICKS(50));
-                    }
-                } else {
-                    // 发送成功，重置计数
-                    consecutive_failures = 0;
-                }
+        }
+        if (ack_pending) {
+            ack_pending = false;
+            release_acked(acked_sequence);
+        }
+        if (RESUME_WINDOW_MS > 0) {
+            trim_expired();
+        }
+
+        bool link_up = is_connected && ws_client != NULL && esp_websocket_client_is_connected(ws_client);
+        if (!link_up) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RESUME_POLL_MS));
+            continue;
+        }
+
+        if (send_text_from(&control_ring)) {
+            continue;
+        }
+
+        TickType_t wait = idle_wait;
+        bool audio_ready = true;
+        if (RESUME_WINDOW_MS > 0 && connect_pending) {
+            // 连接监听执行完才知道有没有提议帧头，结束时会通知
+            audio_ready = false;
+            wait = pdMS_TO_TICKS(RESUME_POLL_MS);
+        } else if (RESUME_WINDOW_MS > 0 && header_offered && !header_negotiated) {
+            // 帧头协商完成前不发音频，补发的包要带上序号服务端才能去重
+            TickType_t since_connect = xTaskGetTickCount() - connected_tick;
+            if (since_connect < pdMS_TO_TICKS(RESUME_HANDSHAKE_MS)) {
+                audio_ready = false;
+                wait = pdMS_TO_TICKS(RESUME_HANDSHAKE_MS) - since_connect;
             }
         }
-        
-        if (item.buf) {
-            free(item.buf);
-            item.buf = NULL;
+        if (audio_ready) {
+            // 数据直接从环中发送，发送完成后才释放这条记录
+            size_t record_len;
+            uint8_t* record = record_ring_peek_at(&send_ring, &send_pos, &record_len);
+            if (record != NULL) {
+                send_audio_record(record, record_len);
+                continue;
+            }
+        }
+
+        if (send_text_from(&telemetry_ring)) {
+            continue;
         }
+        ulTaskNotifyTake(pdTRUE, wait);
     }
 }
 
 // ---------------- 公共接口 ----------------
 
 void audio_uploader_init(void) {
-    if (send_queue == NULL) {
-        send_queue = xQueueCreate(SEND_QUEUE_LEN, sizeof(queue_item_t));
+    metrics_register(&metric_sent_packets);
+    metrics_register(&metric_dropped_packets);
+    metrics_register(&metric_send_failures);
+    metrics_register(&metric_sent_text);
+    metrics_register(&metric_text_dropped);
+    metrics_register(&metric_disconnects);
+    metrics_register(&metric_resent_packets);
+    metrics_register(&metric_expired_packets);
+    metrics_register(&metric_downlink_fragmented);
+    metrics_register(&metric_downlink_reassembled);
+    metrics_register(&metric_downlink_discarded);
+    metrics_register(&metric_connected);
+    metrics_register(&metric_uplink_delay_ms);
+
+    if (producer_mutex == NULL) {
+        // 一次性分配，之后发送路径上不再有堆分配
+        if (!record_ring_init(&send_ring, SEND_RING_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)) {
+            ESP_LOGE(TAG, "发送环分配失败");
+        }
+        producer_mutex = xSemaphoreCreateMutex();
     }
-    if (ws_mutex == NULL) {
-        ws_mutex = xSemaphoreCreateMutex();
+    if (text_mutex == NULL) {
+        if (!record_ring_init(&control_ring, CONTROL_RING_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) ||
+            !record_ring_init(&telemetry_ring, TELEMETRY_RING_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)) {
+            ESP_LOGE(TAG, "文本发送环分配失败");
+        }
+        text_mutex = xSemaphoreCreateMutex();
     }
 
     esp_websocket_client_config_t config = {
         .uri = WEBSOCKET_URI,
         .reconnect_timeout_ms = 5000,
         .network_timeout_ms = 15000,
-        .buffer_size = 16384,            // 增大缓冲区到16KB，确保单帧完整发送
+        .buffer_size = WS_BUFFER_BYTES,  // 所有通道共用这一条连接的收发缓冲
         .disable_auto_reconnect = false,
         .keep_alive_enable = true,
         .keep_alive_idle = 15,
@@ -174,72 +604,201 @@ void audio_uploader_init(void) {
     }
 }
 
-void audio_uploader_send_bytes(const uint8_t *data, size_t len) {
-    // 1. 快速检查：断连时直接丢弃，不进队列
-    if (!is_connected || data == NULL || len == 0) {
-        return;
+uint8_t *audio_uploader_reserve(size_t max_len) {
+    // 1. 快速检查：不续传时断连直接丢弃，不进队列；续传时断连期间照常入队，由保留窗口限长
+    if ((!is_connected && RESUME_WINDOW_MS == 0) || producer_mutex == NULL || max_len == 0) {
+        return NULL;
     }
 
     // 2. 限制单包大小，避免触发WebSocket分片 (opCode 0)
     // Opus 60ms 帧通常在 100-300 字节，设置 1024 字节上限足够
-    if (len > 1024) {
-        ESP_LOGW(TAG, "数据包过大 (%d bytes)，丢弃以避免分片", (int)len);
+    if (max_len > SEND_MAX_PACKET) {
+        ESP_LOGW(TAG, "数据包过大 (%d bytes)，丢弃以避免分片", (int)max_len);
+        return NULL;
+    }
+
+    if (xSemaphoreTake(producer_mutex, pdMS_TO_TICKS(PRODUCER_WAIT_MS)) != pdTRUE) {
+        metrics_counter_add(&metric_dropped_packets, 1);
+        return NULL;
+    }
+
+    // 3. 环满时丢弃最新的（保最新），丢弃的包也占用序号，服务端据此统计丢包
+    uint16_t sequence = next_sequence++;
+    uint8_t* record = record_ring_reserve(&send_ring, sizeof(send_record_t) + max_len);
+    if (record == NULL) {
+        xSemaphoreGive(producer_mutex);
+        metrics_counter_add(&metric_dropped_packets, 1);
+        return NULL;
+    }
+    reserved_record = (send_record_t*)record;
+    reserved_sequence = sequence;
+    return record + sizeof(send_record_t);
+}
+
+void audio_uploader_commit(size_t len, const latency_trace_t *trace, int frame_ms) {
+    if (len == 0) {
+        audio_uploader_cancel();
         return;
     }
+    send_record_t* header = reserved_record;
+    reserved_record = NULL;
+    uint32_t now = latency_trace_now();
+    header->traced = trace != NULL;
+    header->sent = 0;
+    if (trace) {
+        header->trace = *trace;
+        header->trace.stamps[LATENCY_TRACE_UP_ENQUEUED] = now;
+    }
+    header->wire.version = AUDIO_UPLINK_HEADER_VERSION;
+    header->wire.frame_ms = frame_ms > 0 && frame_ms <= UINT8_MAX ? frame_ms : 0;
+    header->wire.sequence = reserved_sequence;
+    // 没有追踪的包（预录、DTX 标记、PCM）以入队时刻近似采集时刻
+    header->wire.capture_us = (trace && trace->stamps[LATENCY_TRACE_UP_CAPTURED] != 0) ?
+        trace->stamps[LATENCY_TRACE_UP_CAPTURED] : now;
+    header->wire.send_delay_ms = 0;
+    record_ring_commit(&send_ring, sizeof(send_record_t) + len);
+    xSemaphoreGive(producer_mutex);
+    if (send_task_handle) {
+        xTaskNotifyGive(send_task_handle);
+    }
+}
+
+void audio_uploader_cancel(void) {
+    reserved_record = NULL;
+    record_ring_cancel(&send_ring);
+    xSemaphoreGive(producer_mutex);
+}
+
+void audio_uploader_send_bytes(const uint8_t *data, size_t len) {
+    audio_uploader_send_traced(data, len, NULL, 0);
+}
 
-    // 3. 队列满时丢弃最新的（保最新）
-    if (uxQueueSpacesAvailable(send_queue) < 5) {
-        // ESP_LOGW(TAG, "队列满，丢包"); // 注释掉减少日志干扰
+void audio_uploader_send_traced(const uint8_t *data, size_t len, const latency_trace_t *trace, int frame_ms) {
+    if (data == NULL || len == 0) {
         return;
     }
+    uint8_t* payload = audio_uploader_reserve(len);
+    if (payload == NULL) {
+        return;
+    }
+    memcpy(payload, data, len);
+    audio_uploader_commit(len, trace, frame_ms);
+}
 
-    uint8_t* buf_copy = (uint8_t*)malloc(len);
-    if (!buf_copy) return;
-    memcpy(buf_copy, data, len);
+void audio_uploader_set_header_version(int version) {
+    if (version != 0 && version != AUDIO_UPLINK_HEADER_VERSION) {
+        ESP_LOGW(TAG, "不支持的上行帧头版本 %d，保持裸 Opus", version);
+        version = 0;
+    }
+    header_version = (uint8_t)version;
+    header_negotiated = true;
+    ESP_LOGI(TAG, "上行帧头版本: %d", version);
+    // 发送任务可能在等协商结果再补发
+    if (send_task_handle) {
+        xTaskNotifyGive(send_task_handle);
+    }
+}
 
-    queue_item_t item = { .len = len, .buf = buf_copy };
+bool audio_uploader_offer_header(void) {
+    char payload[32];
+    int len = snprintf(payload, sizeof(payload), "(uplink_header,%d)", AUDIO_UPLINK_HEADER_VERSION);
+    if (len <= 0 || len >= (int)sizeof(payload) || !audio_uploader_send_text(payload)) {
+        return false;
+    }
+    header_offered = true;
+    return true;
+}
 
-    if (xQueueSend(send_queue, &item, 0) != pdTRUE) {
-        free(buf_copy);
+void audio_uploader_ack(uint16_t sequence) {
+    acked_sequence = sequence;
+    ack_pending = true;
+    acks_active = true;
+    if (send_task_handle) {
+        xTaskNotifyGive(send_task_handle);
     }
 }
 
+void audio_uploader_set_resume_max_age(uint32_t max_age_ms) {
+    resume_max_age_ms = max_age_ms;
+    ESP_LOGI(TAG, "上行续传新鲜度上限: %u ms", (unsigned)max_age_ms);
+}
+
 // 兼容接口：如果还想发 PCM，封装一下即可
 void audio_uploader_send(const int16_t *data, int samples) {
     audio_uploader_send_bytes((const uint8_t*)data, samples * sizeof(int16_t));
 }
 
 bool audio_uploader_send_text(const char *data) {
-    if (!is_connected || ws_client == NULL || data == NULL || data[0] == '\0') {
+    return audio_uploader_send_text_on(WS_CHANNEL_CONTROL, data);
+}
+
+bool audio_uploader_send_text_on(ws_channel_t channel, const char *data) {
+    if (!audio_uploader_is_connected() || text_mutex == NULL || data == NULL || data[0] == '\0') {
         return false;
     }
-    if (!esp_websocket_client_is_connected(ws_client)) {
+    record_ring_t *ring;
+    if (channel == WS_CHANNEL_CONTROL) {
+        ring = &control_ring;
+    } else if (channel == WS_CHANNEL_TELEMETRY) {
+        ring = &telemetry_ring;
+    } else {
         return false;
     }
-    if (ws_mutex && xSemaphoreTake(ws_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-        int ret = esp_websocket_client_send_text(ws_client, data, strlen(data), pdMS_TO_TICKS(WS_SEND_TIMEOUT_MS));
-        xSemaphoreGive(ws_mutex);
-        return ret >= 0;
+
+    size_t len = strlen(data);
+    uint8_t *text = NULL;
+    if (xSemaphoreTake(text_mutex, pdMS_TO_TICKS(PRODUCER_WAIT_MS)) == pdTRUE) {
+        text = record_ring_reserve(ring, len);
+        if (text != NULL) {
+            memcpy(text, data, len);
+            record_ring_commit(ring, len);
+        }
+        xSemaphoreGive(text_mutex);
     }
-    return false;
+    if (text == NULL) {
+        metrics_counter_add(&metric_text_dropped, 1);
+        ESP_LOGW(TAG, "文本通道 %d 已满，丢弃 %d 字节", (int)channel, (int)len);
+        return false;
+    }
+    if (send_task_handle) {
+        xTaskNotifyGive(send_task_handle);
+    }
+    return true;
 }
 
-void audio_uploader_set_binary_cb(audio_uploader_binary_cb_t cb) {
-    binary_cb = cb;
+void audio_uploader_set_binary_sink(const audio_uploader_binary_sink_t *sink) {
+    binary_sink = sink;
 }
 
 void audio_uploader_set_text_cb(audio_uploader_text_cb_t cb) {
     text_cb = cb;
 }
 
-void audio_uploader_set_connected_cb(audio_uploader_connected_cb_t cb) {
-    connected_cb = cb;
+bool audio_uploader_add_connected_cb(audio_uploader_connected_cb_t cb) {
+    return listener_add(&connected_listeners, cb);
 }
 
-void audio_uploader_set_disconnected_cb(audio_uploader_disconnected_cb_t cb) {
-    disconnected_cb = cb;
+bool audio_uploader_add_disconnected_cb(audio_uploader_disconnected_cb_t cb) {
+    return listener_add(&disconnected_listeners, cb);
 }
 
 bool audio_uploader_is_connected(void) {
     return is_connected && ws_client != NULL && esp_websocket_client_is_connected(ws_client);
 }
+
+void audio_uploader_get_stats(audio_uploader_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+    uint32_t in_ring = record_ring_queued(&send_ring);
+    uint32_t awaiting_ack = retained;
+    stats->queued = in_ring > awaiting_ack ? in_ring - awaiting_ack : 0;
+    stats->awaiting_ack = awaiting_ack;
+    stats->queued_bytes = record_ring_used_bytes(&send_ring);
+    stats->capacity_bytes = send_ring.size;
+    stats->send_failures = (uint32_t)metrics_value(&metric_send_failures);
+    stats->dropped = (uint32_t)metrics_value(&metric_dropped_packets);
+    stats->sent = (uint32_t)metrics_value(&metric_sent_packets);
+    stats->sequence = next_sequence;
+    stats->header_version = header_version;
+}
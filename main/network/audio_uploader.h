@@ -8,36 +8,113 @@ extern "C" {
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "latency_trace.h"
+
+// 设备到服务器只有这一条 WebSocket 连接，按逻辑通道复用：
+//   上行音频：二进制，audio_uploader_reserve/commit、send_bytes 等
+//   下行音频：二进制，audio_uploader_set_binary_sink
+//   控制：文本，双向（灯光/音量状态、协商、服务端命令 audio_uploader_set_text_cb）
+//   遥测：文本，上行（指标快照、延迟统计）
+// 所有上行由一个发送任务按 控制 > 音频 > 遥测 的优先级发出，共用一份收发缓冲
+typedef enum {
+    WS_CHANNEL_CONTROL,
+    WS_CHANNEL_AUDIO_UPLINK,
+    WS_CHANNEL_AUDIO_DOWNLINK,
+    WS_CHANNEL_TELEMETRY,
+} ws_channel_t;
+
+// 上行帧头：连接后设备发送 "(uplink_header,1)"，服务端回复 "(uplink_header,1)" 后每个二进制包
+// 前面都带这个帧头（小端）；服务端不回复或回复 0 时保持发送裸 Opus
+#define AUDIO_UPLINK_HEADER_VERSION 1
+
+typedef struct __attribute__((packed)) {
+    uint8_t  version;           // AUDIO_UPLINK_HEADER_VERSION
+    uint8_t  frame_ms;          // 帧长，0 表示未知（如 PCM）
+    uint16_t sequence;          // 包序号，跨重连连续；设备端丢弃的包也占用序号，补发的包序号不变
+    uint32_t capture_us;        // 采集时刻，esp_timer 微秒低 32 位
+    uint16_t send_delay_ms;     // 设备上从采集到发出的时间
+} audio_uplink_header_t;
 
 // 初始化 WebSocket 和发送任务
 void audio_uploader_init(void);
 
 // 发送二进制数据 (Opus包或PCM)
-// 内部会自动处理内存拷贝和队列管理，网络断开时会自动丢弃
+// 拷贝进预分配的发送环，环满时丢弃；未开启续传时网络断开也丢弃
 void audio_uploader_send_bytes(const uint8_t *data, size_t len);
 
+// 同上，并带上该帧的延迟追踪（可为 NULL）和帧长：入队和实际发送时打点，发送后提交
+void audio_uploader_send_traced(const uint8_t *data, size_t len, const latency_trace_t *trace, int frame_ms);
+
+// 零拷贝发送：在发送环中预留最多 max_len 字节，直接写入（例如 Opus 编码输出）后
+// 提交实际长度，或取消。环满、超过单包上限或（未开启续传时）断连时返回 NULL。
+// 预留到提交 / 取消之间其他生产者会等待，期间不要做耗时以外的阻塞操作
+uint8_t *audio_uploader_reserve(size_t max_len);
+void audio_uploader_commit(size_t len, const latency_trace_t *trace, int frame_ms);
+void audio_uploader_cancel(void);
+
+// 在控制通道上提议帧头，连接监听中调用；没提议的连接不等协商直接发送
+bool audio_uploader_offer_header(void);
+// 服务端回复的帧头版本，0 关闭；每次连接都从 0 开始重新协商
+void audio_uploader_set_header_version(int version);
+
+// 断线续传（CONFIG_AUDIO_UPLINK_RESUME_WINDOW_MS）：服务端发 "(uplink_ack,N)" 确认收到序号 N
+// 及之前的包，之后发出的包留在发送环里直到确认；断线重连后未确认的包按序补发，
+// 采集时间超过新鲜度上限的包丢弃。没有确认的服务端上包发出即释放，只补发断线时未发出的部分
+void audio_uploader_ack(uint16_t sequence);
+void audio_uploader_set_resume_max_age(uint32_t max_age_ms);
+
 // 发送 PCM 数据 (兼容旧接口)
 void audio_uploader_send(const int16_t *data, int samples);
 
-// 发送文本消息（短指令或状态）
+// 发送文本消息（短指令或状态），走控制通道
+// 入队即返回 true，未连接或通道已满返回 false；断开时未发出的文本丢弃，重连后由调用方重报状态
 bool audio_uploader_send_text(const char *data);
+// 指定文本通道（WS_CHANNEL_CONTROL 或 WS_CHANNEL_TELEMETRY）
+bool audio_uploader_send_text_on(ws_channel_t channel, const char *data);
 
-// WebSocket 连接建立回调
+// 连接事件监听：每个模块各自注册，建立 / 断开时按注册顺序全部调用（在 WebSocket 事件任务中）
+// 同一个函数重复注册只算一次，最多 AUDIO_UPLOADER_MAX_LISTENERS 个
+#define AUDIO_UPLOADER_MAX_LISTENERS 4
 typedef void (*audio_uploader_connected_cb_t)(void);
-void audio_uploader_set_connected_cb(audio_uploader_connected_cb_t cb);
+typedef void (*audio_uploader_disconnected_cb_t)(void);
+bool audio_uploader_add_connected_cb(audio_uploader_connected_cb_t cb);
+bool audio_uploader_add_disconnected_cb(audio_uploader_disconnected_cb_t cb);
+
+// 下行二进制帧的接收方。客户端缓冲放不下的帧分多次事件到达，每段按偏移直接写进 begin()
+// 返回的缓冲，收齐后 complete()，中途断开或丢了分片时 discard()；整帧一次到达时也走同一路径。
+// 三个回调都在 WebSocket 事件任务中调用，同一时间最多一帧在接收
+typedef struct {
+    // 为 len 字节的帧取缓冲，*frame 存放调用方自己的句柄；返回 NULL 丢弃这帧
+    uint8_t *(*begin)(size_t len, void **frame);
+    void (*complete)(void *frame, size_t len);
+    void (*discard)(void *frame);
+} audio_uploader_binary_sink_t;
 
 // 回调函数定义
-typedef void (*audio_uploader_binary_cb_t)(const uint8_t *data, size_t len);
 typedef void (*audio_uploader_text_cb_t)(const char *data, size_t len);
-typedef void (*audio_uploader_disconnected_cb_t)(void);
 
-void audio_uploader_set_binary_cb(audio_uploader_binary_cb_t cb);
+// sink 需在整个运行期间有效
+void audio_uploader_set_binary_sink(const audio_uploader_binary_sink_t *sink);
 void audio_uploader_set_text_cb(audio_uploader_text_cb_t cb);
-void audio_uploader_set_disconnected_cb(audio_uploader_disconnected_cb_t cb);
 
 // 查询连接状态
 bool audio_uploader_is_connected(void);
 
+// 发送队列状态，供编码码率控制使用
+typedef struct {
+    uint32_t queued;            // 发送环中待发送的包数
+    uint32_t awaiting_ack;      // 已发出、等待服务端确认的包数
+    uint32_t queued_bytes;      // 发送环已用字节（含记录头）
+    uint32_t capacity_bytes;    // 发送环容量（字节）
+    uint32_t send_failures;     // 累计发送失败次数
+    uint32_t dropped;           // 累计丢包数（队列满、断连清队列或超过新鲜度上限）
+    uint32_t sent;              // 累计发送成功的包数
+    uint16_t sequence;          // 下一个上行包的序号
+    uint8_t header_version;     // 当前协商的帧头版本，0 为裸 Opus
+} audio_uploader_stats_t;
+
+void audio_uploader_get_stats(audio_uploader_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
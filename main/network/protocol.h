@@ -4,6 +4,7 @@
 #include <cJSON.h>
 #include <string>
 #include <functional>
+#include <memory>
 #include <chrono>
 #include <vector>
 
@@ -11,6 +12,8 @@ struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    uint32_t receive_time = 0;  // latency_trace_now() on arrival, 0 when not traced
+    int64_t arrival_us = 0;     // esp_timer_get_time() when queued for decoding, the jitter buffer's arrival time
     std::vector<uint8_t> payload;
 };
 
@@ -0,0 +1,137 @@
+#include "record_ring.h"
+#include <string.h>
+#include "esp_heap_caps.h"
+
+#define RECORD_HEADER_SIZE  sizeof(uint32_t)
+#define RECORD_WRAP         0xFFFFFFFFu
+
+static inline uint32_t record_bytes(size_t len) {
+    return RECORD_HEADER_SIZE + (((uint32_t)len + 3) & ~3u);
+}
+
+bool record_ring_init(record_ring_t *ring, uint32_t size, uint32_t caps) {
+    memset(ring, 0, sizeof(*ring));
+    if (size < 64 || (size & (size - 1)) != 0) {
+        return false;
+    }
+    ring->buf = (uint8_t *)heap_caps_malloc(size, caps);
+    if (ring->buf == NULL) {
+        ring->buf = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (ring->buf == NULL) {
+        return false;
+    }
+    ring->size = size;
+    return true;
+}
+
+void record_ring_deinit(record_ring_t *ring) {
+    heap_caps_free(ring->buf);
+    memset(ring, 0, sizeof(*ring));
+}
+
+uint8_t *record_ring_reserve(record_ring_t *ring, size_t max_len) {
+    if (ring->buf == NULL || ring->reserved != 0) {
+        return NULL;
+    }
+    uint32_t need = record_bytes(max_len);
+    uint32_t tail = ring->tail;
+    uint32_t free_bytes = ring->size - (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE));
+    uint32_t offset = tail & (ring->size - 1);
+    uint32_t contiguous = ring->size - offset;
+
+    if (contiguous < need) {
+        // 尾部放不下：回绕标记占掉剩余空间，记录从缓冲起始处开始
+        if (free_bytes < contiguous + need) {
+            return NULL;
+        }
+        *(uint32_t *)(ring->buf + offset) = RECORD_WRAP;
+        tail += contiguous;
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        offset = 0;
+    } else if (free_bytes < need) {
+        return NULL;
+    }
+
+    ring->reserved = need;
+    return ring->buf + offset + RECORD_HEADER_SIZE;
+}
+
+void record_ring_commit(record_ring_t *ring, size_t len) {
+    if (ring->reserved == 0) {
+        return;
+    }
+    uint32_t bytes = record_bytes(len);
+    if (bytes > ring->reserved) {
+        record_ring_cancel(ring);
+        return;
+    }
+    uint32_t tail = ring->tail;
+    *(uint32_t *)(ring->buf + (tail & (ring->size - 1))) = (uint32_t)len;
+    ring->reserved = 0;
+    __atomic_store_n(&ring->records_in, ring->records_in + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->tail, tail + bytes, __ATOMIC_RELEASE);
+}
+
+void record_ring_cancel(record_ring_t *ring) {
+    ring->reserved = 0;
+}
+
+uint8_t *record_ring_peek(record_ring_t *ring, size_t *len) {
+    if (ring->buf == NULL) {
+        return NULL;
+    }
+    uint32_t head = ring->head;
+    while (head != __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+        uint32_t offset = head & (ring->size - 1);
+        uint32_t header = *(const uint32_t *)(ring->buf + offset);
+        if (header == RECORD_WRAP) {
+            head += ring->size - offset;
+            __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+            continue;
+        }
+        *len = header;
+        return ring->buf + offset + RECORD_HEADER_SIZE;
+    }
+    return NULL;
+}
+
+uint8_t *record_ring_peek_at(const record_ring_t *ring, uint32_t *cursor, size_t *len) {
+    if (ring->buf == NULL) {
+        return NULL;
+    }
+    uint32_t position = *cursor;
+    while (position != __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+        uint32_t offset = position & (ring->size - 1);
+        uint32_t header = *(const uint32_t *)(ring->buf + offset);
+        if (header == RECORD_WRAP) {
+            position += ring->size - offset;
+            continue;
+        }
+        *cursor = position;
+        *len = header;
+        return ring->buf + offset + RECORD_HEADER_SIZE;
+    }
+    *cursor = position;
+    return NULL;
+}
+
+void record_ring_advance(const record_ring_t *ring, uint32_t *cursor) {
+    uint32_t header = *(const uint32_t *)(ring->buf + (*cursor & (ring->size - 1)));
+    *cursor += record_bytes(header);
+}
+
+void record_ring_consume(record_ring_t *ring) {
+    uint32_t head = ring->head;
+    uint32_t header = *(const uint32_t *)(ring->buf + (head & (ring->size - 1)));
+    __atomic_store_n(&ring->records_out, ring->records_out + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->head, head + record_bytes(header), __ATOMIC_RELEASE);
+}
+
+uint32_t record_ring_queued(const record_ring_t *ring) {
+    return __atomic_load_n(&ring->records_in, __ATOMIC_RELAXED) - __atomic_load_n(&ring->records_out, __ATOMIC_RELAXED);
+}
+
+uint32_t record_ring_used_bytes(const record_ring_t *ring) {
+    return __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) - __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,66 @@
+#ifndef RECORD_RING_H
+#define RECORD_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * 变长记录环形缓冲（单生产者 / 单消费者，无锁）
+ *
+ * 每条记录在缓冲中连续存放：4 字节长度 + 数据，按 4 字节对齐。尾部剩余空间放不下一条
+ * 记录时写入一个回绕标记，记录从缓冲起始处继续，所以读写双方拿到的都是连续指针，
+ * 可以直接在缓冲里编码 / 直接从缓冲发送。
+ *
+ * 生产者：record_ring_reserve() 取得可写指针，写完后 record_ring_commit() 发布实际长度。
+ * 消费者：record_ring_peek() 取得最早的一条记录，用完后 record_ring_consume() 释放。
+ * 多个生产者时由调用方加锁串行化，消费者一侧始终无锁。
+ *
+ * 消费者还可以用自己的游标（record_ring_head() 起步）向前读取而不释放，
+ * 例如先发送、等对端确认后再 consume。
+ */
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;          // 2 的幂
+    uint32_t head;          // 消费者，自由递增的字节偏移
+    uint32_t tail;          // 生产者
+    uint32_t reserved;      // 生产者：当前预留的字节数，0 表示没有预留
+    uint32_t records_in;    // 生产者：已提交的记录数
+    uint32_t records_out;   // 消费者：已释放的记录数
+} record_ring_t;
+
+// caps 为 heap_caps 标志，分配失败时退回内部 RAM
+bool record_ring_init(record_ring_t *ring, uint32_t size, uint32_t caps);
+void record_ring_deinit(record_ring_t *ring);
+
+// 预留一条最长 max_len 字节的记录，空间不足返回 NULL
+uint8_t *record_ring_reserve(record_ring_t *ring, size_t max_len);
+// 发布预留的记录，len 不超过预留长度
+void record_ring_commit(record_ring_t *ring, size_t len);
+// 放弃预留的记录
+void record_ring_cancel(record_ring_t *ring);
+
+// 最早的一条记录，没有时返回 NULL
+uint8_t *record_ring_peek(record_ring_t *ring, size_t *len);
+void record_ring_consume(record_ring_t *ring);
+
+// 消费者游标：cursor 处的记录（跳过回绕标记并更新 cursor），到达 tail 返回 NULL
+uint8_t *record_ring_peek_at(const record_ring_t *ring, uint32_t *cursor, size_t *len);
+// 把 cursor 移到下一条记录
+void record_ring_advance(const record_ring_t *ring, uint32_t *cursor);
+static inline uint32_t record_ring_head(const record_ring_t *ring) { return ring->head; }
+
+// 任意任务可调用的近似值
+uint32_t record_ring_queued(const record_ring_t *ring);
+uint32_t record_ring_used_bytes(const record_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
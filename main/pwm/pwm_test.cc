@@ -156,7 +156,7 @@ static void InitLampPwm() {
     ESP_ERROR_CHECK(ledc_fade_func_install(0));
     fade_inited = true;
 
-    audio_uploader_set_connected_cb(OnWsConnected);
+    audio_uploader_add_connected_cb(OnWsConnected);
     pwm_inited = true;
     ApplyLampPwm();
 }
@@ -7,6 +7,8 @@
 #include <esp_system.h>
 #include <esp_partition.h>
 #include <esp_app_desc.h>
+#include <esp_heap_caps.h>
+#include "metrics.h"
 #if CONFIG_IDF_TARGET_ESP32P4
 #include "esp_wifi_remote.h"
 #endif
@@ -143,9 +145,18 @@ void SystemInfo::PrintTaskList() {
     ESP_LOGI(TAG, "Task list: \n%s", buffer);
 }
 
-void SystemInfo::PrintHeapStats() {
-    int free_sram = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
-    int min_free_sram = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
-    (void)free_sram;
-    (void)min_free_sram;
+METRICS_GAUGE(metric_free_sram, "heap.free_internal");
+METRICS_GAUGE(metric_min_free_sram, "heap.min_free_internal");
+METRICS_GAUGE(metric_largest_sram_block, "heap.largest_internal_block");
+METRICS_GAUGE(metric_free_psram, "heap.free_psram");
+
+void SystemInfo::UpdateHeapMetrics() {
+    metrics_register(&metric_free_sram);
+    metrics_register(&metric_min_free_sram);
+    metrics_register(&metric_largest_sram_block);
+    metrics_register(&metric_free_psram);
+    metrics_gauge_set(&metric_free_sram, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    metrics_gauge_set(&metric_min_free_sram, heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    metrics_gauge_set(&metric_largest_sram_block, heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+    metrics_gauge_set(&metric_free_psram, heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
 }
@@ -16,7 +16,7 @@ public:
     static std::string GetUserAgent();
     static esp_err_t PrintTaskCpuUsage(TickType_t xTicksToWait);
     static void PrintTaskList();
-    static void PrintHeapStats();
+    static void UpdateHeapMetrics();
 };
 
 #endif // _SYSTEM_INFO_H_
@@ -0,0 +1,123 @@
+#ifndef AUDIO_FRAME_POOL_H
+#define AUDIO_FRAME_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <functional>
+
+#include <freertos/FreeRTOS.h>
+#include <esp_heap_caps.h>
+
+/*
+ * Fixed-capacity slab of recyclable frame objects.
+ *
+ * All objects are constructed once in Initialize() and their buffers are reserved by the
+ * prepare callback, so Acquire() / release never touch the heap while the pool has free
+ * objects. Releasing is done by the Ptr deleter, the object goes back with its buffer
+ * capacity intact.
+ *
+ * When the pool is empty Acquire() falls back to a plain heap object (deleted normally)
+ * and counts it in allocation_failures(), so an undersized pool shows up in the stats
+ * instead of dropping audio.
+ */
+template <typename T>
+class FramePool {
+public:
+    struct Deleter {
+        FramePool* pool = nullptr;
+        void operator()(T* object) const {
+            if (pool != nullptr) {
+                pool->Release(object);
+            } else {
+                delete object;
+            }
+        }
+    };
+    using Ptr = std::unique_ptr<T, Deleter>;
+
+    FramePool() = default;
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    ~FramePool() {
+        if (objects_ != nullptr) {
+            for (size_t i = 0; i < capacity_; i++) {
+                objects_[i].~T();
+            }
+            heap_caps_free(objects_);
+        }
+        if (free_list_ != nullptr) {
+            heap_caps_free(free_list_);
+        }
+    }
+
+    // caps selects where the slab lives, e.g. MALLOC_CAP_SPIRAM for PCM frames
+    bool Initialize(size_t capacity, uint32_t caps, std::function<void(T&)> prepare) {
+        if (objects_ != nullptr || capacity == 0) {
+            return false;
+        }
+        objects_ = static_cast<T*>(heap_caps_calloc(capacity, sizeof(T), caps | MALLOC_CAP_8BIT));
+        free_list_ = static_cast<T**>(heap_caps_calloc(capacity, sizeof(T*), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+        if (objects_ == nullptr || free_list_ == nullptr) {
+            heap_caps_free(objects_);
+            heap_caps_free(free_list_);
+            objects_ = nullptr;
+            free_list_ = nullptr;
+            return false;
+        }
+        for (size_t i = 0; i < capacity; i++) {
+            T* object = new (&objects_[i]) T();
+            if (prepare) {
+                prepare(*object);
+            }
+            free_list_[i] = object;
+        }
+        capacity_ = capacity;
+        free_count_ = capacity;
+        return true;
+    }
+
+    Ptr Acquire() {
+        T* object = nullptr;
+        portENTER_CRITICAL(&lock_);
+        if (free_count_ > 0) {
+            object = free_list_[--free_count_];
+            size_t in_use = capacity_ - free_count_;
+            if (in_use > high_water_mark_) {
+                high_water_mark_ = in_use;
+            }
+        } else {
+            allocation_failures_++;
+        }
+        portEXIT_CRITICAL(&lock_);
+
+        if (object == nullptr) {
+            return Ptr(new T(), Deleter{nullptr});
+        }
+        return Ptr(object, Deleter{this});
+    }
+
+    inline size_t capacity() const { return capacity_; }
+    inline size_t in_use() const { return capacity_ - free_count_; }
+    inline size_t high_water_mark() const { return high_water_mark_; }
+    inline uint32_t allocation_failures() const { return allocation_failures_; }
+
+private:
+    T* objects_ = nullptr;
+    T** free_list_ = nullptr;
+    size_t capacity_ = 0;
+    volatile size_t free_count_ = 0;
+    volatile size_t high_water_mark_ = 0;
+    volatile uint32_t allocation_failures_ = 0;
+    portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+
+    void Release(T* object) {
+        portENTER_CRITICAL(&lock_);
+        free_list_[free_count_++] = object;
+        portEXIT_CRITICAL(&lock_);
+    }
+};
+
+#endif // AUDIO_FRAME_POOL_H
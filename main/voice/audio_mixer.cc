@@ -0,0 +1,216 @@
+#include "audio_mixer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include "metrics.h"
+
+#define TAG "AudioMixer"
+
+METRICS_COUNTER(metric_partial_blocks, "audio.mixer_partial_blocks");
+
+AudioMixer::~AudioMixer() {
+    for (int i = 0; i < source_count_; i++) {
+        heap_caps_free(sources_[i].ring);
+    }
+    heap_caps_free(accumulator_);
+}
+
+bool AudioMixer::Initialize(size_t block_samples) {
+    metrics_register(&metric_partial_blocks);
+    // Touched every sample of every block, keep it in internal RAM
+    accumulator_ = static_cast<int32_t*>(heap_caps_malloc(block_samples * sizeof(int32_t),
+        MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    if (accumulator_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate the mix accumulator");
+        return false;
+    }
+    block_samples_ = block_samples;
+    return true;
+}
+
+int AudioMixer::AddSource(const char* name, int priority, size_t capacity_samples, int32_t duck_gain) {
+    if (source_count_ >= AUDIO_MIXER_MAX_SOURCES) {
+        ESP_LOGE(TAG, "No free source slot for %s", name);
+        return -1;
+    }
+    size_t capacity = 1;
+    while (capacity < std::max(capacity_samples, block_samples_)) {
+        capacity <<= 1;
+    }
+    Source& source = sources_[source_count_];
+    source.name = name;
+    source.priority = priority;
+    source.ring = static_cast<int16_t*>(heap_caps_malloc(capacity * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (source.ring == nullptr) {
+        // Keep the slot so the ids of the later sources do not shift, Write() drops everything
+        ESP_LOGE(TAG, "Failed to allocate %u samples for %s", (unsigned int)capacity, name);
+        capacity = 0;
+    }
+    source.mask = capacity - 1;
+    source.duck_gain = duck_gain;
+    source.applied_gain = source.gain.load(std::memory_order_relaxed);
+    ESP_LOGI(TAG, "Source %d: %s, priority %d, %u samples", source_count_, name, priority, (unsigned int)capacity);
+    return source_count_++;
+}
+
+size_t AudioMixer::Write(int source, const int16_t* pcm, size_t samples) {
+    Source& s = sources_[source];
+    if (s.ring == nullptr) {
+        return 0;
+    }
+    uint32_t tail = s.tail.load(std::memory_order_relaxed);
+    size_t space = s.mask + 1 - (tail - s.head.load(std::memory_order_acquire));
+    samples = std::min(samples, space);
+    if (samples == 0) {
+        return 0;
+    }
+    size_t index = tail & s.mask;
+    size_t first = std::min(samples, s.mask + 1 - index);
+    memcpy(s.ring + index, pcm, first * sizeof(int16_t));
+    memcpy(s.ring, pcm + first, (samples - first) * sizeof(int16_t));
+    s.tail.store(tail + samples, std::memory_order_release);
+    return samples;
+}
+
+size_t AudioMixer::Space(int source) const {
+    const Source& s = sources_[source];
+    return s.mask + 1 - (s.tail.load(std::memory_order_acquire) - s.head.load(std::memory_order_acquire));
+}
+
+size_t AudioMixer::Available(int source) const {
+    const Source& s = sources_[source];
+    return s.tail.load(std::memory_order_acquire) - s.head.load(std::memory_order_acquire);
+}
+
+void AudioMixer::RequestClear(int source) {
+    Source& s = sources_[source];
+    s.clear_mark.store(s.tail.load(std::memory_order_acquire), std::memory_order_release);
+    s.clear_requested.store(true, std::memory_order_release);
+}
+
+void AudioMixer::SetGain(int source, int32_t gain) {
+    sources_[source].gain.store(std::clamp<int32_t>(gain, 0, AUDIO_MIXER_UNITY_GAIN), std::memory_order_relaxed);
+}
+
+bool AudioMixer::HasAudio() const {
+    for (int i = 0; i < source_count_; i++) {
+        if (Available(i) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+AudioMixerStatistics AudioMixer::GetStatistics() const {
+    AudioMixerStatistics statistics;
+    statistics.blocks = blocks_.load(std::memory_order_relaxed);
+    statistics.partial_blocks = partial_blocks_.load(std::memory_order_relaxed);
+    statistics.active_sources = active_sources_.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+// Consumer side of the ring: applies a pending clear and returns what is left to read
+size_t AudioMixer::Fill(Source& source) {
+    if (source.clear_requested.exchange(false, std::memory_order_acq_rel)) {
+        uint32_t mark = source.clear_mark.load(std::memory_order_acquire);
+        uint32_t head = source.head.load(std::memory_order_relaxed);
+        if (static_cast<int32_t>(mark - head) > 0) {
+            source.head.store(mark, std::memory_order_release);
+        }
+    }
+    return source.tail.load(std::memory_order_acquire) - source.head.load(std::memory_order_relaxed);
+}
+
+/*
+ * acc += in * gain, the gain is Q30 (Q15 gain << 15) and moves by step every sample so a
+ * gain change is spread over the whole block. Unity gain is a plain widening add. The
+ * esp-dsp s16 kernels are not used: dsps_add_s16 wraps instead of saturating on the
+ * generic path and there is no multiply-accumulate with a per-sample gain, while this loop
+ * compiles to a MULL + ADD per sample with the sum kept in 32 bits until the final clamp.
+ */
+int32_t AudioMixer::MixSegment(int32_t* acc, const int16_t* in, size_t samples, int32_t gain_q30, int32_t step_q30) {
+    if (step_q30 == 0) {
+        if (gain_q30 == AUDIO_MIXER_UNITY_GAIN * (1 << 15)) {
+            for (size_t i = 0; i < samples; i++) {
+                acc[i] += in[i];
+            }
+        } else {
+            int32_t gain = gain_q30 >> 15;
+            for (size_t i = 0; i < samples; i++) {
+                acc[i] += (in[i] * gain) >> 15;
+            }
+        }
+        return gain_q30;
+    }
+    for (size_t i = 0; i < samples; i++) {
+        acc[i] += (in[i] * (gain_q30 >> 15)) >> 15;
+        gain_q30 += step_q30;
+    }
+    return gain_q30;
+}
+
+void AudioMixer::Saturate(const int32_t* acc, int16_t* out, size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+        out[i] = static_cast<int16_t>(std::clamp<int32_t>(acc[i], INT16_MIN, INT16_MAX));
+    }
+}
+
+bool AudioMixer::Mix(int16_t* out) {
+    size_t available[AUDIO_MIXER_MAX_SOURCES];
+    int top_priority = INT32_MIN;
+    uint8_t active_sources = 0;
+    for (int i = 0; i < source_count_; i++) {
+        available[i] = Fill(sources_[i]);
+        sources_[i].active = available[i] > 0;
+        if (sources_[i].active) {
+            top_priority = std::max(top_priority, sources_[i].priority);
+            active_sources++;
+        }
+    }
+    active_sources_.store(active_sources, std::memory_order_relaxed);
+    if (active_sources == 0) {
+        // Nothing is ducked while the output is idle, the next sound starts at its own gain
+        for (int i = 0; i < source_count_; i++) {
+            sources_[i].applied_gain = sources_[i].gain.load(std::memory_order_relaxed);
+        }
+        return false;
+    }
+
+    memset(accumulator_, 0, block_samples_ * sizeof(int32_t));
+    for (int i = 0; i < source_count_; i++) {
+        Source& s = sources_[i];
+        int32_t target = s.gain.load(std::memory_order_relaxed);
+        if (s.priority < top_priority) {
+            target = (target * s.duck_gain) >> 15;
+        }
+        // Duck at once (within this block), come back slowly
+        int32_t gain = target;
+        if (target > s.applied_gain && s.active) {
+            gain = std::min(target, s.applied_gain + AUDIO_MIXER_UNITY_GAIN / AUDIO_MIXER_DUCK_RELEASE_BLOCKS);
+        }
+        if (!s.active) {
+            s.applied_gain = gain;
+            continue;
+        }
+
+        size_t samples = std::min(available[i], block_samples_);
+        if (samples < block_samples_) {
+            partial_blocks_.fetch_add(1, std::memory_order_relaxed);
+            metrics_counter_add(&metric_partial_blocks, 1);
+        }
+        int32_t gain_q30 = s.applied_gain * (1 << 15);
+        int32_t step_q30 = (gain - s.applied_gain) * (1 << 15) / static_cast<int32_t>(block_samples_);
+        uint32_t head = s.head.load(std::memory_order_relaxed);
+        size_t index = head & s.mask;
+        size_t first = std::min(samples, s.mask + 1 - index);
+        gain_q30 = MixSegment(accumulator_, s.ring + index, first, gain_q30, step_q30);
+        MixSegment(accumulator_ + first, s.ring, samples - first, gain_q30, step_q30);
+        s.head.store(head + samples, std::memory_order_release);
+        s.applied_gain = gain;
+    }
+    Saturate(accumulator_, out, block_samples_);
+    blocks_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Fixed-point mixer in front of the codec output.
+ *
+ * Every source is a mono PCM ring at the codec output rate with its own gain (Q15), a
+ * priority and a duck gain. While a source of higher priority has audio, a source is
+ * attenuated to its duck gain: speech over music, an alarm over speech. Gain changes ramp
+ * over one block so they never click, and a ducked source recovers over
+ * AUDIO_MIXER_DUCK_RELEASE_BLOCKS blocks.
+ *
+ * Sources are added once before the output task starts. Each ring has exactly one producer
+ * task (Write) and the output task as its consumer (Mix); RequestClear(), SetGain() and the
+ * queries are safe from any task.
+ */
+
+#define AUDIO_MIXER_MAX_SOURCES 4
+#define AUDIO_MIXER_UNITY_GAIN 32768
+#define AUDIO_MIXER_DUCK_RELEASE_BLOCKS 30
+
+struct AudioMixerStatistics {
+    uint32_t blocks = 0;            // blocks mixed since start
+    uint32_t partial_blocks = 0;    // source blocks padded with silence, a stream ending or an underrun
+    uint8_t active_sources = 0;     // sources with audio in the last block
+};
+
+class AudioMixer {
+public:
+    AudioMixer() = default;
+    ~AudioMixer();
+    AudioMixer(const AudioMixer&) = delete;
+    AudioMixer& operator=(const AudioMixer&) = delete;
+
+    // block_samples is the size of every Mix() output
+    bool Initialize(size_t block_samples);
+    // Returns the source id, or -1 when out of slots. Ids are handed out in order, a source whose
+    // ring could not be allocated keeps its id but stays silent. capacity_samples is rounded up to a power of two
+    int AddSource(const char* name, int priority, size_t capacity_samples, int32_t duck_gain = AUDIO_MIXER_UNITY_GAIN);
+
+    // Producer side, never blocks: returns the number of samples queued
+    size_t Write(int source, const int16_t* pcm, size_t samples);
+    size_t Space(int source) const;
+    size_t Available(int source) const;
+    // Drop what is queued now, audio written afterwards is kept
+    void RequestClear(int source);
+    void SetGain(int source, int32_t gain);
+
+    // Consumer side: mixes one block, sources without enough audio are padded with silence.
+    // Returns false (and leaves out untouched) when no source has audio.
+    bool Mix(int16_t* out);
+    bool HasAudio() const;
+
+    size_t block_samples() const { return block_samples_; }
+    AudioMixerStatistics GetStatistics() const;
+
+private:
+    struct Source {
+        const char* name = nullptr;
+        int priority = 0;
+        int16_t* ring = nullptr;
+        uint32_t mask = 0;
+        std::atomic<uint32_t> head{0};
+        std::atomic<uint32_t> tail{0};
+        std::atomic<uint32_t> clear_mark{0};
+        std::atomic<bool> clear_requested{false};
+        std::atomic<int32_t> gain{AUDIO_MIXER_UNITY_GAIN};
+        int32_t duck_gain = AUDIO_MIXER_UNITY_GAIN;
+        // Output task state: the gain applied at the end of the last block
+        int32_t applied_gain = 0;
+        bool active = false;
+    };
+
+    Source sources_[AUDIO_MIXER_MAX_SOURCES];
+    int source_count_ = 0;
+    size_t block_samples_ = 0;
+    int32_t* accumulator_ = nullptr;
+    std::atomic<uint32_t> blocks_{0};
+    std::atomic<uint32_t> partial_blocks_{0};
+    std::atomic<uint8_t> active_sources_{0};
+
+    static size_t Fill(Source& source);
+    static int32_t MixSegment(int32_t* acc, const int16_t* in, size_t samples, int32_t gain_q30, int32_t step_q30);
+    static void Saturate(const int32_t* acc, int16_t* out, size_t samples);
+};
+
+#endif // AUDIO_MIXER_H
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <span>
 
 #include "audio_codec.h"
 
@@ -12,10 +13,14 @@ public:
     virtual ~AudioProcessor() = default;
     
     virtual void Initialize(AudioCodec* codec, int frame_duration_ms) = 0;
-    virtual void Feed(std::vector<int16_t>&& data) = 0;
+    // May be called from another task while running, takes effect on the next output frame
+    virtual void SetFrameDuration(int frame_duration_ms) = 0;
+    // Interleaved input channels; the buffer belongs to the caller and is reused after the call returns
+    virtual void Feed(std::span<const int16_t> data) = 0;
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual bool IsRunning() = 0;
+    // The callback may keep the frame; swapping in an empty buffer to reuse keeps the processor allocation-free
     virtual void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) = 0;
     virtual void OnVadStateChange(std::function<void(bool speaking)> callback) = 0;
     virtual size_t GetFeedSize() = 0;
@@ -2,7 +2,10 @@
 #include <esp_log.h>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
 #include "audio_uploader.h"
+#include "metrics.h"
+#include "stereo_pcm.h"
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
@@ -12,6 +15,15 @@
 
 #define TAG "AudioService"
 
+METRICS_COUNTER(metric_input_frames, "audio.input_frames");
+METRICS_COUNTER(metric_decode_frames, "audio.decode_frames");
+METRICS_COUNTER(metric_encode_frames, "audio.encode_frames");
+METRICS_COUNTER(metric_playback_frames, "audio.playback_frames");
+METRICS_HISTOGRAM(metric_decode_us, "audio.decode_us", 1000, 2000, 5000, 10000, 20000, 40000);
+METRICS_HISTOGRAM(metric_encode_us, "audio.encode_us", 5000, 10000, 20000, 30000, 40000, 60000);
+METRICS_GAUGE(metric_jitter_depth, "audio.jitter_depth_frames");
+METRICS_GAUGE(metric_encode_bitrate, "audio.encode_bitrate");
+METRICS_GAUGE(metric_encode_complexity, "audio.encode_complexity");
 
 AudioService::AudioService() {
     event_group_ = xEventGroupCreate();
@@ -28,16 +40,67 @@ void AudioService::Initialize(AudioCodec* codec) {
     codec_ = codec;
     codec_->Start();
 
+    metrics_register(&metric_input_frames);
+    metrics_register(&metric_decode_frames);
+    metrics_register(&metric_encode_frames);
+    metrics_register(&metric_playback_frames);
+    metrics_register(&metric_decode_us);
+    metrics_register(&metric_encode_us);
+    metrics_register(&metric_jitter_depth);
+    metrics_register(&metric_encode_bitrate);
+    metrics_register(&metric_encode_complexity);
+
     /* Setup the audio codec */
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_->SetComplexity(0);
+    opus_decoder_ = std::make_unique<OpusStreamDecoder>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MAX_MS);
+    sound_decoder_ = std::make_unique<OpusStreamDecoder>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MAX_MS);
+    opus_encoder_ = std::make_unique<OpusStreamEncoder>(16000, 1, frame_duration_ms_);
+    ApplyEncoderSettings();
+
+    /* Frame pools: PCM frames live in PSRAM, Opus packets are small and stay internal */
+    size_t max_pcm_samples = std::max(16000, codec->output_sample_rate()) * OPUS_FRAME_DURATION_MAX_MS / 1000;
+    if (!task_pool_.Initialize(AUDIO_TASK_POOL_SIZE, MALLOC_CAP_SPIRAM, [max_pcm_samples](AudioTask& task) {
+        task.pcm.reserve(max_pcm_samples);
+    })) {
+        ESP_LOGW(TAG, "Failed to allocate audio task pool");
+    }
+    if (!packet_pool_.Initialize(AUDIO_PACKET_POOL_SIZE, MALLOC_CAP_INTERNAL, [](AudioStreamPacket& packet) {
+        packet.payload.reserve(AUDIO_PACKET_POOL_PAYLOAD_BYTES);
+    })) {
+        ESP_LOGW(TAG, "Failed to allocate audio packet pool");
+    }
+    decode_buffer_.reserve(max_pcm_samples);
+    capture_buffer_.reserve(codec->input_channels() * codec->input_sample_rate() * OPUS_FRAME_DURATION_MAX_MS / 1000);
+    testing_frame_.reserve(16000 * OPUS_FRAME_DURATION_MAX_MS / 1000);
+    encode_buffer_.reserve(MAX_OPUS_PACKET_SIZE);
+    preroll_frame_.reserve(16000 * OPUS_FRAME_DURATION_MAX_MS / 1000);
+    uplink_gate_.Initialize(16000);
+#if CONFIG_AUDIO_UPLINK_VAD_GATE
+    uplink_gate_.SetEnabled(true);
+#endif
+
+    /* Mixer: one DMA frame per period, sources are added in AudioOutputSource (priority) order */
+    int output_rate = codec->output_sample_rate();
+    output_block_.resize(AUDIO_CODEC_DMA_FRAME_NUM);
+    mixer_.Initialize(AUDIO_CODEC_DMA_FRAME_NUM);
+    mixer_.AddSource("music", kAudioOutputMusic, output_rate * AUDIO_MIXER_MUSIC_BUFFER_MS / 1000, AUDIO_MIXER_MUSIC_DUCK_GAIN);
+    mixer_.AddSource("voice", kAudioOutputVoice, output_rate * AUDIO_MIXER_VOICE_BUFFER_MS / 1000, AUDIO_MIXER_VOICE_DUCK_GAIN);
+    mixer_.AddSource("alert", kAudioOutputAlert, output_rate * AUDIO_MIXER_ALERT_BUFFER_MS / 1000);
+#ifdef CONFIG_SOUND_CACHE_SIZE_KB
+    sound_cache_.SetBudget(CONFIG_SOUND_CACHE_SIZE_KB * 1024);
+#endif
 
     if (codec->input_sample_rate() != 16000) {
         input_resampler_.Configure(codec->input_sample_rate(), 16000);
         reference_resampler_.Configure(codec->input_sample_rate(), 16000);
+        /* One Opus frame per channel before and after resampling, so ReadAudioData never allocates */
+        int frames = codec->input_sample_rate() * OPUS_FRAME_DURATION_MAX_MS / 1000;
+        input_scratch_.resize(codec->input_channels() * (frames + input_resampler_.GetOutputSamples(frames)));
     }
 
+#if CONFIG_USE_AUDIO_DEBUGGER
+    audio_debugger_ = std::make_unique<AudioDebugger>();
+#endif
+
 #if CONFIG_USE_AUDIO_PROCESSOR
     audio_processor_ = std::make_unique<AfeAudioProcessor>();
 #else
@@ -46,38 +109,33 @@ void AudioService::Initialize(AudioCodec* codec) {
 
     audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
         if (afe_output_callback_) {
-            std::vector<int16_t> copy = data;
-            afe_output_callback_(std::move(copy));
+            afe_output_callback_(data);
+        }
+        if (audio_debugger_) {
+            audio_debugger_->Capture(kAudioDebugTapAfeOutput, data.data(), data.size() * sizeof(int16_t));
         }
         // 将 AFE 输出送入发送队列；PushTaskToEncodeQueue 自带丢弃策略避免阻塞
-        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
+        uint32_t capture_time = CaptureTimeOf(data.size());
+        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data), capture_time);
     });
 
     audio_processor_->OnVadStateChange([this](bool speaking) {
         voice_detected_ = speaking;
+        if (speaking) {
+            /* The reply follows the utterance, have the speaker ready before its first packet */
+            codec_power_.Prewarm(kCodecPowerOutput, AUDIO_POWER_REPLY_HOLD_MS);
+        }
         if (callbacks_.on_vad_change) {
             callbacks_.on_vad_change(speaking);
         }
     });
-
-    esp_timer_create_args_t audio_power_timer_args = {
-        .callback = [](void* arg) {
-            AudioService* audio_service = (AudioService*)arg;
-            audio_service->CheckAndUpdateAudioPowerState();
-        },
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "audio_power_timer",
-        .skip_unhandled_events = true,
-    };
-    esp_timer_create(&audio_power_timer_args, &audio_power_timer_);
 }
 
 void AudioService::Start() {
     service_stopped_ = false;
     xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
-    esp_timer_start_periodic(audio_power_timer_, 1000000);
+    codec_power_.Start(codec_);
 
 #if CONFIG_USE_AUDIO_PROCESSOR
     /* Start the audio input task */
@@ -109,60 +167,83 @@ void AudioService::Start() {
     }, "audio_output", 2048, this, 4, &audio_output_task_handle_);
 #endif
 
-    /* Start the opus codec task */
-    xTaskCreate([](void* arg) {
+    /* Start the opus decode / encode tasks on separate cores */
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusDecodeTask();
+        vTaskDelete(NULL);
+    }, "opus_decode", OPUS_DECODE_TASK_STACK_SIZE, this, OPUS_DECODE_TASK_PRIORITY,
+        &opus_decode_task_handle_, OPUS_DECODE_TASK_CORE);
+
+    xTaskCreatePinnedToCore([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
-        audio_service->OpusCodecTask();
+        audio_service->OpusEncodeTask();
         vTaskDelete(NULL);
-    }, "opus_codec", 2048 * 13, this, 2, &opus_codec_task_handle_);
+    }, "opus_encode", OPUS_ENCODE_TASK_STACK_SIZE, this, OPUS_ENCODE_TASK_PRIORITY,
+        &opus_encode_task_handle_, OPUS_ENCODE_TASK_CORE);
 }
 
 void AudioService::Stop() {
-    esp_timer_stop(audio_power_timer_);
+    codec_power_.Stop();
     service_stopped_ = true;
     xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
-        AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+        AS_EVENT_AUDIO_PROCESSOR_RUNNING | AS_EVENT_DECODE_QUEUE_SPACE);
+
+    /* The consumers drop whatever is still queued the next time they pop */
+    audio_encode_queue_.RequestClear();
+    audio_testing_encode_queue_.RequestClear();
+    audio_decode_queue_.RequestClear();
+    jitter_buffer_.RequestReset();
+    audio_playback_queue_.RequestClear();
+    audio_testing_queue_.RequestClear();
+    sound_generation_++;
+    for (int source = 0; source < kAudioOutputSourceCount; source++) {
+        mixer_.RequestClear(source);
+    }
+    NotifyTask(audio_output_task_handle_);
+    NotifyTask(opus_decode_task_handle_);
+    NotifyTask(opus_encode_task_handle_);
+}
 
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+void AudioService::NotifyTask(TaskHandle_t task) {
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
+    }
 }
 
-bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
-    if (!codec_->input_enabled()) {
-        esp_timer_stop(audio_power_timer_);
-        esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
-        codec_->EnableInput(true);
+int16_t* AudioService::ReserveInputScratch(size_t samples) {
+    // Sized in Initialize, only grows if a caller reads more than one Opus frame at once
+    if (input_scratch_.size() < samples) {
+        ESP_LOGW(TAG, "Growing input scratch buffer to %u samples", (unsigned int)samples);
+        input_scratch_.resize(samples);
     }
+    return input_scratch_.data();
+}
 
+bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
     if (codec_->input_sample_rate() != sample_rate) {
         data.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
         if (!codec_->InputData(data)) {
             return false;
         }
         if (codec_->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
+            /* Split mic / reference into scratch, resample each into scratch, interleave back into data */
+            int frames = data.size() / 2;
+            int resampled_frames = input_resampler_.GetOutputSamples(frames);
+            int16_t* mic = ReserveInputScratch(2 * (frames + resampled_frames));
+            int16_t* reference = mic + frames;
+            int16_t* resampled_mic = reference + frames;
+            int16_t* resampled_reference = resampled_mic + resampled_frames;
+            DeinterleaveStereo(data.data(), mic, reference, frames);
+            input_resampler_.Process(mic, frames, resampled_mic);
+            reference_resampler_.Process(reference, frames, resampled_reference);
+            data.resize(resampled_frames * 2);
+            InterleaveStereo(resampled_mic, resampled_reference, data.data(), resampled_frames);
         } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
+            int resampled_samples = input_resampler_.GetOutputSamples(data.size());
+            int16_t* resampled = ReserveInputScratch(resampled_samples);
+            input_resampler_.Process(data.data(), data.size(), resampled);
+            data.assign(resampled, resampled + resampled_samples);
         }
     } else {
         data.resize(samples * codec_->input_channels());
@@ -171,17 +252,17 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
         }
     }
 
-    /* Update the last input time */
-    last_input_time_ = std::chrono::steady_clock::now();
-    debug_statistics_.input_count++;
+    codec_power_.MarkActive(kCodecPowerInput);
+    metrics_counter_add(&metric_input_frames, 1);
 
-#if CONFIG_USE_AUDIO_DEBUGGER
-    // 音频调试：发送原始音频数据
-    if (audio_debugger_ == nullptr) {
-        audio_debugger_ = std::make_unique<AudioDebugger>();
+    // 音频调试：麦克风和参考通道分别抓取，只拷贝进环形缓冲，不阻塞
+    if (audio_debugger_) {
+        int channels = codec_->input_channels();
+        audio_debugger_->CaptureChannel(kAudioDebugTapMic, data.data(), data.size() / channels, channels, 0);
+        if (channels == 2) {
+            audio_debugger_->CaptureChannel(kAudioDebugTapReference, data.data(), data.size() / 2, 2, 1);
+        }
     }
-    audio_debugger_->Feed(data);
-#endif
 
     return true;
 }
@@ -195,42 +276,52 @@ void AudioService::AudioInputTask() {
         if (service_stopped_) {
             break;
         }
-        if (audio_input_need_warmup_) {
-            audio_input_need_warmup_ = false;
-            vTaskDelay(pdMS_TO_TICKS(120));
+        if (audio_input_restarted_) {
+            audio_input_restarted_ = false;
+            // The processor was restarted, sample positions for latency tracing count from zero again
+            capture_epoch_++;
+            captured_samples_ = 0;
+        }
+        /* The power task opens the codec; this only waits when nothing pre-warmed it */
+        if (!codec_power_.WaitReady(kCodecPowerInput, pdMS_TO_TICKS(AUDIO_POWER_CHECK_INTERVAL_MS))) {
             continue;
         }
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+            int frame_duration_ms = frame_duration_ms_;
+            if (audio_testing_queue_.Full() ||
+                audio_testing_queue_.Size() * frame_duration_ms >= AUDIO_TESTING_MAX_DURATION_MS) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
-            std::vector<int16_t> data;
-            int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
+            /* Read into the capture buffer, the mono frame is traded for a pooled buffer on push */
+            std::vector<int16_t>& data = capture_buffer_;
+            int samples = frame_duration_ms * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
                 // If input channels is 2, we need to fetch the left channel data
-                if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
-                    for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                        mono_data[i] = data[j];
-                    }
-                    data = std::move(mono_data);
+                int channels = codec_->input_channels();
+                testing_frame_.resize(data.size() / channels);
+                for (size_t i = 0, j = 0; i < testing_frame_.size(); ++i, j += channels) {
+                    testing_frame_[i] = data[j];
                 }
-                PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(data));
+                PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(testing_frame_));
                 continue;
             }
         }
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-            std::vector<int16_t> data;
+            /* Reserved in Initialize for up to one Opus frame, so reading and feeding never allocate */
+            std::vector<int16_t>& data = capture_buffer_;
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
-                    audio_processor_->Feed(std::move(data));
+                    captured_samples_ += samples;
+                    CaptureStamp stamp = { captured_samples_, latency_trace_now(), capture_epoch_ };
+                    capture_stamps_.Push(std::move(stamp));
+                    audio_processor_->Feed(data);
                     continue;
                 }
             }
@@ -244,201 +335,580 @@ void AudioService::AudioInputTask() {
 }
 
 void AudioService::AudioOutputTask() {
+    const TickType_t block_ticks = std::max<TickType_t>(1,
+        pdMS_TO_TICKS(mixer_.block_samples() * 1000 / codec_->output_sample_rate()));
+    bool voice_waited = false;
+
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
         if (service_stopped_) {
             break;
         }
 
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
+        FeedVoiceSource();
+        size_t voice_samples = mixer_.Available(kAudioOutputVoice);
+        bool voice_short = !voice_task_ && voice_samples < mixer_.block_samples();
+        if (voice_short && !audio_output_waiting_) {
+            /* The speech is about to run dry, from now on the decode task fills missing frames instead of waiting */
+            audio_output_waiting_ = true;
+            NotifyTask(opus_decode_task_handle_);
+        } else if (!voice_short) {
+            audio_output_waiting_ = false;
+        }
+        if (!mixer_.HasAudio()) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (voice_short && voice_samples > 0 && !voice_waited) {
+            /* Give the decoder one block to deliver the next frame before the mixer pads the speech with silence */
+            voice_waited = true;
+            ulTaskNotifyTake(pdTRUE, block_ticks);
+            continue;
+        }
+        voice_waited = false;
 
-        if (!codec_->output_enabled()) {
-            esp_timer_stop(audio_power_timer_);
-            esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
-            codec_->EnableOutput(true);
+        /* Keep the mixed audio until the power task has the DAC up, never open it here */
+        if (!codec_power_.WaitReady(kCodecPowerOutput, block_ticks)) {
+            continue;
         }
-        codec_->OutputData(task->pcm);
-        ESP_LOGD(TAG, "Played chunk samples=%u", (unsigned int)task->pcm.size());
+        /* One DMA-sized block per period however many sources play, the I2S write paces the loop */
+        if (mixer_.Mix(output_block_.data())) {
+            if (audio_debugger_) {
+                audio_debugger_->Capture(kAudioDebugTapMixer, output_block_.data(), output_block_.size() * sizeof(int16_t));
+            }
+            codec_->OutputData(output_block_);
+            codec_power_.MarkActive(kCodecPowerOutput);
+        }
+    }
+
+    ESP_LOGW(TAG, "Audio output task stopped");
+}
 
-        /* Update the last output time */
-        last_output_time_ = std::chrono::steady_clock::now();
-        debug_statistics_.playback_count++;
+void AudioService::FeedVoiceSource() {
+    while (true) {
+        if (voice_task_ && voice_task_generation_ != sound_generation_.load()) {
+            /* ResetDecoder() / Stop() dropped the speech, including the frame in hand */
+            voice_task_.reset();
+        }
+        if (!voice_task_) {
+            if (!audio_playback_queue_.Pop(voice_task_)) {
+                return;
+            }
+            voice_task_offset_ = 0;
+            voice_task_generation_ = sound_generation_.load();
+            /* A playback slot is free again, let the decode task decode the next packet */
+            NotifyTask(opus_decode_task_handle_);
+        }
+
+        auto& pcm = voice_task_->pcm;
+        voice_task_offset_ += mixer_.Write(kAudioOutputVoice, pcm.data() + voice_task_offset_, pcm.size() - voice_task_offset_);
+        if (voice_task_offset_ < pcm.size()) {
+            return;
+        }
+        ESP_LOGD(TAG, "Played chunk samples=%u", (unsigned int)pcm.size());
+        // Sounds and concealed frames have no receive stamp and are not committed
+        voice_task_->trace.stamps[LATENCY_TRACE_DOWN_WRITTEN] = latency_trace_now();
+        latency_trace_commit(kLatencyTraceDownlink, &voice_task_->trace);
+        metrics_counter_add(&metric_playback_frames, 1);
 
 #if CONFIG_USE_SERVER_AEC
         /* Record the timestamp for server AEC */
-        if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
+        if (voice_task_->timestamp > 0 && !timestamp_queue_.Push(std::move(voice_task_->timestamp))) {
+            ESP_LOGW(TAG, "Timestamp queue is full, dropping timestamp");
         }
 #endif
+        voice_task_.reset();
     }
-
-    ESP_LOGW(TAG, "Audio output task stopped");
 }
 
-void AudioService::OpusCodecTask() {
-    ESP_LOGI(TAG, "Opus codec task started");
-    
-    while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                !audio_encode_queue_.empty() ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
-        });
+void AudioService::OpusDecodeTask() {
+    ESP_LOGI(TAG, "Opus decode task started on core %d", xPortGetCoreID());
 
+    while (true) {
         if (service_stopped_) {
             break;
         }
 
+        /* Requests from other tasks: this task owns the decoder and consumes audio_testing_queue_ */
+        if (decoder_reset_requested_.exchange(false)) {
+            opus_decoder_->ResetState();
+        }
+        audio_testing_queue_.ApplyRequestedClear();
+        if (audio_testing_playback_requested_.exchange(false)) {
+            PlayAudioTestingQueue();
+        }
+
         /* ------------------ Decoding Logic (Server -> Speaker) ------------------ */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock(); // 解锁进行耗时操作
-
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
+        // 先把到达的包移入抖动缓冲；到达时间在入队时记录，本任务忙于解码时也不会把抖动算小
+        AudioStreamPacketPtr packet;
+        bool moved = false;
+        // 回放测试录音时先放完录音，服务端的包留在解码队列里等待
+        while (audio_testing_playing_ && !jitter_buffer_.Full()) {
+            if (!audio_testing_queue_.Pop(packet)) {
+                audio_testing_playing_ = false;
+                break;
+            }
+            jitter_buffer_.Put(std::move(packet), esp_timer_get_time());
+        }
+        while (!audio_testing_playing_ && !jitter_buffer_.Full() && audio_decode_queue_.Pop(packet)) {
+            int64_t arrival_us = packet->arrival_us != 0 ? packet->arrival_us : esp_timer_get_time();
+            jitter_buffer_.Put(std::move(packet), arrival_us);
+            moved = true;
+        }
+        if (moved) {
+            /* Wake up PushPacketToDecodeQueue(wait = true) callers */
+            xEventGroupSetBits(event_group_, AS_EVENT_DECODE_QUEUE_SPACE);
+        }
 
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            
-            // 解码 Opus
-            if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
-                // 重采样逻辑
-                if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
-                    int target_size = output_resampler_.GetOutputSamples(task->pcm.size());
-                    std::vector<int16_t> resampled(target_size);
-                    output_resampler_.Process(task->pcm.data(), task->pcm.size(), resampled.data());
-                    task->pcm = std::move(resampled);
+        if (audio_playback_queue_.Full()) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        /* Local sounds go first, they are short and were explicitly requested */
+        const uint8_t* sound_packet = nullptr;
+        size_t sound_packet_size = 0;
+        const int16_t* sound_pcm = nullptr;
+        size_t sound_samples = 0;
+        JitterBufferAction action = kJitterBufferWait;
+        SoundFrameType sound_frame = NextSoundFrame(sound_packet, sound_packet_size, sound_pcm, sound_samples);
+        if (sound_frame == kSoundFrameNone) {
+            action = jitter_buffer_.Next(esp_timer_get_time(), audio_output_waiting_ && audio_playback_queue_.Empty());
+            if (action == kJitterBufferWait) {
+                uint32_t wait_ms = jitter_buffer_.WaitTimeMs();
+                ulTaskNotifyTake(pdTRUE, wait_ms > 0 ? pdMS_TO_TICKS(wait_ms) : portMAX_DELAY);
+                continue;
+            }
+        }
+        int64_t start_time = esp_timer_get_time();
+
+        auto task = task_pool_.Acquire();
+        task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+        task->timestamp = 0;
+        task->trace = {};
+
+        // 解码 Opus（解码到本任务的暂存缓冲，再写入池化帧，避免每帧分配）
+        bool decoded;
+        OpusStreamDecoder* decoder = opus_decoder_.get();
+        PolyphaseResampler* resampler = &output_resampler_;
+        if (sound_frame == kSoundFramePcm) {
+            // 提示音缓存命中：PCM 已是输出采样率，跳过解码和重采样
+            task->pcm.assign(sound_pcm, sound_pcm + sound_samples);
+            decoded = true;
+        } else if (sound_frame == kSoundFrameOpus) {
+            // 提示音：直接从 flash 中的 Ogg 数据解码，不经过解码队列，用独立的解码器
+            SetDecodeSampleRate(sound_decoder_, sound_resampler_, current_sound_->demuxer_.sample_rate());
+            decoder = sound_decoder_.get();
+            resampler = &sound_resampler_;
+            decoded = decoder->Decode(sound_packet, sound_packet_size, decode_buffer_);
+        } else if (action == kJitterBufferDecode) {
+            packet = jitter_buffer_.Take();
+            task->timestamp = packet->timestamp;
+            task->trace.stamps[LATENCY_TRACE_DOWN_RECEIVED] = packet->receive_time;
+            task->trace.stamps[LATENCY_TRACE_DOWN_DEQUEUED] = latency_trace_now();
+            SetDecodeSampleRate(opus_decoder_, output_resampler_, packet->sample_rate);
+            decoder = opus_decoder_.get();
+            stream_frame_duration_ms_ = packet->frame_duration;
+            decoded = decoder->Decode(packet->payload.data(), packet->payload.size(), decode_buffer_);
+        } else if (action == kJitterBufferDecodeFec) {
+            // 丢失帧：用下一包携带的 FEC 数据恢复，下一包本身留在缓冲里正常解码
+            const AudioStreamPacket* next = jitter_buffer_.PeekNext();
+            decoded = decoder->DecodeFec(next->payload.data(), next->payload.size(), next->frame_duration, decode_buffer_);
+        } else {
+            // 丢失帧且没有后续包：由解码器做丢包隐藏，长度按上一帧
+            decoded = decoder->Conceal(stream_frame_duration_ms_, decode_buffer_);
+            if (decoded && action == kJitterBufferConcealTail) {
+                // 缓冲已空，回复可能已经结束：隐藏帧逐渐淡出，不在结尾留下一段 PLC 杂音
+                float from, to;
+                jitter_buffer_.TailGain(from, to);
+                size_t samples = decode_buffer_.size();
+                for (size_t i = 0; i < samples; i++) {
+                    float gain = from + (to - from) * i / samples;
+                    decode_buffer_[i] = static_cast<int16_t>(decode_buffer_[i] * gain);
                 }
+            }
+        }
 
-                // 放入播放队列
-                lock.lock();
-                audio_playback_queue_.push_back(std::move(task));
-                audio_queue_cv_.notify_all(); // 通知 OutputTask
+        if (decoded) {
+            // 重采样逻辑
+            if (sound_frame == kSoundFramePcm) {
+                // already at the output rate
+            } else if (decoder->sample_rate() != codec_->output_sample_rate()) {
+                task->pcm.resize(resampler->GetOutputSamples(decode_buffer_.size()));
+                resampler->Process(decode_buffer_.data(), decode_buffer_.size(), task->pcm.data());
             } else {
-                ESP_LOGE(TAG, "Failed to decode audio");
-                lock.lock();
+                task->pcm.assign(decode_buffer_.begin(), decode_buffer_.end());
+            }
+
+            // 缓存未命中的提示音：记录输出 PCM，完整播放后放入缓存
+            if (sound_frame == kSoundFrameOpus && sound_capturing_) {
+                if ((sound_capture_.size() + task->pcm.size()) * sizeof(int16_t) <= sound_cache_.budget_bytes()) {
+                    sound_capture_.insert(sound_capture_.end(), task->pcm.begin(), task->pcm.end());
+                } else {
+                    sound_capturing_ = false;
+                    std::vector<int16_t>().swap(sound_capture_);
+                }
+            }
+
+            if (audio_debugger_) {
+                audio_debugger_->Capture(kAudioDebugTapDecoded, task->pcm.data(), task->pcm.size() * sizeof(int16_t));
             }
-            debug_statistics_.decode_count++;
+
+            // 放入播放队列（本任务是唯一生产者，上面已确认未满）
+            task->trace.stamps[LATENCY_TRACE_DOWN_DECODED] = latency_trace_now();
+            audio_playback_queue_.Push(std::move(task));
+            NotifyTask(audio_output_task_handle_);
+        } else {
+            ESP_LOGE(TAG, "Failed to decode audio");
         }
-        
+        metrics_counter_add(&metric_decode_frames, 1);
+        int64_t elapsed_us = esp_timer_get_time() - start_time;
+        metrics_histogram_record(&metric_decode_us, elapsed_us);
+        RecordFrameTime(decode_statistics_, elapsed_us);
+    }
+
+    ESP_LOGW(TAG, "Opus decode task stopped");
+}
+
+SoundFrameType AudioService::NextSoundFrame(const uint8_t*& packet, size_t& size, const int16_t*& pcm, size_t& samples) {
+    while (true) {
+        if (!current_sound_ && !sound_queue_.Pop(current_sound_)) {
+            return kSoundFrameNone;
+        }
+        SoundPlayback& sound = *current_sound_;
+        bool stale = sound.cancelled_ || sound.generation_ != sound_generation_.load();
+        if (!stale && !sound.started_) {
+            sound.started_ = true;
+            sound_playing_ = true;
+            sound_decoder_->ResetState();
+            if (sound_cache_.enabled()) {
+                sound.clip_ = sound_cache_.Find(sound.source_.data(), sound.source_.size());
+                sound_capturing_ = !sound.clip_;
+            }
+        }
+
+        if (!stale && sound.clip_) {
+            /* Cache hit: hand out the decoded PCM one Opus frame at a time */
+            if (sound.clip_offset_ < sound.clip_->samples) {
+                size_t chunk = codec_->output_sample_rate() * OPUS_FRAME_DURATION_MAX_MS / 1000;
+                pcm = sound.clip_->pcm + sound.clip_offset_;
+                samples = std::min(chunk, sound.clip_->samples - sound.clip_offset_);
+                sound.clip_offset_ += samples;
+                return kSoundFramePcm;
+            }
+        } else if (!stale && sound.demuxer_.NextPacket(packet, size)) {
+            return kSoundFrameOpus;
+        } else if (!stale && sound_capturing_) {
+            /* Decoded to the end without being cancelled, keep it for next time */
+            sound_cache_.Insert(sound.source_.data(), sound.source_.size(), sound_capture_.data(), sound_capture_.size());
+        }
+
+        if (sound_capturing_) {
+            sound_capturing_ = false;
+            std::vector<int16_t>().swap(sound_capture_);
+        }
+        sound.done_ = true;
+        current_sound_.reset();
+        sound_playing_ = false;
+    }
+}
+
+void AudioService::OpusEncodeTask() {
+    ESP_LOGI(TAG, "Opus encode task started on core %d", xPortGetCoreID());
+
+    while (true) {
+        if (service_stopped_) {
+            break;
+        }
+
         /* ------------------ Encoding Logic (Mic -> Server) ------------------ */
         // 注意：这里不需要再检查 audio_send_queue_ 的大小，因为我们直接发给 uploader
-        if (!audio_encode_queue_.empty()) {
-            // 如果还持有锁，先释放，取出任务
-            if (!lock.owns_lock()) lock.lock();
-            
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock(); // 解锁进行耗时编码
-
-            // 准备编码输出容器
-            std::vector<uint8_t> encoded_payload;
-            
-            // 执行编码
-            if (opus_encoder_->Encode(std::move(task->pcm), encoded_payload)) {
-                
-                // 处理编码后的数据
-                if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                    // === 核心修改：直接发送给 WebSocket Uploader ===
-                    // 不再存入 audio_send_queue_，减少内存占用和延迟
-                    // encoded_payload.data() 是 Opus 数据，encoded_payload.size() 是长度
-                    audio_uploader_send_bytes(encoded_payload.data(), encoded_payload.size());
-
-                } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                    // 用于本地测试的回环逻辑 (Boot Button 测试)
-                    auto packet = std::make_unique<AudioStreamPacket>();
-                    packet->payload = std::move(encoded_payload);
-                    packet->frame_duration = OPUS_FRAME_DURATION_MS;
-                    packet->sample_rate = 16000;
-                    
-                    lock.lock();
-                    audio_testing_queue_.push_back(std::move(packet));
-                    lock.unlock();
+        AudioTaskPtr task;
+        if (!audio_encode_queue_.Pop(task) && !audio_testing_encode_queue_.Pop(task)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        int64_t start_time = esp_timer_get_time();
+
+        /* The encoder follows the frames it is given, so frames queued before a renegotiation still encode */
+        int duration_ms = task->pcm.size() / 16;
+        if (duration_ms != opus_encoder_->duration_ms() && IsValidFrameDuration(duration_ms)) {
+            ESP_LOGI(TAG, "Encoder frame duration %d -> %d ms", opus_encoder_->duration_ms(), duration_ms);
+            opus_encoder_ = std::make_unique<OpusStreamEncoder>(16000, 1, duration_ms);
+            ApplyEncoderSettings();
+        }
+
+        /* Uplink frames pass the VAD gate, a closed gate skips the encoder entirely */
+        if (task->type == kAudioTaskTypeEncodeToSendQueue) {
+            auto action = uplink_gate_.Next(task->speech, duration_ms);
+            if (action == kUplinkGateHold || action == kUplinkGateHoldWithMarker) {
+                uplink_gate_.Hold(task->pcm);
+                if (action == kUplinkGateHoldWithMarker) {
+                    uint8_t marker = UplinkGate::MarkerToc(duration_ms);
+                    audio_uploader_send_traced(&marker, 1, nullptr, duration_ms);
                 }
-                
-                debug_statistics_.encode_count++;
-            } else {
-                ESP_LOGE(TAG, "Failed to encode audio");
+                continue;
+            }
+            if (action == kUplinkGateOpen) {
+                SendUplinkPreroll(task->pcm.size());
             }
-            
-            // 循环回来重新获取锁
-            lock.lock();
         }
+
+        // 执行编码
+        bool encoded;
+        if (task->type == kAudioTaskTypeEncodeToSendQueue) {
+            // === 核心修改：直接编码进 WebSocket Uploader 的发送环 ===
+            // 不再存入 audio_send_queue_，也不经过中间缓冲，减少内存占用和延迟
+            encoded = EncodeUplinkFrame(task->pcm, &task->trace);
+        } else {
+            // 编码输出写入预留容量的暂存缓冲
+            std::vector<uint8_t>& encoded_payload = encode_buffer_;
+            encoded = opus_encoder_->Encode(task->pcm, encoded_payload);
+            if (encoded && task->type == kAudioTaskTypeEncodeToTestingQueue) {
+                // 用于本地测试的回环逻辑 (Boot Button 测试)
+                auto packet = packet_pool_.Acquire();
+                packet->payload.assign(encoded_payload.begin(), encoded_payload.end());
+                packet->frame_duration = duration_ms;
+                packet->sample_rate = 16000;
+                packet->receive_time = 0;
+                packet->arrival_us = 0;
+                audio_testing_queue_.Push(std::move(packet));
+            }
+        }
+        if (encoded) {
+            metrics_counter_add(&metric_encode_frames, 1);
+        } else {
+            ESP_LOGE(TAG, "Failed to encode audio");
+        }
+        int64_t elapsed_us = esp_timer_get_time() - start_time;
+        metrics_histogram_record(&metric_encode_us, elapsed_us);
+        RecordFrameTime(encode_statistics_, elapsed_us);
+
+        /* Only the uplink steers the encoder, the test loopback has no link to measure */
+        if (task->type == kAudioTaskTypeEncodeToSendQueue) {
+            audio_uploader_stats_t uploader;
+            audio_uploader_get_stats(&uploader);
+            EncoderLinkState link;
+            link.queued_ms = uploader.queued * opus_encoder_->duration_ms();
+            link.send_failures = uploader.send_failures;
+            link.dropped = uploader.dropped;
+            if (encoder_controller_.Update(link, elapsed_us, opus_encoder_->duration_ms())) {
+                ApplyEncoderSettings();
+            }
+        }
+    }
+
+    ESP_LOGW(TAG, "Opus encode task stopped");
+}
+
+void AudioService::SendUplinkPreroll(size_t frame_samples) {
+    /* The encoder state is from before the silence, start clean at the oldest pre-roll frame */
+    opus_encoder_->ResetState();
+    while (uplink_gate_.TakePreroll(preroll_frame_, frame_samples)) {
+        if (EncodeUplinkFrame(preroll_frame_, nullptr)) {
+            metrics_counter_add(&metric_encode_frames, 1);
+        }
+    }
+}
+
+bool AudioService::EncodeUplinkFrame(const std::vector<int16_t>& pcm, latency_trace_t* trace) {
+    /* The packet is encoded straight into an uploader ring slot. Without a slot (offline or ring
+       full) it still goes through the encoder, so the stream stays continuous, and is dropped */
+    uint8_t* slot = audio_uploader_reserve(MAX_OPUS_PACKET_SIZE);
+    const uint8_t* packet = slot;
+    int size;
+    if (slot != nullptr) {
+        size = opus_encoder_->Encode(pcm, slot, MAX_OPUS_PACKET_SIZE);
+    } else {
+        size = opus_encoder_->Encode(pcm, encode_buffer_) ? (int)encode_buffer_.size() : -1;
+        packet = encode_buffer_.data();
+    }
+    if (size < 0) {
+        if (slot != nullptr) {
+            audio_uploader_cancel();
+        }
+        return false;
+    }
+
+    if (trace != nullptr) {
+        trace->stamps[LATENCY_TRACE_UP_ENCODED] = latency_trace_now();
+    }
+    if (audio_debugger_) {
+        audio_debugger_->Capture(kAudioDebugTapEncoded, packet, size);
     }
+    if (slot != nullptr) {
+        audio_uploader_commit(size, trace, opus_encoder_->duration_ms());
+    }
+    return true;
+}
 
-    ESP_LOGW(TAG, "Opus codec task stopped");
+void AudioService::ApplyEncoderSettings() {
+    const EncoderSettings& settings = encoder_controller_.settings();
+    opus_encoder_->SetBitrate(settings.bitrate);
+    opus_encoder_->SetComplexity(settings.complexity);
+    opus_encoder_->SetDtx(settings.dtx);
+    metrics_gauge_set(&metric_encode_bitrate, settings.bitrate);
+    metrics_gauge_set(&metric_encode_complexity, settings.complexity);
 }
 
-void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
-    if (opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
+void AudioService::RecordFrameTime(CodecTaskStatistics& statistics, int64_t elapsed_us) {
+    statistics.frames++;
+    statistics.busy_us += elapsed_us;
+    if (elapsed_us > statistics.max_frame_us) {
+        statistics.max_frame_us = elapsed_us;
+    }
+}
+
+void AudioService::UpdateCodecStatistics() {
+    int64_t now = esp_timer_get_time();
+    if (last_statistics_time_us_ != 0 && now > last_statistics_time_us_) {
+        float seconds = (now - last_statistics_time_us_) / 1000000.0f;
+        decode_statistics_.frames_per_second = (decode_statistics_.frames - last_decode_frames_) / seconds;
+        encode_statistics_.frames_per_second = (encode_statistics_.frames - last_encode_frames_) / seconds;
+        ESP_LOGI(TAG, "Codec stats: decode %.1f fps max %lu us, encode %.1f fps max %lu us",
+            decode_statistics_.frames_per_second, decode_statistics_.max_frame_us,
+            encode_statistics_.frames_per_second, encode_statistics_.max_frame_us);
+        auto jitter = jitter_buffer_.GetStatistics();
+        metrics_gauge_set(&metric_jitter_depth, jitter.depth_frames);
+        ESP_LOGI(TAG, "Jitter buffer: depth %lu target %lu jitter %lu ms, underruns %lu, concealed %lu, fec %lu, late %lu",
+            jitter.depth_frames, jitter.target_frames, jitter.jitter_ms, jitter.underruns,
+            jitter.concealed_frames, jitter.fec_frames, jitter.late_packets);
+        if (sound_cache_.enabled()) {
+            auto cache = sound_cache_.GetStatistics();
+            ESP_LOGI(TAG, "Sound cache: %lu hits, %lu misses, %lu evictions, %lu entries, %u / %u bytes",
+                cache.hits, cache.misses, cache.evictions, cache.entries,
+                (unsigned int)cache.used_bytes, (unsigned int)cache.budget_bytes);
+        }
+        auto mixer = mixer_.GetStatistics();
+        ESP_LOGI(TAG, "Mixer: %lu blocks, %lu partial, %u active sources",
+            mixer.blocks, mixer.partial_blocks, mixer.active_sources);
+        if (audio_debugger_ && audio_debugger_->taps() != 0) {
+            auto debugger = audio_debugger_->GetStatistics();
+            ESP_LOGI(TAG, "Audio debugger: taps 0x%02lx, %lu records, %lu dropped, %lu datagrams, %lu send failures",
+                (unsigned long)audio_debugger_->taps(), debugger.records, debugger.dropped,
+                debugger.datagrams, debugger.send_failures);
+        }
+        if (uplink_gate_.enabled()) {
+            auto gate = uplink_gate_.GetStatistics();
+            ESP_LOGI(TAG, "Uplink gate: %lu gated frames, %lu opens, %lu pre-roll frames, %lu markers",
+                gate.gated_frames, gate.opens, gate.preroll_frames, gate.markers);
+        }
+        auto power = codec_power_.GetStatistics();
+        ESP_LOGI(TAG, "Codec power: input off/warming/on %lu/%lu/%lu s, %lu power-ups, %lu stalls; "
+            "output off/warming/on %lu/%lu/%lu s, %lu power-ups, %lu stalls",
+            power.seconds[kCodecPowerInput][kCodecPowerOff], power.seconds[kCodecPowerInput][kCodecPowerWarming],
+            power.seconds[kCodecPowerInput][kCodecPowerOn], power.power_ups[kCodecPowerInput], power.stalls[kCodecPowerInput],
+            power.seconds[kCodecPowerOutput][kCodecPowerOff], power.seconds[kCodecPowerOutput][kCodecPowerWarming],
+            power.seconds[kCodecPowerOutput][kCodecPowerOn], power.power_ups[kCodecPowerOutput], power.stalls[kCodecPowerOutput]);
+    }
+    last_statistics_time_us_ = now;
+    last_decode_frames_ = decode_statistics_.frames;
+    last_encode_frames_ = encode_statistics_.frames;
+    /* The maximum is per window, so a single startup spike does not stick forever */
+    decode_statistics_.max_frame_us = 0;
+    encode_statistics_.max_frame_us = 0;
+}
+
+void AudioService::SetDecodeSampleRate(std::unique_ptr<OpusStreamDecoder>& decoder, PolyphaseResampler& resampler, int sample_rate) {
+    /* Keyed on the sample rate only, the decoder is sized for the longest frame */
+    if (decoder->sample_rate() == sample_rate) {
         return;
     }
 
-    opus_decoder_.reset();
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+    decoder.reset();
+    decoder = std::make_unique<OpusStreamDecoder>(sample_rate, 1, OPUS_FRAME_DURATION_MAX_MS);
 
     auto codec = Board::GetInstance().GetAudioCodec();
-    if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec->output_sample_rate());
-        output_resampler_.Configure(opus_decoder_->sample_rate(), codec->output_sample_rate());
+    if (decoder->sample_rate() != codec->output_sample_rate()) {
+        ESP_LOGI(TAG, "Resampling audio from %d to %d", decoder->sample_rate(), codec->output_sample_rate());
+        resampler.Configure(decoder->sample_rate(), codec->output_sample_rate());
+    }
+}
+
+uint32_t AudioService::CaptureTimeOf(size_t samples) {
+    /* The processor keeps sample order, so the frame ends at the same sample position in its input */
+    processed_samples_ += samples;
+    CaptureStamp stamp;
+    while (static_cast<int32_t>(last_capture_stamp_.end_sample - processed_samples_) < 0 && capture_stamps_.Pop(stamp)) {
+        if (stamp.epoch != last_capture_stamp_.epoch) {
+            // First frame after a processor restart
+            processed_samples_ = samples;
+        }
+        last_capture_stamp_ = stamp;
+    }
+    if (static_cast<int32_t>(last_capture_stamp_.end_sample - processed_samples_) < 0) {
+        return 0;
     }
+    return last_capture_stamp_.time;
 }
 
-void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
-    auto task = std::make_unique<AudioTask>();
+void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm, uint32_t capture_time) {
+    /* Trade buffers with the pooled frame: the caller gets the frame's empty reserved buffer back for its next frame */
+    auto task = task_pool_.Acquire();
     task->type = type;
-    task->pcm = std::move(pcm);
-    
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+    task->pcm.swap(pcm);
+    pcm.clear();
+    task->timestamp = 0;
+    task->speech = voice_detected_;
+    task->trace = {};
+    task->trace.stamps[LATENCY_TRACE_UP_CAPTURED] = capture_time;
+    task->trace.stamps[LATENCY_TRACE_UP_PROCESSED] = latency_trace_now();
+
+    /* Testing frames come from the input task, processed frames from the processor task */
+    if (type == kAudioTaskTypeEncodeToTestingQueue) {
+        if (audio_testing_encode_queue_.Push(std::move(task))) {
+            NotifyTask(opus_encode_task_handle_);
+        }
+        return;
+    }
 
     /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
-        } else {
-            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
-        }
-        timestamp_queue_.pop_front();
+    uint32_t timestamp;
+    if (timestamp_queue_.Pop(timestamp)) {
+        task->timestamp = timestamp;
     }
 
-    if (audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE) {
-        audio_encode_queue_.push_back(std::move(task));
-        audio_queue_cv_.notify_all();
+    if (audio_encode_queue_.Push(std::move(task))) {
+        NotifyTask(opus_encode_task_handle_);
     }
 }
 
-bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
+AudioStreamPacketPtr AudioService::AcquirePacket() {
+    auto packet = packet_pool_.Acquire();
+    packet->sample_rate = 0;
+    packet->frame_duration = 0;
+    packet->timestamp = 0;
+    packet->receive_time = 0;
+    packet->arrival_us = 0;
+    packet->payload.clear();
+    return packet;
+}
+
+bool AudioService::PushPacketToDecodeQueue(AudioStreamPacketPtr packet, bool wait) {
+    packet->arrival_us = esp_timer_get_time();
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(decode_push_mutex_);
+            if (audio_decode_queue_.Push(std::move(packet))) {
+                break;
+            }
+        }
+        if (!wait || service_stopped_) {
             return false;
         }
+        /* The decode task sets this bit every time it takes a packet out */
+        xEventGroupWaitBits(event_group_, AS_EVENT_DECODE_QUEUE_SPACE, pdTRUE, pdFALSE, portMAX_DELAY);
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
+    /* Downlink audio: the DAC opens while the jitter buffer fills, and the user will answer next */
+    codec_power_.Prewarm(kCodecPowerOutput);
+    codec_power_.Prewarm(kCodecPowerInput, AUDIO_POWER_REPLY_HOLD_MS);
+    NotifyTask(opus_decode_task_handle_);
     return true;
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
+AudioStreamPacketPtr AudioService::PopPacketFromSendQueue() {
+    AudioStreamPacketPtr packet;
+    if (!audio_send_queue_.Pop(packet)) {
         return nullptr;
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
     return packet;
 }
 
@@ -446,13 +916,15 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS);
+            audio_processor_->Initialize(codec_, frame_duration_ms_);
             audio_processor_initialized_ = true;
         }
 
         /* We should make sure no audio is playing */
         ResetDecoder();
-        audio_input_need_warmup_ = true;
+        /* Usually a no-op, the input stays warm while the device is in a conversation */
+        codec_power_.Prewarm(kCodecPowerInput);
+        audio_input_restarted_ = true;
         audio_processor_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
     } else {
@@ -464,31 +936,74 @@ void AudioService::EnableVoiceProcessing(bool enable) {
 void AudioService::EnableAudioTesting(bool enable) {
     ESP_LOGI(TAG, "%s audio testing", enable ? "Enabling" : "Disabling");
     if (enable) {
+        /* A new recording replaces one that is still playing, the decode task drops the old one */
+        audio_testing_queue_.RequestClear();
+        NotifyTask(opus_decode_task_handle_);
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        /* The decode task moves the recording to the decode queue, it is the testing queue's consumer */
+        audio_testing_playback_requested_ = true;
+        NotifyTask(opus_decode_task_handle_);
+    }
+}
+
+void AudioService::PlayAudioTestingQueue() {
+    /* Replace whatever is queued for playback with the recording, which the decode loop then feeds from the testing queue */
+    {
+        std::lock_guard<std::mutex> lock(decode_push_mutex_);
+        audio_decode_queue_.RequestClear();
     }
+    audio_testing_playing_ = !audio_testing_queue_.Empty();
+}
+
+void AudioService::SetAudioDebugTaps(uint32_t mask) {
+    if (audio_debugger_ == nullptr) {
+        ESP_LOGW(TAG, "Audio debugger is not enabled (CONFIG_USE_AUDIO_DEBUGGER)");
+        return;
+    }
+    audio_debugger_->SetTaps(mask);
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS);
+        audio_processor_->Initialize(codec_, frame_duration_ms_);
         audio_processor_initialized_ = true;
     }
 
     audio_processor_->EnableDeviceAec(enable);
+#if CONFIG_AUDIO_UPLINK_VAD_GATE
+    /* The AFE turns its VAD off while device AEC runs, so the uplink cannot be gated then */
+    uplink_gate_.SetEnabled(!enable);
+#endif
+}
+
+bool AudioService::IsValidFrameDuration(int frame_duration_ms) {
+    return frame_duration_ms == 20 || frame_duration_ms == 40 || frame_duration_ms == 60;
+}
+
+bool AudioService::SetFrameDuration(int frame_duration_ms) {
+    if (!IsValidFrameDuration(frame_duration_ms)) {
+        ESP_LOGW(TAG, "Unsupported frame duration: %d ms", frame_duration_ms);
+        return false;
+    }
+    if (frame_duration_ms_.exchange(frame_duration_ms) == frame_duration_ms) {
+        return true;
+    }
+    ESP_LOGI(TAG, "Set frame duration to %d ms", frame_duration_ms);
+    /* The processor re-frames its output, the encode task picks the new size up from the frames */
+    if (audio_processor_initialized_) {
+        audio_processor_->SetFrameDuration(frame_duration_ms);
+    }
+    return true;
 }
 
 void AudioService::SetCallbacks(AudioServiceCallbacks& callbacks) {
     callbacks_ = callbacks;
 }
 
-void AudioService::SetAfeOutputCallback(std::function<void(std::vector<int16_t>&&)> callback) {
+void AudioService::SetAfeOutputCallback(std::function<void(const std::vector<int16_t>&)> callback) {
     afe_output_callback_ = callback;
 }
 
@@ -496,11 +1011,6 @@ void AudioService::PlayTestTone(int freq_hz, int duration_ms) {
     if (!codec_) {
         return;
     }
-    if (!codec_->output_enabled()) {
-        esp_timer_stop(audio_power_timer_);
-        esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
-        codec_->EnableOutput(true);
-    }
 
     const int sample_rate = codec_->output_sample_rate();
     const int total_samples = sample_rate * duration_ms / 1000;
@@ -512,143 +1022,81 @@ void AudioService::PlayTestTone(int freq_hz, int duration_ms) {
         pcm[i] = static_cast<int16_t>(s * 6000.0f);
     }
 
-    codec_->OutputData(pcm);
-    last_output_time_ = std::chrono::steady_clock::now();
+    /* Mixed over whatever is playing instead of writing to the codec behind the output task */
+    WriteOutput(kAudioOutputAlert, pcm.data(), pcm.size());
     ESP_LOGI(TAG, "Played test tone freq=%dHz duration=%dms samples=%d", freq_hz, duration_ms, total_samples);
 }
 
-void AudioService::PlaySound(const std::string_view& ogg) {
-    ESP_LOGI(TAG, "PlaySound called, size=%d", (int)ogg.size());
-    
-    if (!codec_->output_enabled()) {
-        esp_timer_stop(audio_power_timer_);
-        esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
-        codec_->EnableOutput(true);
-        ESP_LOGI(TAG, "Output enabled");
+size_t AudioService::WriteOutput(AudioOutputSource source, const int16_t* pcm, size_t samples, TickType_t wait) {
+    if (source == kAudioOutputVoice || service_stopped_) {
+        return 0;
     }
+    const TickType_t block_ticks = std::max<TickType_t>(1,
+        pdMS_TO_TICKS(mixer_.block_samples() * 1000 / codec_->output_sample_rate()));
+    TickType_t start = xTaskGetTickCount();
+    size_t written = 0;
+    while (true) {
+        written += mixer_.Write(source, pcm + written, samples - written);
+        NotifyTask(audio_output_task_handle_);
+        if (written == samples || service_stopped_ || xTaskGetTickCount() - start >= wait) {
+            break;
+        }
+        /* The output task frees one block per period */
+        vTaskDelay(block_ticks);
+    }
+    return written;
+}
 
-    const uint8_t* buf = reinterpret_cast<const uint8_t*>(ogg.data());
-    size_t size = ogg.size();
-    size_t offset = 0;
+void AudioService::ClearOutput(AudioOutputSource source) {
+    mixer_.RequestClear(source);
+    NotifyTask(audio_output_task_handle_);
+}
 
-    auto find_page = [&](size_t start)->size_t {
-        for (size_t i = start; i + 4 <= size; ++i) {
-            if (buf[i] == 'O' && buf[i+1] == 'g' && buf[i+2] == 'g' && buf[i+3] == 'S') return i;
-        }
-        return static_cast<size_t>(-1);
-    };
+void AudioService::SetOutputGain(AudioOutputSource source, int32_t gain) {
+    mixer_.SetGain(source, gain);
+}
 
-    bool seen_head = false;
-    bool seen_tags = false;
-    int sample_rate = 16000; // 默认值
-    size_t queued_packets = 0;
+SoundHandle AudioService::PlaySound(const std::string_view& ogg) {
+    ESP_LOGI(TAG, "PlaySound called, size=%d", (int)ogg.size());
 
-    while (true) {
-        size_t pos = find_page(offset);
-        if (pos == static_cast<size_t>(-1)) break;
-        offset = pos;
-        if (offset + 27 > size) break;
-
-        const uint8_t* page = buf + offset;
-        uint8_t page_segments = page[26];
-        size_t seg_table_off = offset + 27;
-        if (seg_table_off + page_segments > size) break;
-
-        size_t body_size = 0;
-        for (size_t i = 0; i < page_segments; ++i) body_size += page[27 + i];
-
-        size_t body_off = seg_table_off + page_segments;
-        if (body_off + body_size > size) break;
-
-        // Parse packets using lacing
-        size_t cur = body_off;
-        size_t seg_idx = 0;
-        while (seg_idx < page_segments) {
-            size_t pkt_len = 0;
-            size_t pkt_start = cur;
-            bool continued = false;
-            do {
-                uint8_t l = page[27 + seg_idx++];
-                pkt_len += l;
-                cur += l;
-                continued = (l == 255);
-            } while (continued && seg_idx < page_segments);
-
-            if (pkt_len == 0) continue;
-            const uint8_t* pkt_ptr = buf + pkt_start;
-
-            if (!seen_head) {
-                // 解析OpusHead包
-                if (pkt_len >= 19 && std::memcmp(pkt_ptr, "OpusHead", 8) == 0) {
-                    seen_head = true;
-                    
-                    // OpusHead结构：[0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip
-                    // [12-15] input_sample_rate, [16-17] output_gain, [18] mapping_family
-                    if (pkt_len >= 12) {
-                        uint8_t version = pkt_ptr[8];
-                        uint8_t channel_count = pkt_ptr[9];
-                        
-                        if (pkt_len >= 16) {
-                            // 读取输入采样率 (little-endian)
-                            sample_rate = pkt_ptr[12] | (pkt_ptr[13] << 8) | 
-                                        (pkt_ptr[14] << 16) | (pkt_ptr[15] << 24);
-                            ESP_LOGI(TAG, "OpusHead: version=%d, channels=%d, sample_rate=%d", 
-                                version, channel_count, sample_rate);
-                        }
-                    }
-                }
-                continue;
-            }
-            if (!seen_tags) {
-                // Expect OpusTags in second packet
-                if (pkt_len >= 8 && std::memcmp(pkt_ptr, "OpusTags", 8) == 0) {
-                    seen_tags = true;
-                }
-                continue;
-            }
+    codec_power_.Prewarm(kCodecPowerOutput);
 
-            // Audio packet (Opus)
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->sample_rate = sample_rate;
-            packet->frame_duration = 60;
-            packet->payload.resize(pkt_len);
-            std::memcpy(packet->payload.data(), pkt_ptr, pkt_len);
-            PushPacketToDecodeQueue(std::move(packet), true);
-            queued_packets++;
+    /* The decode task demuxes the packets lazily, nothing is parsed or copied here */
+    auto sound = std::make_shared<SoundPlayback>(ogg, sound_generation_.load());
+    {
+        std::lock_guard<std::mutex> lock(decode_push_mutex_);
+        if (!sound_queue_.Push(SoundHandle(sound))) {
+            ESP_LOGW(TAG, "Sound queue is full, dropping sound");
+            sound->done_ = true;
+            return sound;
         }
-
-        offset = body_off + body_size;
     }
-
-    ESP_LOGI(TAG, "Queued %u opus packets for playback (sr=%d)", (unsigned int)queued_packets, sample_rate);
+    NotifyTask(opus_decode_task_handle_);
+    return sound;
 }
 
 bool AudioService::IsIdle() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+    return audio_encode_queue_.Empty() && audio_testing_encode_queue_.Empty() && audio_decode_queue_.Empty() &&
+        jitter_buffer_.Empty() && audio_playback_queue_.Empty() && audio_testing_queue_.Empty() &&
+        sound_queue_.Empty() && !sound_playing_ && !mixer_.HasAudio();
 }
 
-void AudioService::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    opus_decoder_->ResetState();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+void AudioService::EndDownlinkStream() {
+    jitter_buffer_.RequestEnd(esp_timer_get_time());
+    NotifyTask(opus_decode_task_handle_);
 }
 
-void AudioService::CheckAndUpdateAudioPowerState() {
-    auto now = std::chrono::steady_clock::now();
-    auto input_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_input_time_).count();
-    auto output_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_output_time_).count();
-    if (input_elapsed > AUDIO_POWER_TIMEOUT_MS && codec_->input_enabled()) {
-        codec_->EnableInput(false);
-    }
-    if (output_elapsed > AUDIO_POWER_TIMEOUT_MS && codec_->output_enabled()) {
-        codec_->EnableOutput(false);
-    }
-    if (!codec_->input_enabled() && !codec_->output_enabled()) {
-        esp_timer_stop(audio_power_timer_);
-    }
+void AudioService::ResetDecoder() {
+    decoder_reset_requested_ = true;
+    /* Sounds requested before this point are dropped, PlaySound() calls after it still play */
+    sound_generation_++;
+    /* Packets queued from now on are kept, everything before is dropped by the consumers */
+    timestamp_queue_.RequestClear();
+    audio_decode_queue_.RequestClear();
+    jitter_buffer_.RequestReset();
+    audio_playback_queue_.RequestClear();
+    mixer_.RequestClear(kAudioOutputVoice);
+    audio_testing_queue_.RequestClear();
+    NotifyTask(audio_output_task_handle_);
+    NotifyTask(opus_decode_task_handle_);
 }
@@ -2,53 +2,106 @@
 #define AUDIO_SERVICE_H
 
 #include <memory>
-#include <deque>
-#include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <string_view>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/event_groups.h>
 #include <esp_timer.h>
 
-#include <opus_encoder.h>
-#include <opus_decoder.h>
-#include <opus_resampler.h>
+#include "polyphase_resampler.h"
 
 #include "audio_codec.h"
 #include "audio_processor.h"
 #include "processors/audio_debugger.h"
 #include "protocol.h"
+#include "spsc_queue.h"
+#include "audio_frame_pool.h"
+#include "jitter_buffer.h"
+#include "opus_stream_decoder.h"
+#include "opus_stream_encoder.h"
+#include "encoder_controller.h"
+#include "uplink_gate.h"
+#include "codec_power_manager.h"
+#include "ogg_demuxer.h"
+#include "sound_cache.h"
+#include "latency_trace.h"
+#include "audio_mixer.h"
 
 
 /*
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
- * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ * 2. (Server) -> {Decode Queue} -> [Jitter Buffer] -> [Opus Decoder] -> {Playback Queue} -> [Mixer] -> (Speaker)
+ *    (Flash)  -> {Sound Queue} -> [Ogg Demuxer -> Opus Decoder | Sound Cache] -> {Playback Queue} -> [Mixer] -> (Speaker)
+ *    (Music / Alarms / Test tone) -> WriteOutput() -> [Mixer] -> (Speaker)
  *
- * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
+ * We use one task for MIC / Speaker / Processors, one task for the Opus Encoder and one for the Opus Decoder.
+ * The two codec tasks are pinned to different cores so a slow encode never delays the next decode.
  * 
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
  * 
+ * Every queue is a bounded SPSC ring owned by exactly one producer and one consumer task.
+ * The producer wakes the consumer with a task notification, so tasks only wake for their own work.
+ * The decode queue has several producers (network, PlaySound, audio testing), they are serialized
+ * by decode_push_mutex_ while the consumer side stays lock-free.
  */
 
+// Frame duration proposed to the server, the negotiated value is set at runtime by SetFrameDuration()
+#if CONFIG_AUDIO_FRAME_DURATION_20MS
+#define OPUS_FRAME_DURATION_MS 20
+#elif CONFIG_AUDIO_FRAME_DURATION_40MS
+#define OPUS_FRAME_DURATION_MS 40
+#else
 #define OPUS_FRAME_DURATION_MS 60
+#endif
+// Buffers and queues are sized for the whole range so a renegotiation never reallocates
+#define OPUS_FRAME_DURATION_MIN_MS 20
+#define OPUS_FRAME_DURATION_MAX_MS 60
 #define MAX_ENCODE_TASKS_IN_QUEUE 2
 #define MAX_PLAYBACK_TASKS_IN_QUEUE 2
 //#define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
 #define MAX_DECODE_PACKETS_IN_QUEUE 150
-#define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+#define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MIN_MS)
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
 #define MAX_TIMESTAMPS_IN_QUEUE 3
+// Processor feed chunks in flight between the input task and the processor output, for latency tracing
+#define MAX_CAPTURE_STAMPS_IN_QUEUE 16
+// PlaySound() calls waiting behind the one that is playing, e.g. an alert plus a 6 digit code
+#define MAX_PENDING_SOUNDS 8
+
+// Core affinity / priority of the codec workers, decoding feeds the speaker so it runs higher
+#define OPUS_DECODE_TASK_CORE 1
+#define OPUS_DECODE_TASK_PRIORITY 3
+#define OPUS_DECODE_TASK_STACK_SIZE (2048 * 6)
+#define OPUS_ENCODE_TASK_CORE 0
+#define OPUS_ENCODE_TASK_PRIORITY 2
+#define OPUS_ENCODE_TASK_STACK_SIZE (2048 * 12)
+
+// Frame objects in flight: encode + testing encode + playback queues, plus one in each task
+#define AUDIO_TASK_POOL_SIZE (MAX_ENCODE_TASKS_IN_QUEUE * 2 + MAX_PLAYBACK_TASKS_IN_QUEUE + 4)
+// Enough packets for steady-state streaming, bursts beyond this fall back to the heap
+#define AUDIO_PACKET_POOL_SIZE 48
+// Payloads up to CONFIG_SPIRAM_MALLOC_ALWAYSINTERNAL stay in internal RAM
+#define AUDIO_PACKET_POOL_PAYLOAD_BYTES 256
 
-#define AUDIO_POWER_TIMEOUT_MS 15000
-#define AUDIO_POWER_CHECK_INTERVAL_MS 1000
+// Mixer ring sizes, in milliseconds at the codec output rate. The voice ring only bridges
+// playback frames to the mixer blocks, so it is kept short to add no latency.
+#define AUDIO_MIXER_VOICE_BUFFER_MS 20
+#define AUDIO_MIXER_MUSIC_BUFFER_MS 100
+#define AUDIO_MIXER_ALERT_BUFFER_MS 100
+// Q15 gains a source is ducked to while a higher priority source plays
+#define AUDIO_MIXER_MUSIC_DUCK_GAIN 4096    // -18 dB under speech and alerts
+#define AUDIO_MIXER_VOICE_DUCK_GAIN 16384   // -6 dB under alerts
 
 
 #define AS_EVENT_AUDIO_TESTING_RUNNING      (1 << 0)
 #define AS_EVENT_AUDIO_PROCESSOR_RUNNING    (1 << 1)
 #define AS_EVENT_PLAYBACK_NOT_EMPTY         (1 << 2)
+#define AS_EVENT_DECODE_QUEUE_SPACE         (1 << 3)
 
 struct AudioServiceCallbacks {
     std::function<void(void)> on_send_queue_available;
@@ -67,13 +120,64 @@ struct AudioTask {
     AudioTaskType type;
     std::vector<int16_t> pcm;
     uint32_t timestamp;
+    bool speech;                // VAD state when the processor emitted the frame
+    latency_trace_t trace;
+};
+
+// Time at which the input task had read samples [0, end_sample) of the current processor run
+struct CaptureStamp {
+    uint32_t end_sample = 0;
+    uint32_t time = 0;
+    uint32_t epoch = 0;
+};
+
+/*
+ * A PlaySound() request. The decode task pulls Opus packets from the demuxer as playback
+ * space frees up, so the caller gets this handle back immediately.
+ */
+class SoundPlayback {
+public:
+    SoundPlayback(std::string_view ogg, uint32_t generation) : source_(ogg), demuxer_(ogg), generation_(generation) {}
+
+    void Cancel() { cancelled_ = true; }
+    bool IsDone() const { return done_; }
+
+private:
+    friend class AudioService;
+    std::string_view source_;
+    OggDemuxer demuxer_;
+    uint32_t generation_;
+    std::atomic<bool> cancelled_{false};
+    std::atomic<bool> done_{false};
+    // Decode task state
+    bool started_ = false;
+    std::shared_ptr<const SoundClip> clip_;     // set on a cache hit
+    size_t clip_offset_ = 0;
+};
+using SoundHandle = std::shared_ptr<SoundPlayback>;
+
+enum SoundFrameType {
+    kSoundFrameNone,
+    kSoundFrameOpus,    // Opus packet pointing into the asset
+    kSoundFramePcm,     // chunk of a cached clip, already at the output rate
 };
 
-struct DebugStatistics {
-    uint32_t input_count = 0;
-    uint32_t decode_count = 0;
-    uint32_t encode_count = 0;
-    uint32_t playback_count = 0;
+// Mixer inputs, in priority order: a source is ducked while a later one plays
+enum AudioOutputSource {
+    kAudioOutputMusic,      // background music (SD card player)
+    kAudioOutputVoice,      // TTS and PlaySound(), fed by the output task from the playback queue
+    kAudioOutputAlert,      // alarms and test tones
+    kAudioOutputSourceCount,
+};
+
+using AudioTaskPtr = FramePool<AudioTask>::Ptr;
+using AudioStreamPacketPtr = FramePool<AudioStreamPacket>::Ptr;
+
+struct CodecTaskStatistics {
+    uint32_t frames = 0;            // frames processed since start
+    uint32_t max_frame_us = 0;      // worst processing time of a single frame in the current window
+    uint64_t busy_us = 0;           // total processing time since start
+    float frames_per_second = 0;    // rate over the last statistics window
 };
 
 class AudioService {
@@ -89,63 +193,165 @@ public:
     bool IsAudioProcessorRunning() const { return xEventGroupGetBits(event_group_) & AS_EVENT_AUDIO_PROCESSOR_RUNNING; }
 
     void EnableVoiceProcessing(bool enable);
-    void SetAfeOutputCallback(std::function<void(std::vector<int16_t>&&)> callback);
+    void SetAfeOutputCallback(std::function<void(const std::vector<int16_t>&)> callback);
     void EnableAudioTesting(bool enable);
     void EnableDeviceAec(bool enable);
+    // Bit mask of AudioDebugTap, needs CONFIG_USE_AUDIO_DEBUGGER
+    void SetAudioDebugTaps(uint32_t mask);
+    // Uplink Opus frame duration (20 / 40 / 60 ms), applied from the next frame the processor emits
+    bool SetFrameDuration(int frame_duration_ms);
+    int frame_duration_ms() const { return frame_duration_ms_; }
+    static bool IsValidFrameDuration(int frame_duration_ms);
 
     void SetCallbacks(AudioServiceCallbacks& callbacks);
     void PlayTestTone(int freq_hz = 1000, int duration_ms = 200);
 
-    bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
-    std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
-    void PlaySound(const std::string_view& sound);
+    // Mono PCM at the codec output rate into a mixer source (not kAudioOutputVoice). Waits up to
+    // `wait` for ring space and returns the number of samples queued. One producer task per source.
+    size_t WriteOutput(AudioOutputSource source, const int16_t* pcm, size_t samples, TickType_t wait = portMAX_DELAY);
+    void ClearOutput(AudioOutputSource source);
+    // Q15, AUDIO_MIXER_UNITY_GAIN is 0 dB
+    void SetOutputGain(AudioOutputSource source, int32_t gain);
+    // Hint that audio is likely within hold_ms, the codec direction is powered up ahead of it
+    void PrewarmCodec(CodecPowerDirection direction, uint32_t hold_ms = AUDIO_POWER_PREWARM_HOLD_MS) {
+        codec_power_.Prewarm(direction, hold_ms);
+    }
+    int output_sample_rate() const { return codec_ ? codec_->output_sample_rate() : 0; }
+
+    AudioStreamPacketPtr AcquirePacket();
+    bool PushPacketToDecodeQueue(AudioStreamPacketPtr packet, bool wait = false);
+    AudioStreamPacketPtr PopPacketFromSendQueue();
+    SoundHandle PlaySound(const std::string_view& sound);
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
+    // The server sent the last packet of the reply, playback stops without concealing a tail
+    void EndDownlinkStream();
+
+    CodecTaskStatistics GetDecodeStatistics() const { return decode_statistics_; }
+    CodecTaskStatistics GetEncodeStatistics() const { return encode_statistics_; }
+    JitterBufferStatistics GetJitterStatistics() const { return jitter_buffer_.GetStatistics(); }
+    SoundCacheStatistics GetSoundCacheStatistics() const { return sound_cache_.GetStatistics(); }
+    AudioMixerStatistics GetMixerStatistics() const { return mixer_.GetStatistics(); }
+    CodecPowerStatistics GetPowerStatistics() const { return codec_power_.GetStatistics(); }
+    void UpdateCodecStatistics();
+
+    const FramePool<AudioTask>& task_pool() const { return task_pool_; }
+    const FramePool<AudioStreamPacket>& packet_pool() const { return packet_pool_; }
 
 private:
     AudioCodec* codec_ = nullptr;
     AudioServiceCallbacks callbacks_;
     std::unique_ptr<AudioProcessor> audio_processor_;
     std::unique_ptr<AudioDebugger> audio_debugger_;
-    std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
-    std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
-    std::function<void(std::vector<int16_t>&&)> afe_output_callback_;
-    OpusResampler input_resampler_;
-    OpusResampler reference_resampler_;
-    OpusResampler output_resampler_;
-    DebugStatistics debug_statistics_;
+    std::unique_ptr<OpusStreamEncoder> opus_encoder_;
+    EncoderController encoder_controller_;
+    UplinkGate uplink_gate_;
+    std::vector<int16_t> preroll_frame_;
+    std::unique_ptr<OpusStreamDecoder> opus_decoder_;
+    // Local sounds get their own decoder and resampler so switching between a sound and
+    // the stream does not recreate either one
+    std::unique_ptr<OpusStreamDecoder> sound_decoder_;
+    std::function<void(const std::vector<int16_t>&)> afe_output_callback_;
+    PolyphaseResampler input_resampler_;
+    PolyphaseResampler reference_resampler_;
+    PolyphaseResampler output_resampler_;
+    PolyphaseResampler sound_resampler_;
+    // Frame duration of the last decoded stream packet, sizes FEC / concealment frames (decode task)
+    int stream_frame_duration_ms_ = OPUS_FRAME_DURATION_MAX_MS;
+    CodecTaskStatistics decode_statistics_;
+    CodecTaskStatistics encode_statistics_;
+    uint32_t last_decode_frames_ = 0;
+    uint32_t last_encode_frames_ = 0;
+    int64_t last_statistics_time_us_ = 0;
+
+    // Declared before the queues so that queued frames are returned before the pools go away
+    FramePool<AudioTask> task_pool_;
+    FramePool<AudioStreamPacket> packet_pool_;
+    // Scratch buffers owned by the decode / encode task respectively
+    std::vector<int16_t> decode_buffer_;
+    std::vector<uint8_t> encode_buffer_;
+    // Owned by the input task: deinterleaved and resampled channels for ReadAudioData
+    std::vector<int16_t> input_scratch_;
+    // Processor feed chunks are read into this buffer and passed on as a span, input task only
+    std::vector<int16_t> capture_buffer_;
+    // Mono audio-testing frame, swapped with the pooled task buffer on every push, input task only
+    std::vector<int16_t> testing_frame_;
+    // Owned by the output task: one DMA-sized block per mixer period
+    std::vector<int16_t> output_block_;
+    AudioMixer mixer_;
 
     EventGroupHandle_t event_group_;
 
     // Audio encode / decode
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
-    TaskHandle_t opus_codec_task_handle_ = nullptr;
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
+    TaskHandle_t opus_decode_task_handle_ = nullptr;
+    TaskHandle_t opus_encode_task_handle_ = nullptr;
+    std::mutex decode_push_mutex_;
+    SpscQueue<AudioStreamPacketPtr, MAX_DECODE_PACKETS_IN_QUEUE> audio_decode_queue_;
+    // Owned by the decode task, fed from audio_decode_queue_
+    JitterBuffer jitter_buffer_;
+    SpscQueue<AudioStreamPacketPtr, MAX_SEND_PACKETS_IN_QUEUE> audio_send_queue_;
+    // Pushed by the encode task, consumed by the decode task when EnableAudioTesting(false) asks for playback.
+    // The recording stays here and is moved into the jitter buffer as it frees up, so no frame is cut off
+    SpscQueue<AudioStreamPacketPtr, AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MIN_MS> audio_testing_queue_;
+    std::atomic<bool> audio_testing_playback_requested_{false};
+    bool audio_testing_playing_ = false;    // decode task only: feed from audio_testing_queue_ instead of the decode queue
+    // ResetDecoder() runs on the caller's task, the decoder itself is only touched by the decode task
+    std::atomic<bool> decoder_reset_requested_{false};
+    SpscQueue<AudioTaskPtr, MAX_ENCODE_TASKS_IN_QUEUE> audio_encode_queue_;
+    SpscQueue<AudioTaskPtr, MAX_ENCODE_TASKS_IN_QUEUE> audio_testing_encode_queue_;
+    SpscQueue<AudioTaskPtr, MAX_PLAYBACK_TASKS_IN_QUEUE> audio_playback_queue_;
+    // Owned by the output task: the playback frame being copied into the voice source
+    AudioTaskPtr voice_task_;
+    size_t voice_task_offset_ = 0;
+    uint32_t voice_task_generation_ = 0;
     // For server AEC
-    std::deque<uint32_t> timestamp_queue_;
+    SpscQueue<uint32_t, MAX_TIMESTAMPS_IN_QUEUE> timestamp_queue_;
+    // Latency tracing: the input task stamps every processor feed, the processor output maps frames back to them
+    SpscQueue<CaptureStamp, MAX_CAPTURE_STAMPS_IN_QUEUE> capture_stamps_;
+    uint32_t captured_samples_ = 0;
+    uint32_t capture_epoch_ = 0;
+    uint32_t processed_samples_ = 0;
+    CaptureStamp last_capture_stamp_;
+    // PlaySound() requests, producers serialized by decode_push_mutex_; current_sound_ is owned by the decode task
+    SpscQueue<SoundHandle, MAX_PENDING_SOUNDS> sound_queue_;
+    SoundHandle current_sound_;
+    // ResetDecoder() bumps this, sounds queued under an older generation are dropped
+    std::atomic<uint32_t> sound_generation_{0};
+    volatile bool sound_playing_ = false;
+    // Decoded system sounds, plus the PCM of the sound being decoded on a miss
+    SoundCache sound_cache_;
+    std::vector<int16_t> sound_capture_;
+    bool sound_capturing_ = false;
 
     bool audio_processor_initialized_ = false;
     bool voice_detected_ = false;
-    bool service_stopped_ = true;
-    bool audio_input_need_warmup_ = false;
+    volatile bool service_stopped_ = true;
+    // Set while the output task waits on an empty playback queue
+    volatile bool audio_output_waiting_ = false;
+    // Set when the processor starts, the input task restarts its capture sample count
+    volatile bool audio_input_restarted_ = false;
+    std::atomic<int> frame_duration_ms_{OPUS_FRAME_DURATION_MS};
 
-    esp_timer_handle_t audio_power_timer_ = nullptr;
-    std::chrono::steady_clock::time_point last_input_time_;
-    std::chrono::steady_clock::time_point last_output_time_;
+    CodecPowerManager codec_power_;
 
     void AudioInputTask();
     void AudioOutputTask();
-    void OpusCodecTask();
-    void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
-    void SetDecodeSampleRate(int sample_rate, int frame_duration);
-    void CheckAndUpdateAudioPowerState();
+    void OpusDecodeTask();
+    void OpusEncodeTask();
+    void ApplyEncoderSettings();
+    void SendUplinkPreroll(size_t frame_samples);
+    bool EncodeUplinkFrame(const std::vector<int16_t>& pcm, latency_trace_t* trace);
+    void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm, uint32_t capture_time = 0);
+    uint32_t CaptureTimeOf(size_t samples);
+    void SetDecodeSampleRate(std::unique_ptr<OpusStreamDecoder>& decoder, PolyphaseResampler& resampler, int sample_rate);
+    int16_t* ReserveInputScratch(size_t samples);
+    void PlayAudioTestingQueue();
+    SoundFrameType NextSoundFrame(const uint8_t*& packet, size_t& size, const int16_t*& pcm, size_t& samples);
+    void FeedVoiceSource();
+    static void NotifyTask(TaskHandle_t task);
+    static void RecordFrameTime(CodecTaskStatistics& statistics, int64_t elapsed_us);
 };
 
 #endif
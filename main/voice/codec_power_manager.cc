@@ -0,0 +1,215 @@
+#include "codec_power_manager.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include "metrics.h"
+
+#define TAG "CodecPower"
+
+static const char* const kDirectionNames[kCodecPowerDirectionCount] = { "input", "output" };
+
+METRICS_COUNTER(metric_input_on_ms, "audio.power_input_on_ms");
+METRICS_COUNTER(metric_output_on_ms, "audio.power_output_on_ms");
+METRICS_COUNTER(metric_input_stalls, "audio.power_input_stalls");
+METRICS_COUNTER(metric_output_stalls, "audio.power_output_stalls");
+static metric_t* const kOnMsMetrics[kCodecPowerDirectionCount] = { &metric_input_on_ms, &metric_output_on_ms };
+static metric_t* const kStallMetrics[kCodecPowerDirectionCount] = { &metric_input_stalls, &metric_output_stalls };
+
+static inline bool TimeBefore(uint32_t a, uint32_t b) {
+    return static_cast<int32_t>(a - b) < 0;
+}
+
+CodecPowerManager::CodecPowerManager() {
+    ready_bits_ = xEventGroupCreate();
+}
+
+CodecPowerManager::~CodecPowerManager() {
+    Stop();
+    if (ready_bits_ != nullptr) {
+        vEventGroupDelete(ready_bits_);
+    }
+}
+
+uint32_t CodecPowerManager::NowMs() {
+    return static_cast<uint32_t>(esp_timer_get_time() / 1000);
+}
+
+void CodecPowerManager::Start(AudioCodec* codec) {
+    if (task_handle_ != nullptr) {
+        return;
+    }
+    codec_ = codec;
+    for (int i = 0; i < kCodecPowerDirectionCount; i++) {
+        metrics_register(kOnMsMetrics[i]);
+        metrics_register(kStallMetrics[i]);
+    }
+    uint32_t now = NowMs();
+    for (int i = 0; i < kCodecPowerDirectionCount; i++) {
+        auto direction = static_cast<CodecPowerDirection>(i);
+        bool enabled = direction == kCodecPowerInput ? codec_->input_enabled() : codec_->output_enabled();
+        // Whatever the board left enabled counts as warm and idles out like any other use
+        last_active_ms_[i] = now;
+        state_since_ms_[i] = now;
+        state_[i] = kCodecPowerOff;
+        if (enabled) {
+            SetState(direction, kCodecPowerOn, now);
+        }
+    }
+
+    running_ = true;
+    xTaskCreate([](void* arg) {
+        auto manager = (CodecPowerManager*)arg;
+        manager->Task();
+        vTaskDelete(NULL);
+    }, "codec_power", AUDIO_POWER_TASK_STACK_SIZE, this, AUDIO_POWER_TASK_PRIORITY, &task_handle_);
+}
+
+void CodecPowerManager::Stop() {
+    if (task_handle_ == nullptr) {
+        return;
+    }
+    running_ = false;
+    xTaskNotifyGive(task_handle_);
+    // The task clears the handle on its way out
+    while (task_handle_ != nullptr) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void CodecPowerManager::Prewarm(CodecPowerDirection direction, uint32_t hold_ms) {
+    uint32_t until = NowMs() + hold_ms;
+    uint32_t current = hold_until_ms_[direction].load(std::memory_order_relaxed);
+    while (TimeBefore(current, until) &&
+        !hold_until_ms_[direction].compare_exchange_weak(current, until, std::memory_order_relaxed)) {
+    }
+    // An open direction picks the new hold up on its next check, only a closed one needs the task now
+    if (state(direction) == kCodecPowerOff && task_handle_ != nullptr) {
+        xTaskNotifyGive(task_handle_);
+    }
+}
+
+void CodecPowerManager::MarkActive(CodecPowerDirection direction) {
+    last_active_ms_[direction].store(NowMs(), std::memory_order_relaxed);
+}
+
+bool CodecPowerManager::WaitReady(CodecPowerDirection direction, TickType_t wait) {
+    EventBits_t bit = 1 << direction;
+    if (xEventGroupGetBits(ready_bits_) & bit) {
+        return true;
+    }
+    stalls_[direction].fetch_add(1, std::memory_order_relaxed);
+    metrics_counter_add(kStallMetrics[direction], 1);
+    Prewarm(direction);
+    return (xEventGroupWaitBits(ready_bits_, bit, pdFALSE, pdTRUE, wait) & bit) != 0;
+}
+
+void CodecPowerManager::EnableCodec(CodecPowerDirection direction, bool enable) {
+    if (direction == kCodecPowerInput) {
+        codec_->EnableInput(enable);
+    } else {
+        codec_->EnableOutput(enable);
+    }
+}
+
+void CodecPowerManager::SetState(CodecPowerDirection direction, CodecPowerState state, uint32_t now) {
+    {
+        std::lock_guard<std::mutex> lock(statistics_mutex_);
+        CodecPowerState previous = state_[direction].load(std::memory_order_relaxed);
+        if (previous == kCodecPowerOn) {
+            AccrueOnTime(direction, now);
+        }
+        on_since_ms_[direction] = now;
+        state_ms_[direction][previous] += now - state_since_ms_[direction];
+        state_since_ms_[direction] = now;
+        if (state == kCodecPowerWarming) {
+            power_ups_[direction]++;
+        }
+    }
+    state_[direction].store(state, std::memory_order_relaxed);
+    if (state == kCodecPowerOn) {
+        xEventGroupSetBits(ready_bits_, 1 << direction);
+    } else {
+        xEventGroupClearBits(ready_bits_, 1 << direction);
+    }
+}
+
+uint32_t CodecPowerManager::Update(CodecPowerDirection direction, uint32_t now) {
+    uint32_t hold_until = hold_until_ms_[direction].load(std::memory_order_relaxed);
+    uint32_t last_active = last_active_ms_[direction].load(std::memory_order_relaxed);
+    uint32_t warmup_ms = direction == kCodecPowerInput ? AUDIO_INPUT_WARMUP_MS : AUDIO_OUTPUT_WARMUP_MS;
+
+    switch (state(direction)) {
+    case kCodecPowerOff:
+        if (!TimeBefore(hold_until, now)) {
+            EnableCodec(direction, true);
+            // The open itself may take a while, the warm-up counts from when it returned
+            now = NowMs();
+            warm_start_ms_[direction] = now;
+            SetState(direction, kCodecPowerWarming, now);
+            ESP_LOGI(TAG, "Powering up %s", kDirectionNames[direction]);
+            return Update(direction, now);
+        }
+        break;
+    case kCodecPowerWarming:
+        if (now - warm_start_ms_[direction] >= warmup_ms) {
+            // Idle time is counted from the moment the direction became usable
+            last_active_ms_[direction].store(now, std::memory_order_relaxed);
+            SetState(direction, kCodecPowerOn, now);
+            break;
+        }
+        return warmup_ms - (now - warm_start_ms_[direction]);
+    case kCodecPowerOn:
+        // Counted as it passes, not only at power-down, so the counter also moves while the codec stays on
+        AccrueOnTime(direction, now);
+        if (now - last_active >= AUDIO_POWER_TIMEOUT_MS && TimeBefore(hold_until, now)) {
+            SetState(direction, kCodecPowerOff, now);
+            EnableCodec(direction, false);
+            ESP_LOGI(TAG, "Powering down %s", kDirectionNames[direction]);
+        }
+        break;
+    default:
+        break;
+    }
+    return AUDIO_POWER_CHECK_INTERVAL_MS;
+}
+
+void CodecPowerManager::AccrueOnTime(CodecPowerDirection direction, uint32_t now) {
+    metrics_counter_add(kOnMsMetrics[direction], now - on_since_ms_[direction]);
+    on_since_ms_[direction] = now;
+}
+
+void CodecPowerManager::Task() {
+    uint32_t wait_ms = AUDIO_POWER_CHECK_INTERVAL_MS;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, std::max<TickType_t>(1, pdMS_TO_TICKS(wait_ms)));
+        if (!running_) {
+            break;
+        }
+        uint32_t now = NowMs();
+        wait_ms = AUDIO_POWER_CHECK_INTERVAL_MS;
+        for (int i = 0; i < kCodecPowerDirectionCount; i++) {
+            wait_ms = std::min(wait_ms, Update(static_cast<CodecPowerDirection>(i), now));
+        }
+    }
+    task_handle_ = nullptr;
+}
+
+CodecPowerStatistics CodecPowerManager::GetStatistics() const {
+    CodecPowerStatistics statistics;
+    uint32_t now = NowMs();
+    std::lock_guard<std::mutex> lock(statistics_mutex_);
+    for (int i = 0; i < kCodecPowerDirectionCount; i++) {
+        CodecPowerState current = state_[i].load(std::memory_order_relaxed);
+        for (int s = 0; s < kCodecPowerStateCount; s++) {
+            uint64_t ms = state_ms_[i][s];
+            if (s == current) {
+                ms += now - state_since_ms_[i];
+            }
+            statistics.seconds[i][s] = ms / 1000;
+        }
+        statistics.power_ups[i] = power_ups_[i];
+        statistics.stalls[i] = stalls_[i].load(std::memory_order_relaxed);
+    }
+    return statistics;
+}
@@ -0,0 +1,106 @@
+#ifndef CODEC_POWER_MANAGER_H
+#define CODEC_POWER_MANAGER_H
+
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+
+#include "audio_codec.h"
+
+/*
+ * Power state of the codec input (ADC) and output (DAC), one state machine per direction:
+ *
+ *   Off --(hint or demand)--> Warming --(warm-up time)--> On --(idle and no hint)--> Off
+ *
+ * Opening and closing the codec takes I2C transfers and, for the input, a settling time, so
+ * it is done by a low-priority task and never by the audio tasks. The audio tasks only call
+ * WaitReady(), which returns at once when the direction was pre-warmed, and MarkActive().
+ *
+ * Prewarm() is the hint: "audio is likely within hold_ms, keep the direction powered until
+ * then". It is cheap enough to call per packet and never blocks. Time spent in each state is
+ * accumulated so the hold and timeout values can be tuned against the power they cost.
+ */
+
+enum CodecPowerDirection {
+    kCodecPowerInput,
+    kCodecPowerOutput,
+    kCodecPowerDirectionCount,
+};
+
+enum CodecPowerState {
+    kCodecPowerOff,
+    kCodecPowerWarming,
+    kCodecPowerOn,
+    kCodecPowerStateCount,
+};
+
+// A direction nobody used or hinted for this long is powered down
+#define AUDIO_POWER_TIMEOUT_MS 15000
+#define AUDIO_POWER_CHECK_INTERVAL_MS 1000
+// The ADC output is not usable right after it is opened
+#define AUDIO_INPUT_WARMUP_MS 120
+#define AUDIO_OUTPUT_WARMUP_MS 0
+// Default hold of a hint, and the hold of hints that predict a reply (VAD, downlink audio)
+#define AUDIO_POWER_PREWARM_HOLD_MS 5000
+#define AUDIO_POWER_REPLY_HOLD_MS 10000
+#define AUDIO_POWER_TASK_PRIORITY 3
+#define AUDIO_POWER_TASK_STACK_SIZE 4096
+
+struct CodecPowerStatistics {
+    uint32_t seconds[kCodecPowerDirectionCount][kCodecPowerStateCount] = {};  // time in state
+    uint32_t power_ups[kCodecPowerDirectionCount] = {};
+    uint32_t stalls[kCodecPowerDirectionCount] = {};   // WaitReady() calls that had to wait
+};
+
+class CodecPowerManager {
+public:
+    CodecPowerManager();
+    ~CodecPowerManager();
+
+    void Start(AudioCodec* codec);
+    void Stop();
+
+    // Any task, never blocks
+    void Prewarm(CodecPowerDirection direction, uint32_t hold_ms = AUDIO_POWER_PREWARM_HOLD_MS);
+    // From the task that uses the direction, resets its idle timeout
+    void MarkActive(CodecPowerDirection direction);
+    // Asks for the direction and waits until it is on, false on timeout
+    bool WaitReady(CodecPowerDirection direction, TickType_t wait);
+
+    CodecPowerState state(CodecPowerDirection direction) const { return state_[direction].load(std::memory_order_relaxed); }
+    CodecPowerStatistics GetStatistics() const;
+
+private:
+    AudioCodec* codec_ = nullptr;
+    EventGroupHandle_t ready_bits_;
+    TaskHandle_t task_handle_ = nullptr;
+    std::atomic<bool> running_{false};
+
+    // Milliseconds of esp_timer, compared as signed differences so they may wrap
+    std::atomic<uint32_t> hold_until_ms_[kCodecPowerDirectionCount] = {};
+    std::atomic<uint32_t> last_active_ms_[kCodecPowerDirectionCount] = {};
+    std::atomic<CodecPowerState> state_[kCodecPowerDirectionCount] = {};
+    std::atomic<uint32_t> stalls_[kCodecPowerDirectionCount] = {};
+
+    // Owned by the power task, read under statistics_mutex_
+    mutable std::mutex statistics_mutex_;
+    uint32_t state_since_ms_[kCodecPowerDirectionCount] = {};
+    uint32_t warm_start_ms_[kCodecPowerDirectionCount] = {};
+    uint64_t state_ms_[kCodecPowerDirectionCount][kCodecPowerStateCount] = {};
+    uint32_t power_ups_[kCodecPowerDirectionCount] = {};
+    uint32_t on_since_ms_[kCodecPowerDirectionCount] = {};   // on time up to here is in the metrics
+
+    static uint32_t NowMs();
+    void Task();
+    // Returns the time until the direction needs another look
+    uint32_t Update(CodecPowerDirection direction, uint32_t now);
+    void SetState(CodecPowerDirection direction, CodecPowerState state, uint32_t now);
+    void AccrueOnTime(CodecPowerDirection direction, uint32_t now);
+    void EnableCodec(CodecPowerDirection direction, bool enable);
+};
+
+#endif // CODEC_POWER_MANAGER_H
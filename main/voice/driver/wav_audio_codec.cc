@@ -0,0 +1,284 @@
+#include "wav_audio_codec.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "WavAudioCodec"
+
+// Real-time clock: a stream that fell further behind than this was paused, not late
+#define WAV_CODEC_MAX_LAG_MS 100
+// Input frames read from a file per fread()
+#define WAV_CODEC_FILE_CHUNK_FRAMES 480
+
+struct WavChunkHeader {
+    char id[4];
+    uint32_t size;
+};
+
+struct WavFormat {
+    uint16_t format;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+};
+
+static void WriteWavHeader(FILE* file, int sample_rate, uint32_t data_bytes) {
+    uint8_t header[44];
+    WavFormat format = { 1, 1, static_cast<uint32_t>(sample_rate), static_cast<uint32_t>(sample_rate) * 2, 2, 16 };
+    uint32_t riff_size = 36 + data_bytes;
+    uint32_t format_size = sizeof(WavFormat);
+    memcpy(header, "RIFF", 4);
+    memcpy(header + 4, &riff_size, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    memcpy(header + 16, &format_size, 4);
+    memcpy(header + 20, &format, sizeof(WavFormat));
+    memcpy(header + 36, "data", 4);
+    memcpy(header + 40, &data_bytes, 4);
+    fseek(file, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), file);
+}
+
+WavAudioCodec::WavAudioCodec(int input_sample_rate, int output_sample_rate, WavCodecClock clock)
+    : clock_(clock) {
+    duplex_ = true;
+    input_reference_ = false;
+    input_channels_ = 1;
+    output_channels_ = 1;
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    ESP_LOGI(TAG, "Virtual codec %d Hz in, %d Hz out, %s clock", input_sample_rate, output_sample_rate,
+        clock == kWavCodecRealTime ? "real-time" : "free-running");
+}
+
+WavAudioCodec::~WavAudioCodec() {
+    CloseInput();
+    CloseOutput();
+}
+
+bool WavAudioCodec::OpenInput(const char* path, bool loop) {
+    CloseInput();
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return false;
+    }
+
+    char riff[12];
+    WavFormat format = {};
+    bool have_format = false;
+    if (fread(riff, 1, sizeof(riff), file) != sizeof(riff) || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        ESP_LOGE(TAG, "%s is not a WAV file", path);
+        fclose(file);
+        return false;
+    }
+    WavChunkHeader chunk;
+    while (fread(&chunk, 1, sizeof(chunk), file) == sizeof(chunk)) {
+        if (memcmp(chunk.id, "fmt ", 4) == 0) {
+            if (chunk.size < sizeof(WavFormat) || fread(&format, 1, sizeof(format), file) != sizeof(format)) {
+                break;
+            }
+            have_format = true;
+            fseek(file, chunk.size - sizeof(WavFormat) + (chunk.size & 1), SEEK_CUR);
+        } else if (memcmp(chunk.id, "data", 4) == 0) {
+            if (!have_format || format.format != 1 || format.bits_per_sample != 16 || format.channels == 0) {
+                ESP_LOGE(TAG, "%s: only 16-bit PCM is supported", path);
+                break;
+            }
+            if (static_cast<int>(format.sample_rate) != input_sample_rate_) {
+                ESP_LOGE(TAG, "%s: %lu Hz, the codec input runs at %d Hz", path,
+                    (unsigned long)format.sample_rate, input_sample_rate_);
+                break;
+            }
+            std::lock_guard<std::mutex> lock(input_mutex_);
+            input_file_ = file;
+            input_data_offset_ = ftell(file);
+            // Streamed WAV files leave the size at 0 or 0xFFFFFFFF
+            input_data_bytes_ = chunk.size == 0xFFFFFFFF ? 0 : chunk.size;
+            input_data_read_ = 0;
+            input_file_channels_ = format.channels;
+            input_file_buffer_.resize(WAV_CODEC_FILE_CHUNK_FRAMES * format.channels);
+            input_loop_ = loop;
+            input_finished_ = false;
+            ESP_LOGI(TAG, "Input %s: %u channels, %lu bytes", path, format.channels, (unsigned long)input_data_bytes_);
+            return true;
+        } else {
+            fseek(file, chunk.size + (chunk.size & 1), SEEK_CUR);
+        }
+    }
+    ESP_LOGE(TAG, "%s: no usable data chunk", path);
+    fclose(file);
+    return false;
+}
+
+void WavAudioCodec::SetInput(const int16_t* pcm, size_t samples, bool loop) {
+    CloseInput();
+    std::lock_guard<std::mutex> lock(input_mutex_);
+    input_pcm_ = pcm;
+    input_pcm_samples_ = samples;
+    input_pcm_position_ = 0;
+    input_loop_ = loop;
+    input_finished_ = pcm == nullptr || samples == 0;
+}
+
+void WavAudioCodec::CloseInput() {
+    std::lock_guard<std::mutex> lock(input_mutex_);
+    if (input_file_ != nullptr) {
+        fclose(input_file_);
+        input_file_ = nullptr;
+    }
+    std::vector<int16_t>().swap(input_file_buffer_);
+    input_pcm_ = nullptr;
+    input_pcm_samples_ = 0;
+    input_finished_ = true;
+}
+
+bool WavAudioCodec::input_finished() const {
+    std::lock_guard<std::mutex> lock(input_mutex_);
+    return input_finished_;
+}
+
+bool WavAudioCodec::OpenOutput(const char* path) {
+    CloseOutput();
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        ESP_LOGE(TAG, "Failed to create %s", path);
+        return false;
+    }
+    WriteWavHeader(file, output_sample_rate_, 0);
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    output_file_ = file;
+    output_file_bytes_ = 0;
+    return true;
+}
+
+void WavAudioCodec::CaptureOutput(size_t max_samples) {
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    output_capture_limit_ = max_samples;
+    output_capture_.clear();
+    output_capture_.reserve(max_samples);
+}
+
+void WavAudioCodec::CloseOutput() {
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    if (output_file_ != nullptr) {
+        WriteWavHeader(output_file_, output_sample_rate_, output_file_bytes_);
+        fclose(output_file_);
+        output_file_ = nullptr;
+    }
+    output_capture_limit_ = 0;
+}
+
+void WavAudioCodec::TakeCapturedOutput(std::vector<int16_t>& pcm) {
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    pcm.swap(output_capture_);
+    output_capture_.clear();
+}
+
+size_t WavAudioCodec::ReadFile(int16_t* dest, size_t samples) {
+    size_t done = 0;
+    const int channels = input_file_channels_;
+    const uint32_t frame_bytes = channels * sizeof(int16_t);
+    while (done < samples) {
+        size_t frames = std::min(samples - done, static_cast<size_t>(WAV_CODEC_FILE_CHUNK_FRAMES));
+        if (input_data_bytes_ != 0) {
+            frames = std::min(frames, static_cast<size_t>((input_data_bytes_ - input_data_read_) / frame_bytes));
+        }
+        size_t got = frames > 0 ? fread(input_file_buffer_.data(), frame_bytes, frames, input_file_) : 0;
+        if (got == 0) {
+            if (!input_loop_ || input_data_read_ == 0) {
+                input_finished_ = true;
+                break;
+            }
+            fseek(input_file_, input_data_offset_, SEEK_SET);
+            input_data_read_ = 0;
+            continue;
+        }
+        input_data_read_ += got * frame_bytes;
+
+        const int16_t* frame = input_file_buffer_.data();
+        for (size_t i = 0; i < got; i++, frame += channels) {
+            int32_t sum = 0;
+            for (int c = 0; c < channels; c++) {
+                sum += frame[c];
+            }
+            dest[done + i] = static_cast<int16_t>(sum / channels);
+        }
+        done += got;
+    }
+    return done;
+}
+
+size_t WavAudioCodec::ReadBuffer(int16_t* dest, size_t samples) {
+    size_t done = 0;
+    while (done < samples) {
+        if (input_pcm_position_ == input_pcm_samples_) {
+            if (!input_loop_) {
+                input_finished_ = true;
+                break;
+            }
+            input_pcm_position_ = 0;
+        }
+        size_t n = std::min(samples - done, input_pcm_samples_ - input_pcm_position_);
+        memcpy(dest + done, input_pcm_ + input_pcm_position_, n * sizeof(int16_t));
+        input_pcm_position_ += n;
+        done += n;
+    }
+    return done;
+}
+
+/*
+ * Blocks until the sample at due_sample is due. A stream whose previous call (start_sample)
+ * is more than WAV_CODEC_MAX_LAG_MS late was paused, its clock restarts from now.
+ */
+void WavAudioCodec::Pace(int64_t& epoch_us, uint64_t start_sample, int64_t due_sample, int sample_rate) {
+    if (clock_ != kWavCodecRealTime || sample_rate <= 0) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    int64_t start_us = static_cast<int64_t>(start_sample) * 1000000 / sample_rate;
+    if (epoch_us == 0 || now - (epoch_us + start_us) > WAV_CODEC_MAX_LAG_MS * 1000) {
+        epoch_us = now - start_us;
+    }
+    int64_t wait_us = epoch_us + due_sample * 1000000 / sample_rate - now;
+    if (wait_us >= 1000) {
+        vTaskDelay(std::max<TickType_t>(1, pdMS_TO_TICKS(wait_us / 1000)));
+    }
+}
+
+int WavAudioCodec::Read(int16_t* dest, int samples) {
+    if (input_enabled_) {
+        std::lock_guard<std::mutex> lock(input_mutex_);
+        size_t done = 0;
+        if (!input_finished_) {
+            done = input_file_ != nullptr ? ReadFile(dest, samples) : ReadBuffer(dest, samples);
+        }
+        memset(dest + done, 0, (samples - done) * sizeof(int16_t));
+    }
+    // Like the I2S DMA, a read returns once its last sample has been captured
+    Pace(input_epoch_us_, input_samples_, input_samples_ + samples, input_sample_rate_);
+    input_samples_ += samples;
+    return samples;
+}
+
+int WavAudioCodec::Write(const int16_t* data, int samples) {
+    if (output_enabled_ && data != nullptr) {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        if (output_file_ != nullptr && fwrite(data, sizeof(int16_t), samples, output_file_) == static_cast<size_t>(samples)) {
+            output_file_bytes_ += samples * sizeof(int16_t);
+        }
+        if (output_capture_.size() < output_capture_limit_) {
+            size_t n = std::min(static_cast<size_t>(samples), output_capture_limit_ - output_capture_.size());
+            output_capture_.insert(output_capture_.end(), data, data + n);
+        }
+    }
+    // A write only blocks once the DMA descriptors are full
+    const int64_t dma_samples = AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM;
+    Pace(output_epoch_us_, output_samples_, static_cast<int64_t>(output_samples_) - dma_samples, output_sample_rate_);
+    output_samples_ += samples;
+    return samples;
+}
@@ -0,0 +1,86 @@
+#ifndef _WAV_AUDIO_CODEC_H
+#define _WAV_AUDIO_CODEC_H
+
+#include "audio_codec.h"
+
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+/*
+ * Virtual codec without any hardware: the microphone is a WAV file or a PCM buffer, the
+ * speaker a WAV file, a PCM capture buffer or nothing.
+ *
+ * With kWavCodecRealTime, Read() and Write() block like the I2S DMA would, so the audio
+ * tasks run at the real frame rate and latencies can be measured. With kWavCodecFreeRunning
+ * they return at once and the pipeline runs as fast as the CPU allows, for throughput
+ * (frames per second) runs. Files are opened with stdio, so anything mounted in the VFS
+ * (SD card, SPIFFS) works on the device.
+ *
+ * Input is mono 16-bit PCM at input_sample_rate; multi-channel WAV files are averaged down
+ * to mono, other sample formats and rates are rejected. There is no reference channel.
+ */
+
+enum WavCodecClock {
+    kWavCodecRealTime,
+    kWavCodecFreeRunning,
+};
+
+class WavAudioCodec : public AudioCodec {
+public:
+    WavAudioCodec(int input_sample_rate, int output_sample_rate, WavCodecClock clock = kWavCodecRealTime);
+    virtual ~WavAudioCodec();
+
+    // Input source, replaces the previous one. Silence is read once it ends, unless loop is set
+    bool OpenInput(const char* path, bool loop = false);
+    // The buffer must stay valid until the input is replaced or closed
+    void SetInput(const int16_t* pcm, size_t samples, bool loop = false);
+    void CloseInput();
+
+    // Output sink, replaces the previous one. The WAV header is completed by CloseOutput()
+    bool OpenOutput(const char* path);
+    // Keeps up to max_samples of output in memory, see TakeCapturedOutput()
+    void CaptureOutput(size_t max_samples);
+    void CloseOutput();
+    void TakeCapturedOutput(std::vector<int16_t>& pcm);
+
+    bool input_finished() const;
+    uint64_t input_samples() const { return input_samples_; }
+    uint64_t output_samples() const { return output_samples_; }
+
+private:
+    WavCodecClock clock_;
+    mutable std::mutex input_mutex_;
+    std::mutex output_mutex_;
+
+    FILE* input_file_ = nullptr;
+    long input_data_offset_ = 0;
+    uint32_t input_data_bytes_ = 0;     // 0: up to the end of the file
+    uint32_t input_data_read_ = 0;
+    int input_file_channels_ = 1;
+    std::vector<int16_t> input_file_buffer_;
+    const int16_t* input_pcm_ = nullptr;
+    size_t input_pcm_samples_ = 0;
+    size_t input_pcm_position_ = 0;
+    bool input_loop_ = false;
+    bool input_finished_ = true;
+
+    FILE* output_file_ = nullptr;
+    uint32_t output_file_bytes_ = 0;
+    std::vector<int16_t> output_capture_;
+    size_t output_capture_limit_ = 0;
+
+    uint64_t input_samples_ = 0;
+    uint64_t output_samples_ = 0;
+    int64_t input_epoch_us_ = 0;
+    int64_t output_epoch_us_ = 0;
+
+    size_t ReadFile(int16_t* dest, size_t samples);
+    size_t ReadBuffer(int16_t* dest, size_t samples);
+    void Pace(int64_t& epoch_us, uint64_t start_sample, int64_t due_sample, int sample_rate);
+
+    virtual int Read(int16_t* dest, int samples) override;
+    virtual int Write(const int16_t* data, int samples) override;
+};
+
+#endif // _WAV_AUDIO_CODEC_H
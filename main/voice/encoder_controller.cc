@@ -0,0 +1,106 @@
+#include "encoder_controller.h"
+
+#include <esp_log.h>
+
+#define TAG "EncoderController"
+
+static const int kBitrateLadder[] = { 8000, 12000, 16000, 20000, 24000 };
+static const int kLadderSize = sizeof(kBitrateLadder) / sizeof(kBitrateLadder[0]);
+// 16 kbps, plenty for wideband speech at the default complexity
+static const int kStartLevel = 2;
+
+EncoderController::EncoderController() {
+    SetLevel(kStartLevel);
+}
+
+void EncoderController::Reset() {
+    SetLevel(kStartLevel);
+    have_totals_ = false;
+    clear_ms_ = 0;
+    hold_ms_ = 0;
+}
+
+void EncoderController::SetLevel(int level) {
+    level_ = level;
+    settings_.bitrate = kBitrateLadder[level];
+    settings_.dtx = level < kLadderSize - 1;
+}
+
+bool EncoderController::Update(const EncoderLinkState& link, int64_t encode_us, int frame_duration_ms) {
+    if (frame_duration_ms <= 0) {
+        return false;
+    }
+    const uint32_t frame_ms = frame_duration_ms;
+    int level = level_;
+    int complexity = settings_.complexity;
+
+    /* Link: the totals only matter as deltas, the first call just takes a baseline */
+    bool lost = false;
+    if (have_totals_) {
+        lost = link.send_failures != last_send_failures_ || link.dropped != last_dropped_;
+    }
+    last_send_failures_ = link.send_failures;
+    last_dropped_ = link.dropped;
+    have_totals_ = true;
+
+    hold_ms_ = hold_ms_ > frame_ms ? hold_ms_ - frame_ms : 0;
+    if (link.queued_ms >= ENCODER_SEVERE_QUEUE_MS) {
+        level = 0;
+        clear_ms_ = 0;
+    } else if (link.queued_ms >= ENCODER_CONGESTED_QUEUE_MS || lost) {
+        clear_ms_ = 0;
+        if (hold_ms_ == 0 && level > 0) {
+            level--;
+            hold_ms_ = ENCODER_STEP_DOWN_HOLD_MS;
+        }
+    } else if (link.queued_ms < ENCODER_CLEAR_QUEUE_MS) {
+        clear_ms_ += frame_ms;
+        if (clear_ms_ >= ENCODER_STEP_UP_AFTER_MS && level < kLadderSize - 1) {
+            level++;
+            clear_ms_ = 0;
+        }
+    } else {
+        // Between clear and congested: hold the current rung
+        clear_ms_ = 0;
+    }
+
+    /* CPU: fast attack, slow release, same as the link */
+    uint32_t load = encode_us > 0 ? static_cast<uint32_t>(encode_us / frame_ms) : 0;
+    if (load_permille_ == 0) {
+        load_permille_ = load;
+    } else {
+        load_permille_ = load_permille_ + ((static_cast<int32_t>(load) - static_cast<int32_t>(load_permille_)) >> ENCODER_LOAD_SHIFT);
+    }
+    uint32_t averaged_load = load_permille_;
+    if (load_permille_ > ENCODER_LOAD_HIGH_PERMILLE) {
+        idle_ms_ = 0;
+        if (complexity > 0) {
+            complexity--;
+            // The estimate still holds the frames of the old complexity, start over
+            load_permille_ = 0;
+        }
+    } else if (load_permille_ < ENCODER_LOAD_LOW_PERMILLE) {
+        idle_ms_ += frame_ms;
+        if (idle_ms_ >= ENCODER_STEP_UP_AFTER_MS && complexity < ENCODER_MAX_COMPLEXITY) {
+            complexity++;
+            idle_ms_ = 0;
+        }
+    } else {
+        idle_ms_ = 0;
+    }
+
+    if (level == level_ && complexity == settings_.complexity) {
+        return false;
+    }
+    if (level != level_) {
+        ESP_LOGI(TAG, "Bitrate %d -> %d bps (queue %lu ms%s)", settings_.bitrate, kBitrateLadder[level],
+            (unsigned long)link.queued_ms, lost ? ", loss" : "");
+        SetLevel(level);
+    }
+    if (complexity != settings_.complexity) {
+        ESP_LOGI(TAG, "Complexity %d -> %d (load %lu%%)", settings_.complexity, complexity,
+            (unsigned long)(averaged_load / 10));
+        settings_.complexity = complexity;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef ENCODER_CONTROLLER_H
+#define ENCODER_CONTROLLER_H
+
+#include <cstdint>
+
+/*
+ * Closed-loop Opus settings for the uplink.
+ *
+ * Called once per encoded frame with the state of the uploader queue and the time the frame
+ * took to encode, and moves along two independent axes:
+ *
+ *  - bitrate (and DTX) follow the link. A send queue deeper than ENCODER_CONGESTED_QUEUE_MS,
+ *    a new send failure or a new drop steps the bitrate ladder down, at most once per
+ *    ENCODER_STEP_DOWN_HOLD_MS so the queue has time to react. Beyond ENCODER_SEVERE_QUEUE_MS
+ *    it drops straight to the lowest rung. The ladder only climbs back one rung after
+ *    ENCODER_STEP_UP_AFTER_MS of a queue below ENCODER_CLEAR_QUEUE_MS, so a marginal link
+ *    settles on the highest rate it can carry instead of oscillating. DTX stays on except
+ *    on the top rung.
+ *  - complexity follows the CPU: the encode time of a frame over its duration is averaged,
+ *    above ENCODER_LOAD_HIGH_PERMILLE complexity steps down immediately, below
+ *    ENCODER_LOAD_LOW_PERMILLE for ENCODER_STEP_UP_AFTER_MS it steps up.
+ *
+ * Smaller packets drain a slow link faster, so the queue shrinks and the uploader stops
+ * dropping frames; speech gets coarser rather than cut. Time is counted in encoded audio,
+ * so the controller is pure logic and only used from the encode task.
+ */
+
+#define ENCODER_CONGESTED_QUEUE_MS 300
+#define ENCODER_SEVERE_QUEUE_MS 1000
+#define ENCODER_CLEAR_QUEUE_MS 100
+#define ENCODER_STEP_UP_AFTER_MS 3000
+#define ENCODER_STEP_DOWN_HOLD_MS 500
+#define ENCODER_LOAD_HIGH_PERMILLE 500
+#define ENCODER_LOAD_LOW_PERMILLE 250
+#define ENCODER_MAX_COMPLEXITY 5
+// The load average moves by 1/8 of the difference per frame
+#define ENCODER_LOAD_SHIFT 3
+
+struct EncoderLinkState {
+    uint32_t queued_ms = 0;         // audio waiting in the uploader queue
+    uint32_t send_failures = 0;     // running total from the uploader
+    uint32_t dropped = 0;           // running total from the uploader
+};
+
+struct EncoderSettings {
+    int bitrate = 16000;
+    int complexity = 0;
+    bool dtx = true;
+};
+
+class EncoderController {
+public:
+    EncoderController();
+
+    // Returns true when settings() changed and has to be applied to the encoder
+    bool Update(const EncoderLinkState& link, int64_t encode_us, int frame_duration_ms);
+    const EncoderSettings& settings() const { return settings_; }
+    // Rung of the bitrate ladder, 0 is the lowest
+    int level() const { return level_; }
+    // Back to the start rung, for a new connection
+    void Reset();
+
+private:
+    EncoderSettings settings_;
+    int level_ = 0;
+    uint32_t last_send_failures_ = 0;
+    uint32_t last_dropped_ = 0;
+    bool have_totals_ = false;
+    uint32_t clear_ms_ = 0;         // how long the queue has been below ENCODER_CLEAR_QUEUE_MS
+    uint32_t hold_ms_ = 0;          // time left before the next step down
+    uint32_t load_permille_ = 0;    // averaged encode time / frame duration
+    uint32_t idle_ms_ = 0;          // how long the load has been below ENCODER_LOAD_LOW_PERMILLE
+
+    void SetLevel(int level);
+};
+
+#endif // ENCODER_CONTROLLER_H
@@ -0,0 +1,217 @@
+#include "jitter_buffer.h"
+#include <esp_log.h>
+#include "metrics.h"
+
+#define TAG "JitterBuffer"
+
+// Used when a packet does not carry its frame duration
+#define JITTER_BUFFER_DEFAULT_FRAME_MS 60
+
+METRICS_COUNTER(metric_underruns, "audio.jitter_underruns");
+
+JitterBuffer::JitterBuffer() {
+    metrics_register(&metric_underruns);
+}
+
+void JitterBuffer::ApplyPendingReset() {
+    if (!reset_requested_.exchange(false, std::memory_order_acq_rel)) {
+        return;
+    }
+    for (auto& slot : slots_) {
+        slot.reset();
+    }
+    count_ = 0;
+    end_seq_ = play_seq_;
+    conceal_run_ = 0;
+    conceal_pending_ = 0;
+    state_ = kStateIdle;
+    end_requested_us_.store(0, std::memory_order_relaxed);
+}
+
+void JitterBuffer::StartStream(const AudioStreamPacket& packet, int64_t now_us) {
+    frame_ms_ = packet.frame_duration > 0 ? packet.frame_duration : JITTER_BUFFER_DEFAULT_FRAME_MS;
+    frame_us_ = frame_ms_ * 1000;
+    use_timestamps_ = packet.timestamp != 0;
+    base_timestamp_ = packet.timestamp;
+    base_seq_ = play_seq_;
+    end_seq_ = play_seq_;
+    stream_start_us_ = now_us;
+    buffering_since_us_ = now_us;
+    conceal_run_ = 0;
+    conceal_pending_ = 0;
+    state_ = kStateBuffering;
+    /* An end mark set while idle ended an earlier reply, it must not cut this one short */
+    int64_t end_us = end_requested_us_.load(std::memory_order_acquire);
+    if (end_us != 0 && end_us < now_us) {
+        end_requested_us_.compare_exchange_strong(end_us, 0, std::memory_order_acq_rel);
+    }
+}
+
+void JitterBuffer::Put(PacketPtr packet, int64_t now_us) {
+    ApplyPendingReset();
+    if (state_ == kStateIdle) {
+        StartStream(*packet, now_us);
+    }
+
+    uint32_t seq;
+    if (use_timestamps_) {
+        int32_t delta_ms = static_cast<int32_t>(packet->timestamp - base_timestamp_);
+        if (delta_ms < 0) {
+            statistics_.late_packets++;
+            return;
+        }
+        seq = base_seq_ + (delta_ms + frame_ms_ / 2) / frame_ms_;
+        if (static_cast<int32_t>(seq - play_seq_) >= JITTER_BUFFER_SLOTS) {
+            // Timestamp discontinuity, the server started a new stream
+            ESP_LOGW(TAG, "Timestamp jump of %ld ms, restarting stream", (long)delta_ms);
+            for (auto& slot : slots_) {
+                slot.reset();
+            }
+            count_ = 0;
+            StartStream(*packet, now_us);
+            seq = play_seq_;
+        }
+    } else {
+        // Ordered transport: the n-th packet of the stream is the n-th frame
+        seq = end_seq_;
+    }
+    if (static_cast<int32_t>(seq + 1 - end_seq_) > 0) {
+        end_seq_ = seq + 1;
+    }
+
+    /* A packet arriving while the speaker is being stretched means the stream had not ended */
+    if (conceal_pending_ > 0) {
+        statistics_.underruns++;
+        metrics_counter_add(&metric_underruns, 1);
+        statistics_.concealed_frames += conceal_pending_;
+        conceal_pending_ = 0;
+    }
+
+    /* Late packets are measured too, they are the ones that should raise the target */
+    UpdateJitter(seq, now_us);
+
+    if (static_cast<int32_t>(seq - play_seq_) < 0) {
+        // Its slot was already declared lost and filled by FEC / PLC
+        statistics_.late_packets++;
+        return;
+    }
+    auto& slot = slots_[seq % JITTER_BUFFER_SLOTS];
+    if (slot) {
+        // Duplicate
+        return;
+    }
+    slot = std::move(packet);
+    count_++;
+}
+
+void JitterBuffer::UpdateJitter(uint32_t seq, int64_t now_us) {
+    /* Delay relative to the earliest arrival seen in this stream, early packets move the origin */
+    int64_t expected_us = stream_start_us_ + static_cast<int32_t>(seq - base_seq_) * frame_us_;
+    int64_t delay_us = now_us - expected_us;
+    if (delay_us < 0) {
+        stream_start_us_ += delay_us;
+        delay_us = 0;
+    }
+
+    /* Fast attack, slow decay: one late burst raises the target at once, a clean link lowers it gradually */
+    if (delay_us > jitter_us_) {
+        jitter_us_ = delay_us;
+    } else {
+        jitter_us_ -= (jitter_us_ - delay_us) >> JITTER_BUFFER_DECAY_SHIFT;
+    }
+
+    uint32_t target = (jitter_us_ + frame_us_ - 1) / frame_us_;
+    if (target < JITTER_BUFFER_MIN_TARGET_FRAMES) {
+        target = JITTER_BUFFER_MIN_TARGET_FRAMES;
+    } else if (target > JITTER_BUFFER_MAX_TARGET_FRAMES) {
+        target = JITTER_BUFFER_MAX_TARGET_FRAMES;
+    }
+    target_frames_ = target;
+}
+
+JitterBufferAction JitterBuffer::Next(int64_t now_us, bool output_starving) {
+    ApplyPendingReset();
+    wait_ms_ = 0;
+
+    if (state_ == kStateIdle) {
+        return kJitterBufferWait;
+    }
+
+    if (state_ == kStateBuffering) {
+        int64_t prefill_us = target_frames_ * frame_us_;
+        int64_t waited_us = now_us - buffering_since_us_;
+        // A reply shorter than the target still starts once the prefill time has passed
+        if (static_cast<int32_t>(end_seq_ - play_seq_) < static_cast<int32_t>(target_frames_) && waited_us < prefill_us) {
+            wait_ms_ = (prefill_us - waited_us + 999) / 1000;
+            return kJitterBufferWait;
+        }
+        ESP_LOGD(TAG, "Start playing, depth=%lu target=%lu", (unsigned long)count_, (unsigned long)target_frames_);
+        state_ = kStatePlaying;
+        conceal_run_ = 0;
+    }
+
+    if (slots_[play_seq_ % JITTER_BUFFER_SLOTS]) {
+        return kJitterBufferDecode;
+    }
+    if (!output_starving) {
+        // The speaker still has audio queued, the frame may arrive in time
+        return kJitterBufferWait;
+    }
+
+    if (count_ > 0) {
+        /* A later frame is already here, so this one is lost rather than late: skip its slot */
+        if (conceal_run_ == 0) {
+            statistics_.underruns++;
+            metrics_counter_add(&metric_underruns, 1);
+        }
+        conceal_run_++;
+        play_seq_++;
+        if (slots_[play_seq_ % JITTER_BUFFER_SLOTS]) {
+            statistics_.fec_frames++;
+            return kJitterBufferDecodeFec;
+        }
+        statistics_.concealed_frames++;
+        return kJitterBufferConceal;
+    }
+
+    /* A packet queued before the end mark and not moved in yet only costs a new prefill */
+    bool ended = end_requested_us_.exchange(0, std::memory_order_acq_rel) != 0;
+    if (!ended && conceal_run_ < JITTER_BUFFER_MAX_CONCEAL_FRAMES) {
+        /* Nothing buffered, the frame is late: stretch with PLC and keep waiting for it, this deepens the buffer */
+        conceal_run_++;
+        conceal_pending_++;
+        return kJitterBufferConcealTail;
+    }
+
+    // Nothing arrived: the reply ended, or the link stalled and we prefill again
+    state_ = kStateIdle;
+    conceal_pending_ = 0;
+    return kJitterBufferWait;
+}
+
+void JitterBuffer::TailGain(float& from, float& to) const {
+    from = static_cast<float>(JITTER_BUFFER_MAX_CONCEAL_FRAMES - conceal_run_ + 1) / JITTER_BUFFER_MAX_CONCEAL_FRAMES;
+    to = static_cast<float>(JITTER_BUFFER_MAX_CONCEAL_FRAMES - conceal_run_) / JITTER_BUFFER_MAX_CONCEAL_FRAMES;
+}
+
+JitterBuffer::PacketPtr JitterBuffer::Take() {
+    PacketPtr packet = std::move(slots_[play_seq_ % JITTER_BUFFER_SLOTS]);
+    if (packet) {
+        play_seq_++;
+        count_--;
+        conceal_run_ = 0;
+    }
+    return packet;
+}
+
+const AudioStreamPacket* JitterBuffer::PeekNext() const {
+    return slots_[play_seq_ % JITTER_BUFFER_SLOTS].get();
+}
+
+JitterBufferStatistics JitterBuffer::GetStatistics() const {
+    JitterBufferStatistics statistics = statistics_;
+    statistics.depth_frames = count_;
+    statistics.target_frames = target_frames_;
+    statistics.jitter_ms = jitter_us_ / 1000;
+    return statistics;
+}
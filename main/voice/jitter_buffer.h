@@ -0,0 +1,123 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+#include "audio_frame_pool.h"
+
+/*
+ * Adaptive jitter buffer for the downlink Opus stream.
+ *
+ * Packets get a sequence number, derived from their timestamp when the server sends one and
+ * from the arrival order otherwise. Each arrival is compared with the time its frame would
+ * have arrived on an ideal, jitter-free link. The worst recent delay (fast attack, slow
+ * decay) sets the target depth. Playback starts once the target is buffered, so a clean
+ * link keeps the minimum latency and a noisy one buffers more.
+ *
+ * When the speaker runs dry and the frame for the next slot is missing:
+ *  - if later packets are already buffered the frame is lost: it is recovered from the FEC
+ *    data of the following packet, or concealed when that one is missing too. If the lost
+ *    packet shows up afterwards it is dropped.
+ *  - otherwise the frame is late: PLC stretches the audio without skipping the slot, so the
+ *    packet still plays when it arrives and the buffer ends up deeper after the underrun.
+ *    The reply may just as well have ended, so these frames fade out over the run. After
+ *    JITTER_BUFFER_MAX_CONCEAL_FRAMES stretched frames the stream counts as ended (or
+ *    stalled) and the buffer prefills again.
+ * Once RequestEnd() says the server finished the reply, an empty buffer ends the stream at
+ * once and nothing is concealed past the last packet.
+ *
+ * Put() / Next() / Take() must be called from the decode task only. RequestReset(),
+ * RequestEnd() and GetStatistics() are safe from any task.
+ */
+
+#define JITTER_BUFFER_SLOTS 16
+#define JITTER_BUFFER_MIN_TARGET_FRAMES 1
+#define JITTER_BUFFER_MAX_TARGET_FRAMES 10
+#define JITTER_BUFFER_MAX_CONCEAL_FRAMES 2
+// The delay estimate decays by 1/32 of the difference per packet, roughly 2 s at 60 ms frames
+#define JITTER_BUFFER_DECAY_SHIFT 5
+
+enum JitterBufferAction {
+    kJitterBufferWait,          // nothing to do until a packet arrives or WaitTimeMs() elapses
+    kJitterBufferDecode,        // Take() the packet of the current slot and decode it
+    kJitterBufferDecodeFec,     // current slot is lost, decode the FEC data of PeekNext()
+    kJitterBufferConceal,       // current slot is lost, run packet loss concealment
+    kJitterBufferConcealTail,   // nothing buffered after the current slot, conceal and fade out with TailGain()
+};
+
+struct JitterBufferStatistics {
+    uint32_t depth_frames = 0;      // packets waiting in the buffer
+    uint32_t target_frames = 0;     // prefill depth derived from the measured jitter
+    uint32_t jitter_ms = 0;         // current arrival delay estimate
+    uint32_t underruns = 0;         // times the speaker needed a frame that was not there
+    uint32_t concealed_frames = 0;  // frames synthesized by PLC
+    uint32_t fec_frames = 0;        // frames recovered from in-band FEC
+    uint32_t late_packets = 0;      // packets dropped because their slot was already filled
+};
+
+class JitterBuffer {
+public:
+    using PacketPtr = FramePool<AudioStreamPacket>::Ptr;
+
+    JitterBuffer();
+
+    void Put(PacketPtr packet, int64_t now_us);
+    // output_starving: the playback queue is empty, so a missing frame has to be filled now
+    JitterBufferAction Next(int64_t now_us, bool output_starving);
+    PacketPtr Take();
+    const AudioStreamPacket* PeekNext() const;
+
+    bool Full() const { return static_cast<int32_t>(end_seq_ - play_seq_) >= JITTER_BUFFER_SLOTS; }
+    bool Empty() const { return count_ == 0; }
+    // Milliseconds until buffering completes, 0 when only a new packet can change anything
+    uint32_t WaitTimeMs() const { return wait_ms_; }
+
+    // Gain at the start and end of the current kJitterBufferConcealTail frame, 1 to 0 over the run
+    void TailGain(float& from, float& to) const;
+
+    // Drop everything and start a new stream, applied by the decode task on its next call
+    void RequestReset() { reset_requested_.store(true, std::memory_order_release); }
+    // The server finished the reply: stop when the buffer runs dry instead of concealing.
+    // now_us is on the clock of the packet arrival times passed to Put(), a mark older than
+    // the first packet of a stream belongs to an earlier reply and is dropped
+    void RequestEnd(int64_t now_us) { end_requested_us_.store(now_us, std::memory_order_release); }
+    JitterBufferStatistics GetStatistics() const;
+
+private:
+    enum State {
+        kStateIdle,
+        kStateBuffering,
+        kStatePlaying,
+    };
+
+    std::array<PacketPtr, JITTER_BUFFER_SLOTS> slots_{};
+    State state_ = kStateIdle;
+    bool use_timestamps_ = false;
+    uint32_t play_seq_ = 0;         // slot the next frame is played from
+    uint32_t end_seq_ = 0;          // one past the highest sequence received
+    uint32_t base_timestamp_ = 0;
+    uint32_t base_seq_ = 0;
+    int64_t stream_start_us_ = 0;   // ideal arrival time of base_seq_
+    int64_t buffering_since_us_ = 0;
+    int64_t frame_us_ = 0;
+    int64_t jitter_us_ = 0;
+    uint32_t frame_ms_ = 0;
+    uint32_t conceal_run_ = 0;      // consecutive frames filled by FEC / PLC
+    uint32_t conceal_pending_ = 0;  // stretched frames, not counted until we know the stream went on
+    uint32_t wait_ms_ = 0;
+    volatile uint32_t count_ = 0;
+    volatile uint32_t target_frames_ = JITTER_BUFFER_MIN_TARGET_FRAMES;
+    JitterBufferStatistics statistics_;
+    std::atomic<bool> reset_requested_{false};
+    std::atomic<int64_t> end_requested_us_{0};    // 0: no end mark
+
+    void ApplyPendingReset();
+    void StartStream(const AudioStreamPacket& packet, int64_t now_us);
+    void UpdateJitter(uint32_t seq, int64_t now_us);
+};
+
+#endif // JITTER_BUFFER_H
@@ -0,0 +1,164 @@
+#include "latency_trace.h"
+#include "audio_uploader.h"
+#include <esp_log.h>
+#include <cJSON.h>
+#include <atomic>
+#include <cstring>
+
+#define TAG "LatencyTrace"
+
+
+namespace {
+
+struct TraceSlot {
+    std::atomic<uint32_t> sequence{0};  // odd while the writer is filling the slot
+    latency_trace_t trace;
+};
+
+/* Single writer per direction, the reader skips slots rewritten while it was copying them */
+struct TraceRing {
+    std::atomic<uint32_t> head{0};
+    TraceSlot slots[LATENCY_TRACE_RING_SIZE];
+};
+
+const int kStampCount[kLatencyTraceDirectionCount] = { LATENCY_TRACE_UP_STAMPS, LATENCY_TRACE_DOWN_STAMPS };
+const char* const kDirectionName[kLatencyTraceDirectionCount] = { "uplink", "downlink" };
+// Stage i is the delay from stamp i - 1 to stamp i, stage 0 is first to last stamp
+const char* const kStageName[kLatencyTraceDirectionCount][LATENCY_TRACE_MAX_STAMPS] = {
+    { "total", "afe", "encode", "enqueue", "send" },
+    { "total", "buffer", "decode", "output", nullptr },
+};
+
+TraceRing rings[kLatencyTraceDirectionCount];
+// Statistics only, a count lost to a concurrent reset does not matter
+uint16_t histograms[kLatencyTraceDirectionCount][LATENCY_TRACE_MAX_STAMPS][LATENCY_TRACE_BUCKETS];
+
+/* 64us units, exact below 256us, then 4 buckets per octave */
+int BucketOf(uint32_t us) {
+    uint32_t v = us >> 6;
+    if (v < 4) {
+        return v;
+    }
+    int octave = 31 - __builtin_clz(v);
+    int bucket = 4 * (octave - 1) + ((v >> (octave - 2)) & 3);
+    return bucket < LATENCY_TRACE_BUCKETS ? bucket : LATENCY_TRACE_BUCKETS - 1;
+}
+
+uint32_t BucketUpperUs(int bucket) {
+    if (bucket < 4) {
+        return (bucket + 1) << 6;
+    }
+    int octave = bucket / 4 + 1;
+    return ((4 + bucket % 4 + 1) << (octave - 2)) << 6;
+}
+
+uint32_t Percentile(const uint16_t* histogram, uint32_t count, int percent) {
+    uint32_t target = (count * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < LATENCY_TRACE_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen >= target) {
+            return BucketUpperUs(i);
+        }
+    }
+    return BucketUpperUs(LATENCY_TRACE_BUCKETS - 1);
+}
+
+void Record(uint16_t* histogram, uint32_t us) {
+    uint16_t& bucket = histogram[BucketOf(us)];
+    if (bucket < UINT16_MAX) {
+        bucket++;
+    }
+}
+
+double ToMs(uint32_t us) {
+    return (us / 100) / 10.0;
+}
+
+} // namespace
+
+extern "C" void latency_trace_commit(latency_trace_direction_t direction, const latency_trace_t* trace) {
+    int stamps = kStampCount[direction];
+    for (int i = 0; i < stamps; i++) {
+        if (trace->stamps[i] == 0) {
+            return;
+        }
+    }
+
+    TraceRing& ring = rings[direction];
+    uint32_t index = ring.head.load(std::memory_order_relaxed);
+    TraceSlot& slot = ring.slots[index % LATENCY_TRACE_RING_SIZE];
+    slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.trace = *trace;
+    slot.sequence.store(index * 2 + 2, std::memory_order_release);
+    ring.head.store(index + 1, std::memory_order_release);
+
+    auto& histogram = histograms[direction];
+    Record(histogram[0], trace->stamps[stamps - 1] - trace->stamps[0]);
+    for (int i = 1; i < stamps; i++) {
+        Record(histogram[i], trace->stamps[i] - trace->stamps[i - 1]);
+    }
+}
+
+extern "C" void latency_trace_publish(void) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "type", "latency");
+    bool any = false;
+
+    for (int direction = 0; direction < kLatencyTraceDirectionCount; direction++) {
+        auto& histogram = histograms[direction];
+        uint32_t frames = 0;
+        for (int i = 0; i < LATENCY_TRACE_BUCKETS; i++) {
+            frames += histogram[0][i];
+        }
+        if (frames == 0) {
+            continue;
+        }
+        any = true;
+
+        cJSON* stages = cJSON_CreateObject();
+        cJSON_AddNumberToObject(stages, "frames", frames);
+        for (int stage = 0; stage < kStampCount[direction]; stage++) {
+            uint32_t p50 = Percentile(histogram[stage], frames, 50);
+            uint32_t p95 = Percentile(histogram[stage], frames, 95);
+            uint32_t p99 = Percentile(histogram[stage], frames, 99);
+            double values[3] = { ToMs(p50), ToMs(p95), ToMs(p99) };
+            cJSON_AddItemToObject(stages, kStageName[direction][stage], cJSON_CreateDoubleArray(values, 3));
+            ESP_LOGI(TAG, "%s %s: p50=%.1fms p95=%.1fms p99=%.1fms", kDirectionName[direction],
+                kStageName[direction][stage], values[0], values[1], values[2]);
+        }
+        cJSON_AddItemToObject(root, kDirectionName[direction], stages);
+        memset(histogram, 0, sizeof(histogram));
+    }
+
+    if (any) {
+        auto json_str = cJSON_PrintUnformatted(root);
+        if (json_str != nullptr) {
+            audio_uploader_send_text_on(WS_CHANNEL_TELEMETRY, json_str);
+            cJSON_free(json_str);
+        }
+    }
+    cJSON_Delete(root);
+}
+
+extern "C" void latency_trace_dump(void) {
+    for (int direction = 0; direction < kLatencyTraceDirectionCount; direction++) {
+        TraceRing& ring = rings[direction];
+        uint32_t head = ring.head.load(std::memory_order_acquire);
+        uint32_t first = head > LATENCY_TRACE_RING_SIZE ? head - LATENCY_TRACE_RING_SIZE : 0;
+        for (uint32_t index = first; index < head; index++) {
+            TraceSlot& slot = ring.slots[index % LATENCY_TRACE_RING_SIZE];
+            uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+            latency_trace_t trace = slot.trace;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence != index * 2 + 2 || slot.sequence.load(std::memory_order_relaxed) != sequence) {
+                continue;
+            }
+            // <direction> <frame> <stamp>... parsed by scripts/latency_timeline.py
+            ESP_LOGI(TAG, "%c %lu %lu %lu %lu %lu %lu", direction == kLatencyTraceUplink ? 'U' : 'D',
+                (unsigned long)index, (unsigned long)trace.stamps[0], (unsigned long)trace.stamps[1],
+                (unsigned long)trace.stamps[2], (unsigned long)trace.stamps[3], (unsigned long)trace.stamps[4]);
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <stdint.h>
+#include <esp_timer.h>
+
+/*
+ * Per-frame latency tracing for the voice pipeline.
+ *
+ * Each frame carries a latency_trace_t and every stage writes its esp_timer time into the
+ * matching stamp. The task that finishes the frame (the uploader send task on the uplink,
+ * the audio output task on the downlink) commits it: the trace goes into a lock-free ring
+ * for latency_trace_dump() and each stage delay into a histogram for latency_trace_publish().
+ *
+ * Stamps are the low 32 bits of esp_timer_get_time(), differences stay correct across the
+ * wrap. 0 means the stage was not stamped.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LATENCY_TRACE_MAX_STAMPS        5
+#define LATENCY_TRACE_RING_SIZE         32      // per direction, the most recent frames are kept
+#define LATENCY_TRACE_BUCKETS           64      // 4 buckets per octave from 64us to ~8s
+
+typedef enum {
+    kLatencyTraceUplink = 0,
+    kLatencyTraceDownlink,
+    kLatencyTraceDirectionCount,
+} latency_trace_direction_t;
+
+/* Uplink: mic -> server */
+#define LATENCY_TRACE_UP_CAPTURED       0       // last sample of the frame read from I2S
+#define LATENCY_TRACE_UP_PROCESSED      1       // frame emitted by the audio processor (AFE)
+#define LATENCY_TRACE_UP_ENCODED        2
+#define LATENCY_TRACE_UP_ENQUEUED       3       // accepted by the uploader queue
+#define LATENCY_TRACE_UP_SENT           4       // handed to the WebSocket client
+#define LATENCY_TRACE_UP_STAMPS         5
+
+/* Downlink: server -> speaker */
+#define LATENCY_TRACE_DOWN_RECEIVED     0       // binary frame received from the WebSocket
+#define LATENCY_TRACE_DOWN_DEQUEUED     1       // left the jitter buffer
+#define LATENCY_TRACE_DOWN_DECODED      2
+#define LATENCY_TRACE_DOWN_WRITTEN      3       // handed to the output mixer, at most one block before I2S
+#define LATENCY_TRACE_DOWN_STAMPS       4
+
+typedef struct {
+    uint32_t stamps[LATENCY_TRACE_MAX_STAMPS];
+} latency_trace_t;
+
+static inline uint32_t latency_trace_now(void) {
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    return now != 0 ? now : 1;
+}
+
+// Called once per direction by the task that finishes the frame, traces with a missing stamp are ignored
+void latency_trace_commit(latency_trace_direction_t direction, const latency_trace_t* trace);
+
+// Send p50/p95/p99 of every stage over the uploader text channel and start a new window
+void latency_trace_publish(void);
+
+// Log the traces in the ring, scripts/latency_timeline.py turns the log into a timeline
+void latency_trace_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LATENCY_TRACE_H
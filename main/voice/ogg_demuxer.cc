@@ -0,0 +1,120 @@
+#include "ogg_demuxer.h"
+#include <esp_log.h>
+#include <cstring>
+
+#define TAG "OggDemuxer"
+
+// Capture pattern + version + header type + granule + serial + sequence + CRC + segment count
+#define OGG_PAGE_HEADER_SIZE 27
+
+
+OggDemuxer::OggDemuxer(std::string_view data)
+    : data_(reinterpret_cast<const uint8_t*>(data.data())), size_(data.size()) {
+}
+
+bool OggDemuxer::LoadPage() {
+    size_t offset = page_offset_;
+    if (offset + 4 > size_ || std::memcmp(data_ + offset, "OggS", 4) != 0) {
+        // Not where the previous page said it would be, resync on the next capture pattern
+        while (offset + 4 <= size_ && std::memcmp(data_ + offset, "OggS", 4) != 0) {
+            offset++;
+        }
+        if (offset + 4 > size_) {
+            return false;
+        }
+        ESP_LOGW(TAG, "Resynced to page at offset %u", (unsigned int)offset);
+        continued_ = false;
+    }
+    if (offset + OGG_PAGE_HEADER_SIZE > size_) {
+        return false;
+    }
+
+    const uint8_t* page = data_ + offset;
+    uint8_t segment_count = page[26];
+    size_t body_offset = offset + OGG_PAGE_HEADER_SIZE + segment_count;
+    if (body_offset > size_) {
+        return false;
+    }
+    size_t body_size = 0;
+    for (uint8_t i = 0; i < segment_count; i++) {
+        body_size += page[OGG_PAGE_HEADER_SIZE + i];
+    }
+    if (body_offset + body_size > size_) {
+        return false;
+    }
+
+    segment_table_ = page + OGG_PAGE_HEADER_SIZE;
+    segment_count_ = segment_count;
+    segment_index_ = 0;
+    body_offset_ = body_offset;
+    page_offset_ = body_offset + body_size;
+    return true;
+}
+
+bool OggDemuxer::NextPacket(const uint8_t*& packet, size_t& size) {
+    while (true) {
+        if (segment_index_ >= segment_count_) {
+            if (!LoadPage()) {
+                return false;
+            }
+            continue;
+        }
+
+        /* Lacing: a packet ends at the first segment shorter than 255 bytes */
+        size_t start = body_offset_;
+        size_t length = 0;
+        bool complete = false;
+        while (segment_index_ < segment_count_) {
+            uint8_t lace = segment_table_[segment_index_++];
+            length += lace;
+            if (lace < 255) {
+                complete = true;
+                break;
+            }
+        }
+        body_offset_ += length;
+
+        if (!complete) {
+            // The packet continues on the next page, this is the only case that copies
+            if (!continued_) {
+                spill_.clear();
+                continued_ = true;
+            }
+            spill_.insert(spill_.end(), data_ + start, data_ + start + length);
+            continue;
+        }
+        if (continued_) {
+            spill_.insert(spill_.end(), data_ + start, data_ + start + length);
+            continued_ = false;
+            packet = spill_.data();
+            size = spill_.size();
+        } else {
+            packet = data_ + start;
+            size = length;
+        }
+        if (size == 0) {
+            continue;
+        }
+
+        if (!seen_head_) {
+            // OpusHead: [0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip, [12-15] input_sample_rate
+            if (size >= 19 && std::memcmp(packet, "OpusHead", 8) == 0) {
+                seen_head_ = true;
+                int sample_rate = packet[12] | (packet[13] << 8) | (packet[14] << 16) | (packet[15] << 24);
+                if (sample_rate > 0) {
+                    sample_rate_ = sample_rate;
+                }
+                ESP_LOGD(TAG, "OpusHead: version=%d, channels=%d, sample_rate=%d", packet[8], packet[9], sample_rate_);
+            }
+            continue;
+        }
+        if (!seen_tags_) {
+            // Expect OpusTags in the second packet
+            if (size >= 8 && std::memcmp(packet, "OpusTags", 8) == 0) {
+                seen_tags_ = true;
+            }
+            continue;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef OGG_DEMUXER_H
+#define OGG_DEMUXER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/*
+ * Incremental Ogg/Opus demuxer over an in-memory (usually flash mapped) asset.
+ *
+ * NextPacket() walks one page at a time and returns pointers straight into the source
+ * buffer, so nothing is copied except the rare packet that continues across a page
+ * boundary. OpusHead / OpusTags are consumed internally. The source must outlive the
+ * demuxer, which holds for the embedded sound assets.
+ */
+class OggDemuxer {
+public:
+    explicit OggDemuxer(std::string_view data);
+
+    // Next Opus audio packet, false at the end of the stream or on a truncated page
+    bool NextPacket(const uint8_t*& packet, size_t& size);
+
+    inline int sample_rate() const {
+        return sample_rate_;
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t page_offset_ = 0;            // where the next page is expected
+    const uint8_t* segment_table_ = nullptr;
+    uint8_t segment_count_ = 0;
+    uint8_t segment_index_ = 0;
+    size_t body_offset_ = 0;            // start of the next packet in the current page body
+    bool seen_head_ = false;
+    bool seen_tags_ = false;
+    bool continued_ = false;            // spill_ holds the head of a packet that crosses pages
+    int sample_rate_ = 16000;
+    std::vector<uint8_t> spill_;
+
+    bool LoadPage();
+};
+
+#endif // OGG_DEMUXER_H
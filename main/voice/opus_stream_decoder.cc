@@ -0,0 +1,71 @@
+#include "opus_stream_decoder.h"
+#include <esp_log.h>
+#include <algorithm>
+
+#define TAG "OpusStreamDecoder"
+
+OpusStreamDecoder::OpusStreamDecoder(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), duration_ms_(duration_ms), channels_(channels) {
+    int error;
+    audio_dec_ = opus_decoder_create(sample_rate, channels, &error);
+    if (audio_dec_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio decoder, error code: %d", error);
+        return;
+    }
+
+    frame_size_ = FrameSize(duration_ms);
+}
+
+OpusStreamDecoder::~OpusStreamDecoder() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (audio_dec_ != nullptr) {
+        opus_decoder_destroy(audio_dec_);
+    }
+}
+
+bool OpusStreamDecoder::Decode(const uint8_t* opus, size_t size, std::vector<int16_t>& pcm) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return DecodeLocked(opus, size, frame_size_, pcm, 0);
+}
+
+bool OpusStreamDecoder::DecodeFec(const uint8_t* opus, size_t size, int duration_ms, std::vector<int16_t>& pcm) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Without LBRR data in the packet libopus falls back to concealment by itself
+    return DecodeLocked(opus, size, FrameSize(duration_ms), pcm, 1);
+}
+
+bool OpusStreamDecoder::Conceal(int duration_ms, std::vector<int16_t>& pcm) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // A null packet asks the decoder to extrapolate one frame from its state
+    return DecodeLocked(nullptr, 0, FrameSize(duration_ms), pcm, 0);
+}
+
+int OpusStreamDecoder::FrameSize(int duration_ms) const {
+    // Never more than the buffer sized in the constructor
+    return sample_rate_ / 1000 * channels_ * std::min(duration_ms, duration_ms_);
+}
+
+bool OpusStreamDecoder::DecodeLocked(const uint8_t* opus, size_t size, int frame_size, std::vector<int16_t>& pcm, int decode_fec) {
+    if (audio_dec_ == nullptr) {
+        ESP_LOGE(TAG, "Audio decoder is not configured");
+        return false;
+    }
+
+    pcm.resize(frame_size);
+    auto ret = opus_decode(audio_dec_, opus, size, pcm.data(), frame_size, decode_fec);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to decode audio, error code: %d", ret);
+        return false;
+    }
+
+    // Resize the pcm vector to the actual decoded samples
+    pcm.resize(ret);
+    return true;
+}
+
+void OpusStreamDecoder::ResetState() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (audio_dec_ != nullptr) {
+        opus_decoder_ctl(audio_dec_, OPUS_RESET_STATE);
+    }
+}
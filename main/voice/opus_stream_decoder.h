@@ -0,0 +1,55 @@
+#ifndef OPUS_STREAM_DECODER_H
+#define OPUS_STREAM_DECODER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+#include "opus.h"
+
+/*
+ * Opus decoder for the downlink stream.
+ *
+ * Same shape as OpusDecoderWrapper, but it also exposes packet loss concealment and
+ * in-band FEC recovery. The jitter buffer uses these to fill frames that did not
+ * arrive in time.
+ *
+ * duration_ms is the longest frame the stream may carry. Decode() returns whatever the
+ * packet holds; FEC and concealment have no packet to read it from, so the caller passes
+ * the duration of the missing frame.
+ */
+class OpusStreamDecoder {
+public:
+    OpusStreamDecoder(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusStreamDecoder();
+
+    bool Decode(const uint8_t* opus, size_t size, std::vector<int16_t>& pcm);
+    // Recover the frame *before* `opus` from the FEC data carried in `opus`
+    bool DecodeFec(const uint8_t* opus, size_t size, int duration_ms, std::vector<int16_t>& pcm);
+    // Synthesize one frame for a missing packet
+    bool Conceal(int duration_ms, std::vector<int16_t>& pcm);
+    void ResetState();
+
+    inline int sample_rate() const {
+        return sample_rate_;
+    }
+
+    inline int duration_ms() const {
+        return duration_ms_;
+    }
+
+private:
+    std::mutex mutex_;
+    struct OpusDecoder* audio_dec_ = nullptr;
+    int frame_size_ = 0;
+    int sample_rate_;
+    int duration_ms_;
+
+    int channels_;
+
+    bool DecodeLocked(const uint8_t* opus, size_t size, int frame_size, std::vector<int16_t>& pcm, int decode_fec);
+    int FrameSize(int duration_ms) const;
+};
+
+#endif // OPUS_STREAM_DECODER_H
@@ -0,0 +1,87 @@
+#include "opus_stream_encoder.h"
+#include <esp_log.h>
+
+#define TAG "OpusStreamEncoder"
+
+OpusStreamEncoder::OpusStreamEncoder(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), duration_ms_(duration_ms) {
+    int error;
+    audio_enc_ = opus_encoder_create(sample_rate, channels, OPUS_APPLICATION_VOIP, &error);
+    if (audio_enc_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", error);
+        return;
+    }
+
+    opus_encoder_ctl(audio_enc_, OPUS_SET_DTX(1));
+    // Complexity 0 uses the least CPU, the encoder controller raises it when there is headroom
+    opus_encoder_ctl(audio_enc_, OPUS_SET_COMPLEXITY(0));
+
+    frame_size_ = sample_rate / 1000 * channels * duration_ms;
+}
+
+OpusStreamEncoder::~OpusStreamEncoder() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (audio_enc_ != nullptr) {
+        opus_encoder_destroy(audio_enc_);
+    }
+}
+
+bool OpusStreamEncoder::Encode(const std::vector<int16_t>& pcm, std::vector<uint8_t>& opus) {
+    opus.resize(MAX_OPUS_PACKET_SIZE);
+    int ret = Encode(pcm, opus.data(), opus.size());
+    if (ret < 0) {
+        opus.clear();
+        return false;
+    }
+    opus.resize(ret);
+    return true;
+}
+
+int OpusStreamEncoder::Encode(const std::vector<int16_t>& pcm, uint8_t* opus, size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (audio_enc_ == nullptr) {
+        ESP_LOGE(TAG, "Audio encoder is not configured");
+        return -1;
+    }
+
+    if (pcm.size() != frame_size_) {
+        ESP_LOGE(TAG, "Audio data size is not equal to frame size, size: %u, frame size: %u",
+            (unsigned int)pcm.size(), (unsigned int)frame_size_);
+        return -1;
+    }
+
+    auto ret = opus_encode(audio_enc_, pcm.data(), frame_size_, opus, capacity);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+        return -1;
+    }
+    return ret;
+}
+
+void OpusStreamEncoder::SetBitrate(int bitrate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (audio_enc_ != nullptr) {
+        opus_encoder_ctl(audio_enc_, OPUS_SET_BITRATE(bitrate));
+    }
+}
+
+void OpusStreamEncoder::SetComplexity(int complexity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (audio_enc_ != nullptr) {
+        opus_encoder_ctl(audio_enc_, OPUS_SET_COMPLEXITY(complexity));
+    }
+}
+
+void OpusStreamEncoder::SetDtx(bool enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (audio_enc_ != nullptr) {
+        opus_encoder_ctl(audio_enc_, OPUS_SET_DTX(enable ? 1 : 0));
+    }
+}
+
+void OpusStreamEncoder::ResetState() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (audio_enc_ != nullptr) {
+        opus_encoder_ctl(audio_enc_, OPUS_RESET_STATE);
+    }
+}
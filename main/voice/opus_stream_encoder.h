@@ -0,0 +1,50 @@
+#ifndef OPUS_STREAM_ENCODER_H
+#define OPUS_STREAM_ENCODER_H
+
+#include <vector>
+#include <cstdint>
+#include <mutex>
+
+#include "opus.h"
+
+#ifndef MAX_OPUS_PACKET_SIZE
+#define MAX_OPUS_PACKET_SIZE 1000
+#endif
+
+/*
+ * Opus encoder for the uplink stream.
+ *
+ * Same shape as OpusEncoderWrapper (VoIP, DTX on, complexity 0 at creation), but the
+ * bitrate can be changed too, so the EncoderController can trade quality for bandwidth
+ * while the stream is running. Encode() writes straight into the caller's buffer.
+ */
+class OpusStreamEncoder {
+public:
+    OpusStreamEncoder(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusStreamEncoder();
+
+    bool Encode(const std::vector<int16_t>& pcm, std::vector<uint8_t>& opus);
+    // Into a caller-owned buffer (e.g. a slot of the uploader ring), returns the packet size or -1
+    int Encode(const std::vector<int16_t>& pcm, uint8_t* opus, size_t capacity);
+    void SetBitrate(int bitrate);
+    void SetComplexity(int complexity);
+    void SetDtx(bool enable);
+    void ResetState();
+
+    inline int sample_rate() const {
+        return sample_rate_;
+    }
+
+    inline int duration_ms() const {
+        return duration_ms_;
+    }
+
+private:
+    std::mutex mutex_;
+    struct OpusEncoder* audio_enc_ = nullptr;
+    size_t frame_size_ = 0;
+    int sample_rate_;
+    int duration_ms_;
+};
+
+#endif // OPUS_STREAM_ENCODER_H
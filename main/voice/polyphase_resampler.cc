@@ -0,0 +1,144 @@
+#include "polyphase_resampler.h"
+#include "resampler_filters.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <esp_log.h>
+#include <dsps_dotprod.h>
+
+#define TAG "PolyphaseResampler"
+
+// Input samples per call the work buffer is sized for up front: 60 ms at 48 kHz
+#define POLYPHASE_RESERVE_SAMPLES 2880
+
+/*
+ * One output sample, rounded to nearest. The taps sum to 1.0 in Q15.
+ *
+ * esp-dsp's MAC16 dot product stores the low 16 bits of its shifted accumulator and
+ * rounds with 0x7fff >> shift, which is a whole output step rather than half of one. So
+ * the product is taken at twice the output scale: that gives ceil(2y), and halving it
+ * gives y rounded to nearest. This wraps for |y| >= 16384, so the caller only takes this
+ * path when the block's peak times the bank's gain stays below that.
+ */
+static inline int16_t Dot(const int16_t* coefficients, const int16_t* samples, int taps) {
+    int16_t doubled;
+    dsps_dotprod_s16(samples, coefficients, &doubled, taps, 15 - POLYPHASE_COEFFICIENT_BITS + 1);
+    return doubled >> 1;
+}
+
+// Blocks too loud for Dot(): Q30 taps in a 64-bit accumulator, saturated to 16 bits
+static inline int16_t WideDot(const int32_t* coefficients, const int16_t* samples, int taps) {
+    int64_t acc = (INT64_C(1) << (POLYPHASE_WIDE_COEFFICIENT_BITS - 1)) - 1;
+    for (int i = 0; i < taps; i++) {
+        acc += static_cast<int64_t>(samples[i]) * coefficients[i];
+    }
+    return static_cast<int16_t>(std::clamp<int64_t>(acc >> POLYPHASE_WIDE_COEFFICIENT_BITS, INT16_MIN, INT16_MAX));
+}
+
+template <int L, int M, int Taps, bool Wide>
+void PolyphaseResampler::Run(int input_samples, int16_t* output) {
+    const int16_t* work = work_.data();
+    const uint32_t end = static_cast<uint32_t>(input_samples) * L;
+    uint32_t position = position_;
+    while (position < end) {
+        uint32_t newest = position / L;
+        uint32_t phase = position % L;
+        // The window of this output is work[newest .. newest + Taps - 1]
+        if (Wide) {
+            *output++ = WideDot(wide_bank_ + phase * Taps, work + newest, Taps);
+        } else if ((newest & 1) == 0) {
+            *output++ = Dot(bank_ + phase * Taps, work + newest, Taps);
+        } else {
+            *output++ = Dot(shifted_bank_.data() + phase * (Taps + 4), work + newest - 1, Taps + 4);
+        }
+        position += M;
+    }
+    position_ = position - end;
+}
+
+template <int L, int M, int Taps>
+void PolyphaseResampler::Select(const int16_t (&bank)[L][Taps], const int32_t (&wide_bank)[L][Taps]) {
+    static_assert(Taps % 4 == 0, "The MAC16 dot product works on groups of 4 taps");
+    up_ = L;
+    down_ = M;
+    taps_ = Taps;
+    bank_ = &bank[0][0];
+    wide_bank_ = &wide_bank[0][0];
+    kernel_ = &PolyphaseResampler::Run<L, M, Taps, false>;
+    wide_kernel_ = &PolyphaseResampler::Run<L, M, Taps, true>;
+
+    // |y| <= peak * sum(|h|) over the loudest phase, Dot() is exact while that stays below 16384
+    int32_t gain = 0;
+    for (int phase = 0; phase < L; phase++) {
+        int32_t sum = 0;
+        for (int tap = 0; tap < Taps; tap++) {
+            sum += std::abs(bank[phase][tap]);
+        }
+        gain = std::max(gain, sum);
+    }
+    mac16_peak_ = static_cast<int32_t>((static_cast<int64_t>(INT16_MAX / 2) << POLYPHASE_COEFFICIENT_BITS) / gain);
+
+    shifted_bank_.assign(L * (Taps + 4), 0);
+    for (int phase = 0; phase < L; phase++) {
+        std::copy(bank[phase], bank[phase] + Taps, shifted_bank_.begin() + phase * (Taps + 4) + 1);
+    }
+}
+
+void PolyphaseResampler::Configure(int input_sample_rate, int output_sample_rate) {
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    position_ = 0;
+    kernel_ = nullptr;
+
+    if (input_sample_rate == 16000 && output_sample_rate == 24000) {
+        Select<3, 2>(kPolyphaseBank16kTo24k, kPolyphaseWideBank16kTo24k);
+    } else if (input_sample_rate == 24000 && output_sample_rate == 16000) {
+        Select<2, 3>(kPolyphaseBank24kTo16k, kPolyphaseWideBank24kTo16k);
+    } else if (input_sample_rate == 48000 && output_sample_rate == 16000) {
+        Select<1, 3>(kPolyphaseBank48kTo16k, kPolyphaseWideBank48kTo16k);
+    } else {
+        ESP_LOGI(TAG, "No filter bank for %d -> %d, using the SILK resampler", input_sample_rate, output_sample_rate);
+        fallback_.Configure(input_sample_rate, output_sample_rate);
+        std::vector<int16_t>().swap(work_);
+        std::vector<int16_t>().swap(shifted_bank_);
+        return;
+    }
+
+    // Start from silence
+    work_.assign(taps_ - 1 + POLYPHASE_RESERVE_SAMPLES + 4, 0);
+    ESP_LOGI(TAG, "Resampling %d -> %d with %d x %d taps", input_sample_rate, output_sample_rate, up_, taps_);
+}
+
+int PolyphaseResampler::GetOutputSamples(int input_samples) const {
+    if (kernel_ == nullptr) {
+        return fallback_.GetOutputSamples(input_samples);
+    }
+    uint32_t end = static_cast<uint32_t>(input_samples) * up_;
+    if (position_ >= end) {
+        return 0;
+    }
+    return (end - position_ + down_ - 1) / down_;
+}
+
+void PolyphaseResampler::Process(const int16_t* input, int input_samples, int16_t* output) {
+    if (kernel_ == nullptr) {
+        fallback_.Process(input, input_samples, output);
+        return;
+    }
+
+    size_t history = taps_ - 1;
+    if (work_.size() < history + input_samples + 4) {
+        ESP_LOGW(TAG, "Growing work buffer to %d input samples", input_samples);
+        work_.resize(history + input_samples + 4);
+    }
+    memcpy(work_.data() + history, input, input_samples * sizeof(int16_t));
+    // The MAC16 kernel needs headroom; a loud block (history included) takes the 32-bit one
+    int32_t peak = 0;
+    for (size_t i = 0; i < history + input_samples; i++) {
+        peak = std::max<int32_t>(peak, std::abs(work_[i]));
+    }
+    (this->*(peak <= mac16_peak_ ? kernel_ : wide_kernel_))(input_samples, output);
+    // The last taps - 1 input samples are the history of the next call
+    memmove(work_.data(), work_.data() + input_samples, history * sizeof(int16_t));
+}
@@ -0,0 +1,61 @@
+#ifndef POLYPHASE_RESAMPLER_H
+#define POLYPHASE_RESAMPLER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <opus_resampler.h>
+
+/*
+ * Streaming rational resampler for the fixed rates of the voice path.
+ *
+ * 16k -> 24k, 24k -> 16k and 48k -> 16k run a polyphase FIR with a precomputed Q15 bank
+ * per ratio (resampler_filters.h, generated by scripts/gen_resampler_filters.py). The
+ * inner product is esp-dsp's MAC16 dot product, specialized at compile time on the ratio
+ * and tap count. Blocks loud enough to overflow its 16-bit result use a C loop over a
+ * Q30 copy of the bank instead. Other rate pairs fall back to the SILK resampler
+ * (OpusResampler).
+ *
+ * The filter history and the output phase carry over between Process() calls, so a
+ * stream can be fed in frames of any size. GetOutputSamples() returns exactly how many
+ * samples the next Process() call with that input size writes.
+ */
+class PolyphaseResampler {
+public:
+    void Configure(int input_sample_rate, int output_sample_rate);
+    void Process(const int16_t* input, int input_samples, int16_t* output);
+    int GetOutputSamples(int input_samples) const;
+
+    int input_sample_rate() const { return input_sample_rate_; }
+    int output_sample_rate() const { return output_sample_rate_; }
+    // False when the rate pair is served by the SILK fallback
+    bool polyphase() const { return kernel_ != nullptr; }
+
+private:
+    using Kernel = void (PolyphaseResampler::*)(int input_samples, int16_t* output);
+
+    int input_sample_rate_ = 0;
+    int output_sample_rate_ = 0;
+    int up_ = 1;                        // L
+    int down_ = 1;                      // M
+    int taps_ = 0;                      // taps per phase
+    uint32_t position_ = 0;             // next output, in L-upsampled input samples from the start of the block
+    Kernel kernel_ = nullptr;           // MAC16
+    Kernel wide_kernel_ = nullptr;      // Q30 taps, 64-bit accumulator, saturating
+    int32_t mac16_peak_ = 0;            // loudest input sample the MAC16 kernel takes
+    const int16_t* bank_ = nullptr;     // [L][taps], 4-byte aligned rows
+    const int32_t* wide_bank_ = nullptr; // [L][taps], Q30
+    // The same phases with one leading zero tap and padded to taps + 4, for outputs whose
+    // history window starts at an odd sample (the MAC16 loop needs 4-byte aligned loads)
+    std::vector<int16_t> shifted_bank_;
+    // taps - 1 samples of history, then the current input, then 4 samples of padding
+    std::vector<int16_t> work_;
+    OpusResampler fallback_;
+
+    template <int L, int M, int Taps, bool Wide>
+    void Run(int input_samples, int16_t* output);
+    template <int L, int M, int Taps>
+    void Select(const int16_t (&bank)[L][Taps], const int32_t (&wide_bank)[L][Taps]);
+};
+
+#endif // POLYPHASE_RESAMPLER_H
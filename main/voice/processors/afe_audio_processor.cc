@@ -12,10 +12,7 @@ AfeAudioProcessor::AfeAudioProcessor()
 
 void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms) {
     codec_ = codec;
-    frame_samples_ = frame_duration_ms * 16000 / 1000;
-
-    // Pre-allocate output buffer capacity
-    output_buffer_.reserve(frame_samples_);
+    assembler_.Initialize(frame_duration_ms * 16000 / 1000);
 
     int ref_num = codec_->input_reference() ? 1 : 0;
 
@@ -67,6 +64,10 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms) {
     }, "audio_communication", 4096, this, 3, NULL);
 }
 
+void AfeAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    assembler_.SetFrameSamples(frame_duration_ms * 16000 / 1000);
+}
+
 AfeAudioProcessor::~AfeAudioProcessor() {
     if (afe_data_ != nullptr) {
         afe_iface_->destroy(afe_data_);
@@ -81,10 +82,11 @@ size_t AfeAudioProcessor::GetFeedSize() {
     return afe_iface_->get_feed_chunksize(afe_data_);
 }
 
-void AfeAudioProcessor::Feed(std::vector<int16_t>&& data) {
+void AfeAudioProcessor::Feed(std::span<const int16_t> data) {
     if (afe_data_ == nullptr) {
         return;
     }
+    // The AFE copies the chunk into its own ring before returning
     afe_iface_->feed(afe_data_, data.data());
 }
 
@@ -143,24 +145,7 @@ void AfeAudioProcessor::AudioProcessorTask() {
         }
 
         if (output_callback_) {
-            size_t samples = res->data_size / sizeof(int16_t);
-            
-            // Add data to buffer
-            output_buffer_.insert(output_buffer_.end(), res->data, res->data + samples);
-            
-            // Output complete frames when buffer has enough data
-            while (output_buffer_.size() >= frame_samples_) {
-                if (output_buffer_.size() == frame_samples_) {
-                    // If buffer size equals frame size, move the entire buffer
-                    output_callback_(std::move(output_buffer_));
-                    output_buffer_.clear();
-                    output_buffer_.reserve(frame_samples_);
-                } else {
-                    // If buffer size exceeds frame size, copy one frame and remove it
-                    output_callback_(std::vector<int16_t>(output_buffer_.begin(), output_buffer_.begin() + frame_samples_));
-                    output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + frame_samples_);
-                }
-            }
+            assembler_.Append(res->data, res->data_size / sizeof(int16_t), output_callback_);
         }
     }
 }
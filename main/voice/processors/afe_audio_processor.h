@@ -9,9 +9,11 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <atomic>
 
 #include "audio_processor.h"
 #include "audio_codec.h"
+#include "frame_assembler.h"
 
 class AfeAudioProcessor : public AudioProcessor {
 public:
@@ -19,7 +21,8 @@ public:
     ~AfeAudioProcessor();
 
     void Initialize(AudioCodec* codec, int frame_duration_ms) override;
-    void Feed(std::vector<int16_t>&& data) override;
+    void SetFrameDuration(int frame_duration_ms) override;
+    void Feed(std::span<const int16_t> data) override;
     void Start() override;
     void Stop() override;
     bool IsRunning() override;
@@ -35,9 +38,8 @@ private:
     std::function<void(std::vector<int16_t>&& data)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     AudioCodec* codec_ = nullptr;
-    int frame_samples_ = 0;
     bool is_speaking_ = false;
-    std::vector<int16_t> output_buffer_;
+    FrameAssembler assembler_;
 
     void AudioProcessorTask();
 };
@@ -1,17 +1,20 @@
 #include "audio_debugger.h"
 #include "sdkconfig.h"
+#include "latency_trace.h"
 
-#if CONFIG_USE_AUDIO_DEBUGGER
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <errno.h>
+#include <algorithm>
 #include <cstring>
 #include <string>
-#endif
 
 #define TAG "AudioDebugger"
 
+static_assert((AUDIO_DEBUG_TAP_RING_BYTES & (AUDIO_DEBUG_TAP_RING_BYTES - 1)) == 0, "Tap rings must be a power of two");
+static const uint32_t kRingMask = AUDIO_DEBUG_TAP_RING_BYTES - 1;
 
 AudioDebugger::AudioDebugger() {
 #if CONFIG_USE_AUDIO_DEBUGGER
@@ -20,16 +23,16 @@ AudioDebugger::AudioDebugger() {
         // 解析配置的服务器地址 "IP:PORT"
         std::string server_addr = CONFIG_AUDIO_DEBUG_UDP_SERVER;
         size_t colon_pos = server_addr.find(':');
-        
+
         if (colon_pos != std::string::npos) {
             std::string ip = server_addr.substr(0, colon_pos);
             int port = std::stoi(server_addr.substr(colon_pos + 1));
-            
+
             memset(&udp_server_addr_, 0, sizeof(udp_server_addr_));
             udp_server_addr_.sin_family = AF_INET;
             udp_server_addr_.sin_port = htons(port);
             inet_pton(AF_INET, ip.c_str(), &udp_server_addr_.sin_addr);
-            
+
             ESP_LOGI(TAG, "Initialized server address: %s", CONFIG_AUDIO_DEBUG_UDP_SERVER);
         } else {
             ESP_LOGW(TAG, "Invalid server address: %s, should be IP:PORT", CONFIG_AUDIO_DEBUG_UDP_SERVER);
@@ -40,29 +43,179 @@ AudioDebugger::AudioDebugger() {
         ESP_LOGW(TAG, "Failed to create UDP socket: %d", errno);
     }
 #endif
+    if (udp_sockfd_ < 0) {
+        taps_ = 0;
+        return;
+    }
+
+    for (auto& ring : rings_) {
+        ring.buffer = static_cast<uint8_t*>(heap_caps_malloc(AUDIO_DEBUG_TAP_RING_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+        if (ring.buffer == nullptr) {
+            ESP_LOGW(TAG, "Failed to allocate a tap ring");
+        }
+    }
+
+    running_ = true;
+    xTaskCreate([](void* arg) {
+        auto debugger = (AudioDebugger*)arg;
+        debugger->SenderTask();
+        vTaskDelete(NULL);
+    }, "audio_debugger", 4096, this, AUDIO_DEBUG_TASK_PRIORITY, &task_handle_);
 }
 
 AudioDebugger::~AudioDebugger() {
-#if CONFIG_USE_AUDIO_DEBUGGER
+    taps_ = 0;
+    if (task_handle_ != nullptr) {
+        running_ = false;
+        // The sender clears the handle on its way out
+        while (task_handle_ != nullptr) {
+            vTaskDelay(pdMS_TO_TICKS(AUDIO_DEBUG_FLUSH_MS));
+        }
+    }
+    for (auto& ring : rings_) {
+        heap_caps_free(ring.buffer);
+    }
     if (udp_sockfd_ >= 0) {
         close(udp_sockfd_);
         ESP_LOGI(TAG, "Closed UDP socket");
     }
-#endif
 }
 
-void AudioDebugger::Feed(const std::vector<int16_t>& data) {
-#if CONFIG_USE_AUDIO_DEBUGGER
-    if (udp_sockfd_ >= 0) {
-        ssize_t sent = sendto(udp_sockfd_, data.data(), data.size() * sizeof(int16_t), 0,
-                             (struct sockaddr*)&udp_server_addr_, sizeof(udp_server_addr_));
-        if (sent < 0) {
-            ESP_LOGW(TAG, "Failed to send audio data to %s: %d", CONFIG_AUDIO_DEBUG_UDP_SERVER, errno);
-        } else {
-            ESP_LOGD(TAG, "Sent %d bytes audio data to %s", sent, CONFIG_AUDIO_DEBUG_UDP_SERVER);
+void AudioDebugger::SetTaps(uint32_t mask) {
+    if (udp_sockfd_ < 0) {
+        ESP_LOGW(TAG, "No debug server, taps stay off");
+        return;
+    }
+    mask &= (1u << kAudioDebugTapCount) - 1;
+    taps_.store(mask, std::memory_order_relaxed);
+    ESP_LOGI(TAG, "Taps set to 0x%02lx", (unsigned long)mask);
+}
+
+void AudioDebugger::Put(TapRing& ring, uint32_t offset, const void* data, size_t bytes) {
+    uint32_t start = offset & kRingMask;
+    size_t first = std::min<size_t>(bytes, AUDIO_DEBUG_TAP_RING_BYTES - start);
+    memcpy(ring.buffer + start, data, first);
+    memcpy(ring.buffer, static_cast<const uint8_t*>(data) + first, bytes - first);
+}
+
+void AudioDebugger::Get(const TapRing& ring, uint32_t offset, void* data, size_t bytes) {
+    uint32_t start = offset & kRingMask;
+    size_t first = std::min<size_t>(bytes, AUDIO_DEBUG_TAP_RING_BYTES - start);
+    memcpy(data, ring.buffer + start, first);
+    memcpy(static_cast<uint8_t*>(data) + first, ring.buffer, bytes - first);
+}
+
+/*
+ * Records are padded to an even size, so 16-bit samples never straddle the end of the ring.
+ * The sequence number advances for dropped records too, the receiver sees them as gaps.
+ */
+bool AudioDebugger::Reserve(TapRing& ring, size_t bytes, uint32_t& tail) {
+    if (ring.buffer == nullptr) {
+        return false;
+    }
+    size_t need = sizeof(RecordHeader) + ((bytes + 1) & ~static_cast<size_t>(1));
+    tail = ring.tail.load(std::memory_order_relaxed);
+    uint32_t used = tail - ring.head.load(std::memory_order_acquire);
+    if (bytes > UINT16_MAX || need > AUDIO_DEBUG_TAP_RING_BYTES - used) {
+        ring.sequence++;
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void AudioDebugger::Commit(TapRing& ring, uint32_t tail, size_t bytes) {
+    RecordHeader header = { static_cast<uint16_t>(bytes), ring.sequence++, latency_trace_now() };
+    Put(ring, tail, &header, sizeof(header));
+    size_t need = sizeof(RecordHeader) + ((bytes + 1) & ~static_cast<size_t>(1));
+    ring.tail.store(tail + need, std::memory_order_release);
+    records_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioDebugger::Capture(AudioDebugTap tap, const void* data, size_t bytes) {
+    if (!enabled(tap) || bytes == 0) {
+        return;
+    }
+    TapRing& ring = rings_[tap];
+    uint32_t tail;
+    if (!Reserve(ring, bytes, tail)) {
+        return;
+    }
+    Put(ring, tail + sizeof(RecordHeader), data, bytes);
+    Commit(ring, tail, bytes);
+}
+
+void AudioDebugger::CaptureChannel(AudioDebugTap tap, const int16_t* interleaved, size_t frames, int channels, int channel) {
+    if (channels == 1) {
+        Capture(tap, interleaved, frames * sizeof(int16_t));
+        return;
+    }
+    if (!enabled(tap) || frames == 0 || channel >= channels) {
+        return;
+    }
+    TapRing& ring = rings_[tap];
+    uint32_t tail;
+    if (!Reserve(ring, frames * sizeof(int16_t), tail)) {
+        return;
+    }
+    uint32_t offset = tail + sizeof(RecordHeader);
+    for (size_t i = 0; i < frames; i++, offset += sizeof(int16_t)) {
+        memcpy(ring.buffer + (offset & kRingMask), &interleaved[i * channels + channel], sizeof(int16_t));
+    }
+    Commit(ring, tail, frames * sizeof(int16_t));
+}
+
+void AudioDebugger::Drain(AudioDebugTap tap) {
+    TapRing& ring = rings_[tap];
+    if (ring.buffer == nullptr) {
+        return;
+    }
+    uint32_t head = ring.head.load(std::memory_order_relaxed);
+    while (head != ring.tail.load(std::memory_order_acquire)) {
+        RecordHeader record;
+        Get(ring, head, &record, sizeof(record));
+
+        auto datagram = reinterpret_cast<AudioDebugDatagram*>(datagram_.data());
+        datagram->magic = AUDIO_DEBUG_MAGIC;
+        datagram->tap = tap;
+        datagram->sequence = record.sequence;
+        datagram->time_us = record.time_us;
+        datagram->total = record.bytes;
+        const size_t max_fragment = AUDIO_DEBUG_MAX_DATAGRAM - sizeof(AudioDebugDatagram);
+        for (size_t offset = 0; offset < record.bytes; offset += max_fragment) {
+            size_t fragment = std::min<size_t>(max_fragment, record.bytes - offset);
+            datagram->offset = offset;
+            Get(ring, head + sizeof(record) + offset, datagram_.data() + sizeof(AudioDebugDatagram), fragment);
+            ssize_t sent = sendto(udp_sockfd_, datagram_.data(), sizeof(AudioDebugDatagram) + fragment, 0,
+                (struct sockaddr*)&udp_server_addr_, sizeof(udp_server_addr_));
+            if (sent < 0) {
+                send_failures_.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                datagrams_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        head += sizeof(record) + ((record.bytes + 1) & ~1u);
+        ring.head.store(head, std::memory_order_release);
+    }
+}
+
+void AudioDebugger::SenderTask() {
+    ESP_LOGI(TAG, "Audio debugger task started");
+    while (running_) {
+        vTaskDelay(pdMS_TO_TICKS(AUDIO_DEBUG_FLUSH_MS));
+        for (int tap = 0; tap < kAudioDebugTapCount; tap++) {
+            Drain(static_cast<AudioDebugTap>(tap));
         }
     }
-#endif
+    task_handle_ = nullptr;
 }
 
- 
\ No newline at end of file
+AudioDebuggerStatistics AudioDebugger::GetStatistics() const {
+    AudioDebuggerStatistics statistics;
+    statistics.records = records_.load(std::memory_order_relaxed);
+    statistics.dropped = dropped_.load(std::memory_order_relaxed);
+    statistics.datagrams = datagrams_.load(std::memory_order_relaxed);
+    statistics.send_failures = send_failures_.load(std::memory_order_relaxed);
+    return statistics;
+}
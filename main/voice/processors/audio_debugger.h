@@ -1,22 +1,113 @@
 #ifndef AUDIO_DEBUGGER_H
 #define AUDIO_DEBUGGER_H
 
+#include <array>
+#include <atomic>
 #include <vector>
+#include <cstddef>
 #include <cstdint>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 
+/*
+ * Audio taps streamed over UDP to CONFIG_AUDIO_DEBUG_UDP_SERVER.
+ *
+ * Every tap has its own lock-free ring in PSRAM with exactly one producer task (noted below),
+ * so Capture() only copies and never blocks: a record that does not fit is dropped and
+ * counted. A low-priority task drains the rings every AUDIO_DEBUG_FLUSH_MS and sends each
+ * record as one or more datagrams (AudioDebugDatagram header + payload). scripts/
+ * audio_debug_receiver.py turns them back into one file per tap.
+ *
+ * Taps are selected at runtime with SetTaps() (server command "(audio_debug,<mask>)"), so
+ * the debugger can stay compiled in on production devices at no cost while the mask is 0.
+ */
+
+enum AudioDebugTap {
+    kAudioDebugTapMic,          // microphone channel as fed to the processor, 16 kHz (input task)
+    kAudioDebugTapReference,    // reference channel as fed to the processor, 16 kHz (input task)
+    kAudioDebugTapAfeOutput,    // processed frames, 16 kHz (processor task)
+    kAudioDebugTapEncoded,      // uplink Opus packets (encode task)
+    kAudioDebugTapDecoded,      // downlink PCM at the codec output rate (decode task)
+    kAudioDebugTapMixer,        // mixed blocks sent to the codec (output task)
+    kAudioDebugTapCount,
+};
+
+#define AUDIO_DEBUG_DEFAULT_TAPS ((1 << kAudioDebugTapMic) | (1 << kAudioDebugTapReference))
+// Per tap, a power of two. 16 KB hold about 300 ms of 24 kHz PCM
+#define AUDIO_DEBUG_TAP_RING_BYTES (16 * 1024)
+#define AUDIO_DEBUG_FLUSH_MS 20
+#define AUDIO_DEBUG_MAX_DATAGRAM 1024
+#define AUDIO_DEBUG_TASK_PRIORITY 1
+#define AUDIO_DEBUG_MAGIC 0xAD
+
+// Little endian on the wire
+struct __attribute__((packed)) AudioDebugDatagram {
+    uint8_t magic;          // AUDIO_DEBUG_MAGIC
+    uint8_t tap;            // AudioDebugTap
+    uint16_t sequence;      // record number of the tap, a gap means records were dropped
+    uint32_t time_us;       // capture time, esp_timer low 32 bits
+    uint16_t offset;        // offset of this fragment in the record
+    uint16_t total;         // record size in bytes
+};
+
+struct AudioDebuggerStatistics {
+    uint32_t records = 0;   // records captured on all taps
+    uint32_t dropped = 0;   // records that did not fit in their ring
+    uint32_t datagrams = 0;
+    uint32_t send_failures = 0;
+};
+
 class AudioDebugger {
 public:
     AudioDebugger();
     ~AudioDebugger();
 
-    void Feed(const std::vector<int16_t>& data);
+    void SetTaps(uint32_t mask);
+    uint32_t taps() const { return taps_.load(std::memory_order_relaxed); }
+    bool enabled(AudioDebugTap tap) const { return (taps() & (1u << tap)) != 0; }
+
+    // Real-time safe, from the tap's producer task only
+    void Capture(AudioDebugTap tap, const void* data, size_t bytes);
+    // One channel of interleaved PCM
+    void CaptureChannel(AudioDebugTap tap, const int16_t* interleaved, size_t frames, int channels, int channel);
+
+    AudioDebuggerStatistics GetStatistics() const;
 
 private:
+    struct RecordHeader {
+        uint16_t bytes;
+        uint16_t sequence;
+        uint32_t time_us;
+    };
+
+    struct TapRing {
+        uint8_t* buffer = nullptr;
+        std::atomic<uint32_t> head{0};  // consumer, free-running byte offsets
+        std::atomic<uint32_t> tail{0};  // producer
+        uint16_t sequence = 0;          // producer
+    };
+
     int udp_sockfd_ = -1;
     struct sockaddr_in udp_server_addr_;
+    std::atomic<uint32_t> taps_{AUDIO_DEBUG_DEFAULT_TAPS};
+    std::array<TapRing, kAudioDebugTapCount> rings_;
+    std::array<uint8_t, AUDIO_DEBUG_MAX_DATAGRAM> datagram_;
+    TaskHandle_t task_handle_ = nullptr;
+    std::atomic<bool> running_{false};
+    std::atomic<uint32_t> records_{0};
+    std::atomic<uint32_t> dropped_{0};
+    std::atomic<uint32_t> datagrams_{0};
+    std::atomic<uint32_t> send_failures_{0};
+
+    bool Reserve(TapRing& ring, size_t bytes, uint32_t& tail);
+    void Commit(TapRing& ring, uint32_t tail, size_t bytes);
+    static void Put(TapRing& ring, uint32_t offset, const void* data, size_t bytes);
+    static void Get(const TapRing& ring, uint32_t offset, void* data, size_t bytes);
+    void SenderTask();
+    void Drain(AudioDebugTap tap);
 };
 
-#endif 
\ No newline at end of file
+#endif
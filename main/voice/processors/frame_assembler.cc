@@ -0,0 +1,43 @@
+#include "frame_assembler.h"
+
+#include <algorithm>
+
+void FrameAssembler::Initialize(size_t frame_samples) {
+    frame_samples_ = frame_samples;
+    frame_.reserve(frame_samples);
+}
+
+void FrameAssembler::Append(const int16_t* data, size_t samples, const Output& output) {
+    while (true) {
+        size_t frame_samples = frame_samples_;
+        if (frame_.size() >= frame_samples) {
+            Emit(frame_samples, output);
+            continue;
+        }
+        if (samples == 0) {
+            break;
+        }
+        if (frame_.capacity() < frame_samples) {
+            // Only when the consumer kept the buffer instead of giving one back
+            frame_.reserve(frame_samples);
+        }
+        size_t n = std::min(samples, frame_samples - frame_.size());
+        frame_.insert(frame_.end(), data, data + n);
+        data += n;
+        samples -= n;
+    }
+}
+
+void FrameAssembler::Emit(size_t frame_samples, const Output& output) {
+    if (frame_.size() > frame_samples) {
+        // The frame duration shrank while this frame was filling, the excess starts the next one
+        carry_.assign(frame_.begin() + frame_samples, frame_.end());
+        frame_.resize(frame_samples);
+    }
+    output(std::move(frame_));
+    frame_.clear();
+    if (!carry_.empty()) {
+        frame_.insert(frame_.end(), carry_.begin(), carry_.end());
+        carry_.clear();
+    }
+}
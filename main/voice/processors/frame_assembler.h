@@ -0,0 +1,40 @@
+#ifndef FRAME_ASSEMBLER_H
+#define FRAME_ASSEMBLER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/*
+ * Cuts a stream of fetches of any size into frames of frame_samples().
+ *
+ * Each fetch is copied once, straight into the frame being assembled. A complete frame is
+ * handed to the output callback by rvalue reference: the consumer swaps it with an empty
+ * pooled buffer, which becomes the next frame, so in steady state nothing is erased,
+ * copied again or allocated, whatever the fetch size.
+ *
+ * Append() belongs to one task; SetFrameSamples() is safe from any task and takes effect
+ * on the next frame. Samples already buffered are cut at the new size, nothing is dropped.
+ */
+class FrameAssembler {
+public:
+    using Output = std::function<void(std::vector<int16_t>&& frame)>;
+
+    // Sets the frame size and reserves the first frame, before Append() is first called
+    void Initialize(size_t frame_samples);
+    void SetFrameSamples(size_t frame_samples) { frame_samples_ = frame_samples; }
+    size_t frame_samples() const { return frame_samples_; }
+
+    void Append(const int16_t* data, size_t samples, const Output& output);
+
+private:
+    std::atomic<size_t> frame_samples_{0};
+    std::vector<int16_t> frame_;        // output frame being assembled
+    std::vector<int16_t> carry_;        // samples beyond a frame after the frame duration shrank
+
+    void Emit(size_t frame_samples, const Output& output);
+};
+
+#endif // FRAME_ASSEMBLER_H
@@ -6,23 +6,29 @@
 void NoAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms) {
     codec_ = codec;
     frame_samples_ = frame_duration_ms * 16000 / 1000;
+    frame_.reserve(frame_samples_);
 }
 
-void NoAudioProcessor::Feed(std::vector<int16_t>&& data) {
+void NoAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    frame_samples_ = frame_duration_ms * 16000 / 1000;
+}
+
+void NoAudioProcessor::Feed(std::span<const int16_t> data) {
     if (!is_running_ || !output_callback_) {
         return;
     }
 
     if (codec_->input_channels() == 2) {
         // If input channels is 2, we need to fetch the left channel data
-        auto mono_data = std::vector<int16_t>(data.size() / 2);
-        for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-            mono_data[i] = data[j];
+        frame_.resize(data.size() / 2);
+        for (size_t i = 0, j = 0; i < frame_.size(); ++i, j += 2) {
+            frame_[i] = data[j];
         }
-        output_callback_(std::move(mono_data));
     } else {
-        output_callback_(std::move(data));
+        frame_.assign(data.begin(), data.end());
     }
+    output_callback_(std::move(frame_));
+    frame_.clear();
 }
 
 void NoAudioProcessor::Start() {
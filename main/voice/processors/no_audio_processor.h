@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <functional>
+#include <atomic>
 
 #include "audio_processor.h"
 #include "audio_codec.h"
@@ -13,7 +14,8 @@ public:
     ~NoAudioProcessor() = default;
 
     void Initialize(AudioCodec* codec, int frame_duration_ms) override;
-    void Feed(std::vector<int16_t>&& data) override;
+    void SetFrameDuration(int frame_duration_ms) override;
+    void Feed(std::span<const int16_t> data) override;
     void Start() override;
     void Stop() override;
     bool IsRunning() override;
@@ -24,10 +26,12 @@ public:
 
 private:
     AudioCodec* codec_ = nullptr;
-    int frame_samples_ = 0;
+    std::atomic<int> frame_samples_{0};
     std::function<void(std::vector<int16_t>&& data)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     bool is_running_ = false;
+    // Output frame, swapped with a pooled buffer by the output callback
+    std::vector<int16_t> frame_;
 };
 
 #endif 
@@ -0,0 +1,114 @@
+// Generated by scripts/gen_resampler_filters.py, do not edit
+#ifndef RESAMPLER_FILTERS_H
+#define RESAMPLER_FILTERS_H
+
+#include <cstdint>
+
+// Kaiser beta 9.3, cutoff 7500 Hz, every phase reversed and summing to 1.0
+#define POLYPHASE_COEFFICIENT_BITS 15
+#define POLYPHASE_WIDE_COEFFICIENT_BITS 30
+
+// 16000 Hz -> 24000 Hz: L = 3, M = 2, ripple 0.00 dB to 6000 Hz, 88 dB (Q15) / 94 dB (Q30) above 9000 Hz
+alignas(4) static const int16_t kPolyphaseBank16kTo24k[3][32] = {
+    {
+        1, -5, 15, -36, 74, -134, 218, -322, 436, -537, 589, -533,
+        271, 434, -2535, 29488, 7844, -4146, 2818, -2005, 1412, -961, 620, -374,
+        206, -101, 43, -14, 2, 1, -1, 0,
+    },
+    {
+        1, -4, 11, -23, 38, -53, 56, -31, -48, 215, -518, 1024,
+        -1853, 3296, -6397, 20670, 20670, -6397, 3296, -1854, 1024, -519, 216, -48,
+        -31, 56, -52, 38, -23, 11, -4, 1,
+    },
+    {
+        0, -1, 1, 2, -14, 43, -102, 207, -374, 620, -960, 1413,
+        -2005, 2818, -4146, 7844, 29488, -2535, 435, 270, -533, 587, -537, 436,
+        -322, 217, -133, 74, -36, 15, -5, 1,
+    },
+};
+alignas(4) static const int32_t kPolyphaseWideBank16kTo24k[3][32] = {
+    {
+        36965, -165847, 498160, -1191344, 2430365, -4381484, 7120949, -10546692,
+        14285356, -17602076, 19295017, -17476598, 8859600, 14235715, -83034019, 966218837,
+        257040279, -135842726, 92327130, -65714307, 46299053, -31475578, 20304402, -12240245,
+        6771614, -3348337, 1412683, -457396, 73199, 29800, -27662, 7011,
+    },
+    {
+        32131, -139962, 369646, -750740, 1250839, -1718929, 1824733, -1005605,
+        -1572585, 7051863, -16969348, 33555713, -60751608, 107993909, -209597246, 677298226,
+        677297976, -209597246, 107993909, -60751608, 33555713, -16969348, 7051863, -1572585,
+        -1005605, 1824733, -1718929, 1250839, -750740, 369646, -139962, 32131,
+    },
+    {
+        7011, -27662, 29800, 73199, -457396, 1412683, -3348337, 6771614,
+        -12240245, 20304402, -31475578, 46299053, -65714307, 92327130, -135842726, 257040279,
+        966218837, -83034019, 14235715, 8859600, -17476598, 19295017, -17602076, 14285356,
+        -10546692, 7120949, -4381484, 2430365, -1191344, 498160, -165847, 36965,
+    },
+};
+
+// 24000 Hz -> 16000 Hz: L = 2, M = 3, ripple 0.00 dB to 6000 Hz, 83 dB (Q15) / 94 dB (Q30) above 9000 Hz
+alignas(4) static const int16_t kPolyphaseBank24kTo16k[2][48] = {
+    {
+        1, 0, -3, 8, 2, -24, 25, 29, -89, 37, 138, -214,
+        -32, 413, -358, -345, 942, -355, -1236, 1878, 289, -4264, 5230, 19656,
+        13778, -1689, -2764, 2196, 180, -1337, 682, 393, -640, 143, 290, -249,
+        -20, 145, -68, -35, 49, -10, -15, 11, 1, -2, 1, 0,
+    },
+    {
+        0, 1, -2, 1, 11, -15, -10, 49, -35, -68, 145, -20,
+        -249, 290, 143, -640, 393, 683, -1337, 180, 2196, -2764, -1689, 13779,
+        19656, 5229, -4264, 289, 1878, -1236, -356, 942, -344, -358, 412, -32,
+        -214, 138, 37, -89, 29, 25, -24, 2, 8, -3, 0, 1,
+    },
+};
+alignas(4) static const int32_t kPolyphaseWideBank24kTo16k[2][48] = {
+    {
+        21421, -18441, -110565, 246431, 48799, -794229, 833893, 941789,
+        -2920989, 1216489, 4514409, -7031128, -1048390, 13536268, -11734717, -11312899,
+        30866035, -11651065, -40501072, 61551420, 9490476, -139731497, 171360186, 644145809,
+        451532151, -55356013, -90561817, 71995939, 5906400, -43809538, 22370475, 12863344,
+        -20983719, 4701242, 9523571, -8160163, -670403, 4747299, -2232225, -1145953,
+        1620243, -304931, -500494, 332106, 19867, -93308, 24644, 4674,
+    },
+    {
+        4674, 24644, -93308, 19867, 332106, -500494, -304931, 1620243,
+        -1145953, -2232225, 4747299, -670403, -8160163, 9523571, 4701242, -20983719,
+        12863344, 22370475, -43809538, 5906400, 71995939, -90561817, -55356013, 451532151,
+        644145809, 171360186, -139731497, 9490476, 61551420, -40501072, -11651065, 30866035,
+        -11312899, -11734717, 13536268, -1048390, -7031128, 4514409, 1216489, -2920989,
+        941789, 833893, -794229, 48799, 246431, -110565, -18441, 21421,
+    },
+};
+
+// 48000 Hz -> 16000 Hz: L = 1, M = 3, ripple 0.00 dB to 6000 Hz, 79 dB (Q15) / 94 dB (Q30) above 9000 Hz
+alignas(4) static const int16_t kPolyphaseBank48kTo16k[1][96] = {
+    {
+        0, 0, 0, 0, -1, -2, 0, 3, 5, 1, -7, -12,
+        -5, 12, 24, 14, -17, -44, -34, 18, 72, 69, -10, -107,
+        -124, -16, 146, 207, 72, -179, -321, -173, 196, 471, 341, -178,
+        -669, -618, 91, 940, 1099, 145, -1382, -2132, -844, 2615, 6890, 9829,
+        9829, 6890, 2615, -844, -2132, -1382, 145, 1099, 940, 91, -618, -669,
+        -178, 341, 471, 196, -173, -321, -179, 72, 207, 145, -17, -125,
+        -107, -10, 69, 72, 17, -35, -45, -17, 15, 25, 12, -5,
+        -12, -7, 1, 5, 3, -1, -2, -1, 1, 1, 1, 0,
+    },
+};
+alignas(4) static const int32_t kPolyphaseWideBank48kTo16k[1][96] = {
+    {
+        2337, 10710, 12322, -9221, -46654, -55282, 9933, 123215,
+        166053, 24400, -250247, -397115, -152465, 416946, 810122, 470894,
+        -572976, -1460495, -1116112, 608244, 2373650, 2257205, -335202, -3515564,
+        -4080082, -524195, 4761785, 6768134, 2350621, -5867359, -10491859, -5656449,
+        6431672, 15433018, 11185238, -5825533, -21904769, -20250536, 2953200, 30775710,
+        35997970, 4745238, -45280909, -69865749, -27678006, 85680093, 225766075, 322072904,
+        322072908, 225766075, 85680093, -27678006, -69865749, -45280909, 4745238, 35997970,
+        30775710, 2953200, -20250536, -21904769, -5825533, 11185238, 15433018, 6431672,
+        -5656449, -10491859, -5867359, 2350621, 6768134, 4761785, -524195, -4080082,
+        -3515564, -335202, 2257205, 2373650, 608244, -1116112, -1460495, -572976,
+        470894, 810122, 416946, -152465, -397115, -250247, 24400, 166053,
+        123215, 9933, -55282, -46654, -9221, 12322, 10710, 2337,
+    },
+};
+
+#endif // RESAMPLER_FILTERS_H
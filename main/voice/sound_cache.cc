@@ -0,0 +1,88 @@
+#include "sound_cache.h"
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+#include "metrics.h"
+
+#define TAG "SoundCache"
+
+METRICS_COUNTER(metric_hits, "audio.sound_cache_hits");
+
+
+SoundClip::~SoundClip() {
+    if (pcm != nullptr) {
+        heap_caps_free(pcm);
+    }
+}
+
+void SoundCache::SetBudget(size_t bytes) {
+    metrics_register(&metric_hits);
+    budget_bytes_.store(bytes, std::memory_order_relaxed);
+    EvictUntil(bytes);
+}
+
+std::shared_ptr<const SoundClip> SoundCache::Find(const void* key, size_t key_size) {
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if ((*it)->key == key && (*it)->key_size == key_size) {
+            entries_.splice(entries_.begin(), entries_, it);
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            metrics_counter_add(&metric_hits, 1);
+            return entries_.front();
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+void SoundCache::Insert(const void* key, size_t key_size, const int16_t* pcm, size_t samples) {
+    size_t bytes = samples * sizeof(int16_t);
+    size_t budget = budget_bytes_.load(std::memory_order_relaxed);
+    if (bytes == 0 || bytes > budget) {
+        return;
+    }
+    for (const auto& entry : entries_) {
+        if (entry->key == key && entry->key_size == key_size) {
+            return;
+        }
+    }
+
+    EvictUntil(budget - bytes);
+    auto clip = std::make_shared<SoundClip>();
+    clip->pcm = static_cast<int16_t*>(heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (clip->pcm == nullptr) {
+        ESP_LOGW(TAG, "Failed to allocate %u bytes for a decoded sound", (unsigned int)bytes);
+        return;
+    }
+    std::memcpy(clip->pcm, pcm, bytes);
+    clip->key = key;
+    clip->key_size = key_size;
+    clip->samples = samples;
+    size_t used = used_bytes_.load(std::memory_order_relaxed) + bytes;
+    used_bytes_.store(used, std::memory_order_relaxed);
+    entries_.push_front(std::move(clip));
+    entry_count_.store(entries_.size(), std::memory_order_relaxed);
+    ESP_LOGD(TAG, "Cached sound %p, %u bytes, %u / %u used", key, (unsigned int)bytes,
+        (unsigned int)used, (unsigned int)budget);
+}
+
+void SoundCache::EvictUntil(size_t budget) {
+    size_t used = used_bytes_.load(std::memory_order_relaxed);
+    while (used > budget && !entries_.empty()) {
+        used -= entries_.back()->bytes();
+        entries_.pop_back();
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    used_bytes_.store(used, std::memory_order_relaxed);
+    entry_count_.store(entries_.size(), std::memory_order_relaxed);
+}
+
+SoundCacheStatistics SoundCache::GetStatistics() const {
+    SoundCacheStatistics statistics;
+    statistics.hits = hits_.load(std::memory_order_relaxed);
+    statistics.misses = misses_.load(std::memory_order_relaxed);
+    statistics.evictions = evictions_.load(std::memory_order_relaxed);
+    statistics.entries = entry_count_.load(std::memory_order_relaxed);
+    statistics.used_bytes = used_bytes_.load(std::memory_order_relaxed);
+    statistics.budget_bytes = budget_bytes_.load(std::memory_order_relaxed);
+    return statistics;
+}
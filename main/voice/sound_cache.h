@@ -0,0 +1,70 @@
+#ifndef SOUND_CACHE_H
+#define SOUND_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+
+/*
+ * LRU cache of decoded system sounds.
+ *
+ * Entries hold mono PCM already at the codec output rate, keyed by the address and size
+ * of the Ogg asset in flash. The PCM lives in PSRAM and the cache evicts the least recently
+ * played sounds to stay within its byte budget. Clips are shared_ptr, so an evicted clip
+ * stays valid until the sound playing from it finishes.
+ *
+ * Only the decode task uses the cache; GetStatistics() may be called from any task.
+ */
+
+struct SoundClip {
+    const void* key = nullptr;
+    size_t key_size = 0;
+    int16_t* pcm = nullptr;
+    size_t samples = 0;
+
+    SoundClip() = default;
+    SoundClip(const SoundClip&) = delete;
+    SoundClip& operator=(const SoundClip&) = delete;
+    ~SoundClip();
+
+    inline size_t bytes() const { return samples * sizeof(int16_t); }
+};
+
+struct SoundCacheStatistics {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+    uint32_t entries = 0;
+    size_t used_bytes = 0;
+    size_t budget_bytes = 0;
+};
+
+class SoundCache {
+public:
+    // 0 disables the cache
+    void SetBudget(size_t bytes);
+    bool enabled() const { return budget_bytes_.load(std::memory_order_relaxed) > 0; }
+    size_t budget_bytes() const { return budget_bytes_.load(std::memory_order_relaxed); }
+
+    std::shared_ptr<const SoundClip> Find(const void* key, size_t key_size);
+    void Insert(const void* key, size_t key_size, const int16_t* pcm, size_t samples);
+
+    SoundCacheStatistics GetStatistics() const;
+
+private:
+    // Front is the most recently used, only touched by the decode task
+    std::list<std::shared_ptr<SoundClip>> entries_;
+    // Written by the decode task, read by GetStatistics() from any task
+    std::atomic<size_t> budget_bytes_{0};
+    std::atomic<size_t> used_bytes_{0};
+    std::atomic<uint32_t> entry_count_{0};
+    std::atomic<uint32_t> hits_{0};
+    std::atomic<uint32_t> misses_{0};
+    std::atomic<uint32_t> evictions_{0};
+
+    void EvictUntil(size_t budget);
+};
+
+#endif // SOUND_CACHE_H
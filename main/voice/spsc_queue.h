@@ -0,0 +1,102 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+/*
+ * Bounded single-producer / single-consumer ring.
+ *
+ * Exactly one task may call Push() and exactly one task may call Pop() / Clear().
+ * RequestClear(), Size() and Empty() are safe from any task; the actual discard of
+ * the items queued before RequestClear() is performed lazily by the consumer on its
+ * next Pop() (or ApplyRequestedClear()), so nothing is destroyed behind the consumer's back.
+ *
+ * Wakeups are not handled here: callers pair each ring with a task notification
+ * to the task on the other side.
+ */
+template <typename T, size_t Capacity>
+class SpscQueue {
+public:
+    static_assert(Capacity > 0, "SpscQueue capacity must be positive");
+
+    bool Push(T&& item) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= Capacity) {
+            return false;
+        }
+        slots_[tail & kMask] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(T& item) {
+        if (clear_requested_.exchange(false, std::memory_order_acq_rel)) {
+            DiscardUntil(clear_mark_.load(std::memory_order_acquire));
+        }
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(slots_[head & kMask]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    void Clear() {
+        clear_requested_.store(false, std::memory_order_relaxed);
+        DiscardUntil(tail_.load(std::memory_order_acquire));
+    }
+
+    // Consumer: carry out a pending RequestClear() without taking an item
+    void ApplyRequestedClear() {
+        if (clear_requested_.exchange(false, std::memory_order_acq_rel)) {
+            DiscardUntil(clear_mark_.load(std::memory_order_acquire));
+        }
+    }
+
+    // Drop everything pushed so far; items pushed afterwards are kept
+    void RequestClear() {
+        clear_mark_.store(tail_.load(std::memory_order_acquire), std::memory_order_release);
+        clear_requested_.store(true, std::memory_order_release);
+    }
+
+    size_t Size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    bool Empty() const { return Size() == 0; }
+    bool Full() const { return Size() >= Capacity; }
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    static constexpr size_t RoundUpPow2(size_t n) {
+        size_t p = 1;
+        while (p < n) {
+            p <<= 1;
+        }
+        return p;
+    }
+    static constexpr size_t kSlots = RoundUpPow2(Capacity);
+    static constexpr uint32_t kMask = kSlots - 1;
+
+    void DiscardUntil(uint32_t mark) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        while (static_cast<int32_t>(mark - head) > 0 && head != tail_.load(std::memory_order_acquire)) {
+            T discarded = std::move(slots_[head & kMask]);
+            (void)discarded;
+            head_.store(++head, std::memory_order_release);
+        }
+    }
+
+    std::array<T, kSlots> slots_{};
+    // Free-running counters, the slot index is counter & kMask
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+    std::atomic<uint32_t> clear_mark_{0};
+    std::atomic<bool> clear_requested_{false};
+};
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,27 @@
+#ifndef STEREO_PCM_H
+#define STEREO_PCM_H
+
+#include <cstdint>
+
+/*
+ * Channel split / merge for the 16-bit stereo input (mic + reference). One 32-bit load or
+ * store covers a whole frame. The esp-dsp add kernels only use PIE for unit-stride data, and
+ * their strided path reads one element past the input, so they do not help here.
+ */
+static inline void DeinterleaveStereo(const int16_t* interleaved, int16_t* left, int16_t* right, int frames) {
+    const uint32_t* in = reinterpret_cast<const uint32_t*>(interleaved);
+    for (int i = 0; i < frames; i++) {
+        uint32_t frame = in[i];
+        left[i] = static_cast<int16_t>(frame & 0xFFFF);
+        right[i] = static_cast<int16_t>(frame >> 16);
+    }
+}
+
+static inline void InterleaveStereo(const int16_t* left, const int16_t* right, int16_t* interleaved, int frames) {
+    uint32_t* out = reinterpret_cast<uint32_t*>(interleaved);
+    for (int i = 0; i < frames; i++) {
+        out[i] = static_cast<uint16_t>(left[i]) | (static_cast<uint32_t>(static_cast<uint16_t>(right[i])) << 16);
+    }
+}
+
+#endif // STEREO_PCM_H
@@ -0,0 +1,118 @@
+#include "uplink_gate.h"
+
+#include <algorithm>
+#include <cstring>
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include "metrics.h"
+
+#define TAG "UplinkGate"
+
+METRICS_COUNTER(metric_gated_frames, "audio.uplink_gated_frames");
+METRICS_COUNTER(metric_opens, "audio.uplink_gate_opens");
+
+UplinkGate::~UplinkGate() {
+    heap_caps_free(ring_);
+}
+
+bool UplinkGate::Initialize(int sample_rate) {
+    metrics_register(&metric_gated_frames);
+    metrics_register(&metric_opens);
+    heap_caps_free(ring_);
+    capacity_ = static_cast<size_t>(sample_rate) * UPLINK_GATE_PREROLL_MS / 1000;
+    ring_ = static_cast<int16_t*>(heap_caps_malloc(capacity_ * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    write_ = 0;
+    count_ = 0;
+    if (ring_ == nullptr) {
+        ESP_LOGW(TAG, "Failed to allocate %u samples of pre-roll", (unsigned int)capacity_);
+        capacity_ = 0;
+        return false;
+    }
+    return true;
+}
+
+UplinkGateAction UplinkGate::Next(bool speech, int frame_duration_ms) {
+    const uint32_t frame_ms = frame_duration_ms > 0 ? frame_duration_ms : 0;
+
+    if (speech || !enabled()) {
+        hangover_ms_ = UPLINK_GATE_HANGOVER_MS;
+        if (open_) {
+            return kUplinkGateSend;
+        }
+        open_ = true;
+        opens_.fetch_add(1, std::memory_order_relaxed);
+        metrics_counter_add(&metric_opens, 1);
+        return kUplinkGateOpen;
+    }
+
+    if (open_) {
+        if (hangover_ms_ >= frame_ms && frame_ms > 0) {
+            hangover_ms_ -= frame_ms;
+            return kUplinkGateSend;
+        }
+        // Hang-over elapsed, the pre-roll starts over from this frame
+        open_ = false;
+        write_ = 0;
+        count_ = 0;
+        marker_ms_ = 0;
+    }
+
+    gated_frames_.fetch_add(1, std::memory_order_relaxed);
+    metrics_counter_add(&metric_gated_frames, 1);
+    if (marker_ms_ > frame_ms) {
+        marker_ms_ -= frame_ms;
+        return kUplinkGateHold;
+    }
+    marker_ms_ = UPLINK_GATE_MARKER_MS;
+    markers_.fetch_add(1, std::memory_order_relaxed);
+    return kUplinkGateHoldWithMarker;
+}
+
+void UplinkGate::Hold(const std::vector<int16_t>& pcm) {
+    if (capacity_ == 0) {
+        return;
+    }
+    const int16_t* data = pcm.data();
+    size_t samples = pcm.size();
+    if (samples > capacity_) {
+        data += samples - capacity_;
+        samples = capacity_;
+    }
+    size_t first = std::min(samples, capacity_ - write_);
+    memcpy(ring_ + write_, data, first * sizeof(int16_t));
+    memcpy(ring_, data + first, (samples - first) * sizeof(int16_t));
+    write_ = (write_ + samples) % capacity_;
+    count_ = std::min(count_ + samples, capacity_);
+}
+
+bool UplinkGate::TakePreroll(std::vector<int16_t>& frame, size_t frame_samples) {
+    if (frame_samples == 0 || count_ < frame_samples) {
+        count_ = 0;
+        return false;
+    }
+    // Only whole frames go out, a partial one at the old end is the least useful
+    count_ -= count_ % frame_samples;
+    size_t read = (write_ + capacity_ - count_) % capacity_;
+    size_t first = std::min(frame_samples, capacity_ - read);
+    frame.resize(frame_samples);
+    memcpy(frame.data(), ring_ + read, first * sizeof(int16_t));
+    memcpy(frame.data() + first, ring_, (frame_samples - first) * sizeof(int16_t));
+    count_ -= frame_samples;
+    preroll_frames_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+UplinkGateStatistics UplinkGate::GetStatistics() const {
+    UplinkGateStatistics statistics;
+    statistics.gated_frames = gated_frames_.load(std::memory_order_relaxed);
+    statistics.opens = opens_.load(std::memory_order_relaxed);
+    statistics.preroll_frames = preroll_frames_.load(std::memory_order_relaxed);
+    statistics.markers = markers_.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+uint8_t UplinkGate::MarkerToc(int frame_duration_ms) {
+    // RFC 6716 configs 9 / 10 / 11: SILK-only wideband 20 / 40 / 60 ms, mono, one frame
+    int config = frame_duration_ms >= 60 ? 11 : frame_duration_ms >= 40 ? 10 : 9;
+    return static_cast<uint8_t>(config << 3);
+}
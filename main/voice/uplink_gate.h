@@ -0,0 +1,79 @@
+#ifndef UPLINK_GATE_H
+#define UPLINK_GATE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * VAD gate for the uplink.
+ *
+ * While nobody speaks the encode task neither encodes nor sends the processed frames. They
+ * go into a short pre-roll ring instead. When the VAD reports speech the gate opens: the
+ * pre-roll is encoded and sent first, so the word onset the VAD needed to decide is not cut,
+ * then the live frames follow. After speech ends the gate stays open for the hang-over time,
+ * so pauses between words are streamed normally. Once it closes, a one-byte Opus DTX packet
+ * is sent every UPLINK_GATE_MARKER_MS. The server's decoder turns it into comfort noise and
+ * can tell a quiet device from a dead link.
+ *
+ * Next() / Hold() / TakePreroll() are called by the encode task only, SetEnabled() and
+ * GetStatistics() from any task. A disabled gate is always open.
+ */
+
+#define UPLINK_GATE_PREROLL_MS 300
+#define UPLINK_GATE_HANGOVER_MS 600
+#define UPLINK_GATE_MARKER_MS 400
+
+enum UplinkGateAction {
+    kUplinkGateSend,            // gate open, encode and send the frame
+    kUplinkGateOpen,            // speech started: send the pre-roll, then the frame
+    kUplinkGateHold,            // gate closed, Hold() the frame
+    kUplinkGateHoldWithMarker,  // gate closed, Hold() the frame and send a DTX marker
+};
+
+struct UplinkGateStatistics {
+    uint32_t gated_frames = 0;      // frames not encoded
+    uint32_t opens = 0;             // speech onsets
+    uint32_t preroll_frames = 0;    // frames sent ahead of an onset
+    uint32_t markers = 0;           // DTX markers sent
+};
+
+class UplinkGate {
+public:
+    UplinkGate() = default;
+    ~UplinkGate();
+    UplinkGate(const UplinkGate&) = delete;
+    UplinkGate& operator=(const UplinkGate&) = delete;
+
+    // Pre-roll ring in PSRAM, sample_rate is the rate of the frames given to Hold()
+    bool Initialize(int sample_rate);
+    void SetEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    UplinkGateAction Next(bool speech, int frame_duration_ms);
+    void Hold(const std::vector<int16_t>& pcm);
+    // Oldest first, whole frames of frame_samples only. False when the pre-roll is used up
+    bool TakePreroll(std::vector<int16_t>& frame, size_t frame_samples);
+
+    UplinkGateStatistics GetStatistics() const;
+
+    // TOC-only Opus packet (a zero-length SILK wideband frame) of the given duration
+    static uint8_t MarkerToc(int frame_duration_ms);
+
+private:
+    std::atomic<bool> enabled_{false};
+    bool open_ = true;
+    uint32_t hangover_ms_ = 0;
+    uint32_t marker_ms_ = 0;        // time until the next marker
+    int16_t* ring_ = nullptr;
+    size_t capacity_ = 0;
+    size_t write_ = 0;              // next sample to write
+    size_t count_ = 0;              // samples held
+    std::atomic<uint32_t> gated_frames_{0};
+    std::atomic<uint32_t> opens_{0};
+    std::atomic<uint32_t> preroll_frames_{0};
+    std::atomic<uint32_t> markers_{0};
+};
+
+#endif // UPLINK_GATE_H
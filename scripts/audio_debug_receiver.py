@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""
+Receive the AudioDebugger taps and write one file per tap
+
+The device sends every captured record as one or more UDP datagrams, each starting with
+
+    uint8 magic (0xAD), uint8 tap, uint16 sequence, uint32 time_us, uint16 offset, uint16 total
+
+(little endian) followed by the fragment. PCM taps are written as 16-bit mono WAV files, the
+encoded tap as <tap>.opus.bin: every Opus packet prefixed with its length (uint16 LE). Gaps
+in a tap's sequence numbers are records the device dropped because its ring was full; they are
+filled with silence in the WAV files so the taps stay aligned, and counted in the summary.
+
+Select taps on the device with the server command "(audio_debug,<mask>)":
+    1 mic, 2 reference, 4 AFE output, 8 encoded, 16 decoded, 32 mixer output
+
+Usage:
+    ./audio_debug_receiver.py [--port 8000] [--output-rate 24000] [-d captures/]
+    (Ctrl+C to stop and finish the files)
+"""
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import wave
+
+
+HEADER = struct.Struct("<BBHIHH")
+MAGIC = 0xAD
+TAPS = ["mic", "reference", "afe_output", "encoded", "decoded", "mixer"]
+ENCODED = 3
+
+
+class Tap:
+    def __init__(self, index, directory, rate):
+        self.name = TAPS[index] if index < len(TAPS) else f"tap{index}"
+        self.encoded = index == ENCODED
+        self.records = 0
+        self.lost = 0
+        self.last_sequence = None
+        self.last_size = 0
+        self.pending = {}
+        if self.encoded:
+            self.file = open(os.path.join(directory, f"{self.name}.opus.bin"), "wb")
+        else:
+            self.file = wave.open(os.path.join(directory, f"{self.name}.wav"), "wb")
+            self.file.setnchannels(1)
+            self.file.setsampwidth(2)
+            self.file.setframerate(rate)
+
+    def fragment(self, sequence, offset, total, payload):
+        record = self.pending.setdefault(sequence, [bytearray(total), 0])
+        record[0][offset:offset + len(payload)] = payload
+        record[1] += len(payload)
+        if record[1] >= total:
+            del self.pending[sequence]
+            self.record(sequence, bytes(record[0]))
+
+    def record(self, sequence, data):
+        if self.last_sequence is not None:
+            gap = (sequence - self.last_sequence - 1) & 0xFFFF
+            if gap > 0x8000:
+                return  # reordered duplicate
+            self.lost += gap
+            if gap and not self.encoded:
+                self.file.writeframes(bytes(self.last_size * gap))
+        self.last_sequence = sequence
+        self.last_size = len(data)
+        self.records += 1
+        if self.encoded:
+            self.file.write(struct.pack("<H", len(data)) + data)
+        else:
+            self.file.writeframes(data)
+
+    def close(self):
+        self.file.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Receive AudioDebugger taps over UDP")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--rate", type=int, default=16000, help="rate of the mic, reference and AFE taps")
+    parser.add_argument("--output-rate", type=int, default=24000, help="codec output rate (decoded and mixer taps)")
+    parser.add_argument("-d", "--directory", default=".")
+    args = parser.parse_args()
+
+    os.makedirs(args.directory, exist_ok=True)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("0.0.0.0", args.port))
+    print(f"Listening on UDP {args.port}, writing to {args.directory}")
+
+    taps = {}
+    try:
+        while True:
+            datagram, _ = sock.recvfrom(2048)
+            if len(datagram) < HEADER.size:
+                continue
+            magic, index, sequence, _time_us, offset, total = HEADER.unpack_from(datagram)
+            if magic != MAGIC:
+                continue
+            if index not in taps:
+                rate = args.output_rate if index >= 4 else args.rate
+                taps[index] = Tap(index, args.directory, rate)
+                print(f"Receiving {taps[index].name}")
+            taps[index].fragment(sequence, offset, total, datagram[HEADER.size:])
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for tap in taps.values():
+            tap.close()
+            print(f"{tap.name}: {tap.records} records, {tap.lost} lost")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+"""
+Generate the polyphase filter banks used by PolyphaseResampler
+
+Every supported ratio L/M runs its input through one Kaiser-windowed sinc low-pass at
+L * input rate (48 kHz for all of them) with the cutoff at CUTOFF_HZ. The prototype is split
+into L phases of TAPS_PER_PHASE[L] taps, each phase is reversed (so the device computes a
+forward dot product over its history buffer) and scaled to a DC gain of exactly 1.0.
+
+Each ratio gets two banks: Q15 for the MAC16 kernel and Q30 for the 32-bit kernel that
+takes the blocks too loud for MAC16. Q15 rounding alone leaves the stopband near -80 dB,
+so those taps are refined to push the quantization error out of the stopband.
+
+The script also prints the passband ripple and the stopband attenuation of both quantized
+banks, so a change of the design parameters can be checked before it is flashed.
+
+Usage:
+    ./gen_resampler_filters.py [-o main/voice/resampler_filters.h]
+"""
+
+import argparse
+import cmath
+import math
+import os
+import sys
+
+
+CUTOFF_HZ = 7500
+KAISER_BETA = 9.3     # about 94 dB over the 6 - 9 kHz transition of 96 taps at 48 kHz
+PASSBAND_HZ = 6000
+STOPBAND_HZ = 9000
+Q = 15
+WIDE_Q = 30
+
+# (name, input rate, output rate, L, M, taps per phase), taps per phase must be a multiple of 4
+RATIOS = [
+    ("kPolyphaseBank16kTo24k", 16000, 24000, 3, 2, 32),
+    ("kPolyphaseBank24kTo16k", 24000, 16000, 2, 3, 48),
+    ("kPolyphaseBank48kTo16k", 48000, 16000, 1, 3, 96),
+]
+
+
+def bessel_i0(x):
+    total, term, k = 1.0, 1.0, 1
+    while term > 1e-12 * total:
+        term *= (x / (2 * k)) ** 2
+        total += term
+        k += 1
+    return total
+
+
+def prototype(taps, rate):
+    """Windowed sinc with unity DC gain"""
+    center = (taps - 1) / 2
+    fc = CUTOFF_HZ / rate
+    h = []
+    for n in range(taps):
+        t = n - center
+        sinc = 2 * fc if t == 0 else math.sin(2 * math.pi * fc * t) / (math.pi * t)
+        window = bessel_i0(KAISER_BETA * math.sqrt(1 - (2 * n / (taps - 1) - 1) ** 2)) / bessel_i0(KAISER_BETA)
+        h.append(sinc * window)
+    total = sum(h)
+    return [v / total for v in h]
+
+
+def response_db(h, rate, freq):
+    z = sum(v * cmath.exp(-2j * math.pi * freq / rate * n) for n, v in enumerate(h))
+    return 20 * math.log10(max(abs(z), 1e-12))
+
+
+def quantize_phase(taps, bits):
+    """Rounding error pushed into the largest tap so the phase sums to 1.0"""
+    q = [round(v * (1 << bits)) for v in taps]
+    largest = max(range(len(q)), key=lambda i: abs(q[i]))
+    q[largest] += (1 << bits) - sum(q)
+    return q
+
+
+def refine(q, L, rate):
+    """
+    Plain rounding leaves the stopband at the Q15 noise floor, well above the design. Move
+    single steps between two taps of the same phase (so it keeps summing to 1.0) while that
+    lowers the stopband energy of the quantized prototype; q is in prototype order.
+    """
+    n = len(q)
+    scale = 1.0 / (L * (1 << Q))
+    omegas = [2 * math.pi * f / rate for f in range(STOPBAND_HZ, rate // 2 + 1, 100)]
+    basis = [[cmath.exp(-1j * w * k) for w in omegas] for k in range(n)]
+    response = [sum(q[k] * scale * basis[k][i] for k in range(n)) for i in range(len(omegas))]
+    # Energy of (basis[a] - basis[b]) only depends on a - b
+    distance = [sum(2 - 2 * math.cos(w * d) for w in omegas) for d in range(n)]
+    while True:
+        gradient = [sum((response[i].conjugate() * basis[k][i]).real for i in range(len(omegas))) for k in range(n)]
+        best, move = 0.0, None
+        for p in range(L):
+            for a in range(p, n, L):
+                for b in range(p, n, L):
+                    if a == b:
+                        continue
+                    change = 2 * scale * (gradient[a] - gradient[b]) + scale * scale * distance[abs(a - b)]
+                    if change < best - 1e-18:
+                        best, move = change, (a, b)
+        if move is None:
+            return q
+        a, b = move
+        q[a] += 1
+        q[b] -= 1
+        for i in range(len(omegas)):
+            response[i] += scale * (basis[a][i] - basis[b][i])
+
+
+def quantize(h, L, bits):
+    q = [0] * len(h)
+    for p in range(L):
+        q[p::L] = quantize_phase([L * v for v in h[p::L]], bits)
+    return q
+
+
+def measure(q, L, bits, rate):
+    """Ripple and attenuation of what the device runs, not of the ideal prototype"""
+    h = [v / (L * (1 << bits)) for v in q]
+    passband = [response_db(h, rate, f) for f in range(0, PASSBAND_HZ + 1, 250)]
+    stopband = [response_db(h, rate, f) for f in range(STOPBAND_HZ, rate // 2 + 1, 250)]
+    return max(passband) - min(passband), -max(stopband)
+
+
+def build(L, taps_per_phase, rate):
+    h = prototype(L * taps_per_phase, rate)
+    q = refine(quantize(h, L, Q), L, rate)
+    wide = quantize(h, L, WIDE_Q)
+    banks = [[q[p::L][::-1] for p in range(L)], [wide[p::L][::-1] for p in range(L)]]
+    return banks, measure(q, L, Q, rate), measure(wide, L, WIDE_Q, rate)
+
+
+def emit(lines, ctype, name, bank, per_line):
+    L, taps = len(bank), len(bank[0])
+    lines.append(f"alignas(4) static const {ctype} {name}[{L}][{taps}] = {{")
+    for phase in bank:
+        lines.append("    {")
+        for i in range(0, taps, per_line):
+            lines.append("        " + " ".join(f"{v}," for v in phase[i:i + per_line]))
+        lines.append("    },")
+    lines.append("};")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate the PolyphaseResampler filter banks")
+    default_output = os.path.join(os.path.dirname(__file__), "..", "main", "voice", "resampler_filters.h")
+    parser.add_argument("-o", "--output", default=default_output)
+    args = parser.parse_args()
+
+    lines = [
+        "// Generated by scripts/gen_resampler_filters.py, do not edit",
+        "#ifndef RESAMPLER_FILTERS_H",
+        "#define RESAMPLER_FILTERS_H",
+        "",
+        "#include <cstdint>",
+        "",
+        f"// Kaiser beta {KAISER_BETA}, cutoff {CUTOFF_HZ} Hz, every phase reversed and summing to 1.0",
+        f"#define POLYPHASE_COEFFICIENT_BITS {Q}",
+        f"#define POLYPHASE_WIDE_COEFFICIENT_BITS {WIDE_Q}",
+    ]
+    for name, in_rate, out_rate, L, M, taps in RATIOS:
+        rate = L * in_rate
+        (bank, wide), (ripple, attenuation), (wide_ripple, wide_attenuation) = build(L, taps, rate)
+        print(f"{in_rate} -> {out_rate}: {L}x{taps} taps, ripple {ripple:.2f} dB to {PASSBAND_HZ} Hz, "
+              f"{attenuation:.1f} dB (Q{Q}) / {wide_attenuation:.1f} dB (Q{WIDE_Q}) above {STOPBAND_HZ} Hz")
+        lines += [
+            "",
+            f"// {in_rate} Hz -> {out_rate} Hz: L = {L}, M = {M}, ripple {ripple:.2f} dB to {PASSBAND_HZ} Hz, "
+            f"{attenuation:.0f} dB (Q{Q}) / {wide_attenuation:.0f} dB (Q{WIDE_Q}) above {STOPBAND_HZ} Hz",
+        ]
+        emit(lines, "int16_t", name, bank, 12)
+        emit(lines, "int32_t", name.replace("Bank", "WideBank"), wide, 8)
+    lines += ["", "#endif // RESAMPLER_FILTERS_H", ""]
+
+    with open(args.output, "w") as f:
+        f.write("\n".join(lines))
+    print(f"Written to {args.output}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""
+Turn a latency trace dump into a per-frame timeline
+
+The device prints its trace ring when the server sends "(latency_dump)". Each frame is one
+log line from the LatencyTrace tag:
+
+    I (123456) LatencyTrace: U <frame> <captured> <processed> <encoded> <enqueued> <sent>
+    I (123456) LatencyTrace: D <frame> <received> <dequeued> <decoded> <written> 0
+
+Stamps are esp_timer microseconds (low 32 bits). The script prints one row per frame with
+the delay of every stage and, with --chrome, writes a Chrome trace (chrome://tracing or
+https://ui.perfetto.dev) where every stage of every frame is a slice.
+
+Usage:
+    idf.py monitor | tee monitor.log
+    ./latency_timeline.py monitor.log [--chrome trace.json]
+"""
+
+import argparse
+import json
+import re
+import sys
+
+
+STAGES = {
+    "U": ("uplink", ["captured", "processed", "encoded", "enqueued", "sent"],
+          ["afe", "encode", "enqueue", "send"]),
+    "D": ("downlink", ["received", "dequeued", "decoded", "written"],
+          ["buffer", "decode", "output"]),
+}
+
+LINE_RE = re.compile(r"LatencyTrace: ([UD]) (\d+)((?: \d+)+)")
+WRAP = 1 << 32
+
+
+def parse(lines):
+    """Return {direction: {frame: [stamps]}}, later dumps of the same frame win"""
+    frames = {"U": {}, "D": {}}
+    for line in lines:
+        match = LINE_RE.search(line)
+        if not match:
+            continue
+        direction, frame = match.group(1), int(match.group(2))
+        count = len(STAGES[direction][1])
+        stamps = [int(v) for v in match.group(3).split()][:count]
+        if len(stamps) == count:
+            frames[direction][frame] = stamps
+    return frames
+
+
+def unwrap(stamps, origin):
+    """Microseconds since origin, the device counter wraps every ~71 minutes"""
+    return [(s - origin) % WRAP for s in stamps]
+
+
+def print_timeline(frames):
+    for direction, (name, _, stage_names) in STAGES.items():
+        traces = frames[direction]
+        if not traces:
+            continue
+        first = min(traces)
+        origin = traces[first][0]
+        print(f"{name}: {len(traces)} frames")
+        header = "".join(f"{s:>10}" for s in stage_names)
+        print(f"{'frame':>8}{'start ms':>12}{header}{'total':>10}")
+        for frame in sorted(traces):
+            stamps = traces[frame]
+            start = unwrap([stamps[0]], origin)[0]
+            deltas = [(b - a) % WRAP for a, b in zip(stamps, stamps[1:])]
+            total = (stamps[-1] - stamps[0]) % WRAP
+            row = "".join(f"{d / 1000:>10.1f}" for d in deltas)
+            print(f"{frame:>8}{start / 1000:>12.1f}{row}{total / 1000:>10.1f}")
+        print()
+
+
+def write_chrome_trace(frames, path):
+    events = []
+    origins = [t[0] for traces in frames.values() for t in traces.values()]
+    if not origins:
+        return
+    origin = min(origins)
+    for pid, (direction, (name, _, stage_names)) in enumerate(STAGES.items()):
+        events.append({"ph": "M", "pid": pid, "name": "process_name", "args": {"name": name}})
+        for frame, stamps in frames[direction].items():
+            times = unwrap(stamps, origin)
+            # One row per stage keeps overlapping frames readable
+            for tid, stage in enumerate(stage_names):
+                events.append({
+                    "ph": "X", "pid": pid, "tid": tid, "name": f"{stage} #{frame}",
+                    "ts": times[tid], "dur": max(times[tid + 1] - times[tid], 1),
+                })
+        for tid, stage in enumerate(stage_names):
+            events.append({"ph": "M", "pid": pid, "tid": tid, "name": "thread_name", "args": {"name": stage}})
+    with open(path, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Per-frame latency timeline from a LatencyTrace dump")
+    parser.add_argument("log", nargs="?", help="monitor log, stdin if omitted")
+    parser.add_argument("--chrome", help="write a Chrome trace JSON to this path")
+    args = parser.parse_args()
+
+    if args.log:
+        with open(args.log, errors="replace") as f:
+            frames = parse(f)
+    else:
+        frames = parse(sys.stdin)
+
+    if not frames["U"] and not frames["D"]:
+        print("No LatencyTrace lines found", file=sys.stderr)
+        return 1
+    print_timeline(frames)
+    if args.chrome:
+        write_chrome_trace(frames, args.chrome)
+        print(f"Chrome trace written to {args.chrome}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
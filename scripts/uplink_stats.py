@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""
+Server-side parser and statistics for the uplink frame header
+
+After the device sends "(uplink_header,1)" on connect and the server answers with the same,
+every binary uplink message starts with (little endian)
+
+    uint8 version (1), uint8 frame_ms, uint16 sequence, uint32 capture_us, uint16 send_delay_ms
+
+followed by the Opus packet. sequence continues across reconnects and the device also uses up
+a number for every packet it drops (ring full, too old), so a gap is a loss no matter where it
+happened. After a reconnect the device resends what was not acknowledged with the original
+sequence numbers; on_message() returns None for the copies. Acknowledge with
+"(uplink_ack,%d)" % stats.ack() about once a second so the device can release its buffer. capture_us is the device's esp_timer (low 32 bits); the clocks are
+not synchronized, so one-way latency is reported relative to the fastest packet seen
+(arrival - capture - min(arrival - capture)), which is the queueing and network delay on top
+of the best case. send_delay_ms is the part of it spent on the device.
+
+Use it from the server:
+
+    from uplink_stats import UplinkStats
+    stats = UplinkStats()
+    opus = stats.on_message(message, time.monotonic())   # None for a duplicate
+    ...
+    print(stats.summary())
+
+or run it against a capture of binary messages, one per line as "<arrival seconds> <hex>":
+
+    ./uplink_stats.py messages.txt
+"""
+
+import struct
+import sys
+
+
+HEADER = struct.Struct("<BBHIH")
+VERSION = 1
+WRAP_US = 1 << 32
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * p / 100))]
+
+
+class UplinkStats:
+    def __init__(self, window=500):
+        self.window = window
+        self.received = 0
+        self.lost = 0
+        self.late = 0           # arrived after a later sequence number (reordered)
+        self.duplicates = 0
+        self.highest = None
+        self.recent = set()
+        self.offset_us = None
+        self.base_capture = None
+        self.last_capture = None
+        self.relative_ms = []
+        self.device_ms = []
+
+    def on_message(self, message, arrival_s):
+        """Return the Opus payload, or None when the message is a duplicate or not framed"""
+        if len(message) < HEADER.size:
+            return None
+        version, frame_ms, sequence, capture_us, send_delay_ms = HEADER.unpack_from(message)
+        if version != VERSION:
+            return None
+
+        if self.highest is None:
+            self.highest = sequence
+        else:
+            ahead = (sequence - self.highest) & 0xFFFF
+            if ahead == 0 or sequence in self.recent:
+                self.duplicates += 1
+                return None
+            if ahead < 0x8000:
+                self.lost += ahead - 1
+                self.highest = sequence
+            else:
+                # A packet counted as lost turned up after all
+                self.late += 1
+                self.lost = max(0, self.lost - 1)
+        self.recent.add(sequence)
+        if len(self.recent) > 1024:
+            self.recent = {s for s in self.recent if (self.highest - s) & 0xFFFF < 512}
+        self.received += 1
+
+        # Unwrap the device clock so the offset stays comparable across the 71 minute wrap
+        if self.last_capture is None:
+            self.base_capture = 0
+        elif capture_us < self.last_capture and self.last_capture - capture_us > WRAP_US // 2:
+            self.base_capture += WRAP_US
+        self.last_capture = capture_us
+        offset = arrival_s * 1e6 - (self.base_capture + capture_us)
+        if self.offset_us is None or offset < self.offset_us:
+            self.offset_us = offset
+        self.relative_ms.append((offset - self.offset_us) / 1000)
+        self.device_ms.append(send_delay_ms)
+        del self.relative_ms[:-self.window]
+        del self.device_ms[:-self.window]
+        return message[HEADER.size:]
+
+    def ack(self):
+        """Highest sequence received, for "(uplink_ack,N)"; None before the first packet"""
+        return self.highest
+
+    def summary(self):
+        expected = self.received + self.lost
+        loss = 100.0 * self.lost / expected if expected else 0.0
+        return ("received %d, lost %d (%.2f%%), late %d, duplicates %d; "
+                "one-way over best p50/p95/p99 %d/%d/%d ms; device p50/p95/p99 %d/%d/%d ms" % (
+                    self.received, self.lost, loss, self.late, self.duplicates,
+                    percentile(self.relative_ms, 50), percentile(self.relative_ms, 95),
+                    percentile(self.relative_ms, 99), percentile(self.device_ms, 50),
+                    percentile(self.device_ms, 95), percentile(self.device_ms, 99)))
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__)
+        return 1
+    stats = UplinkStats()
+    with open(sys.argv[1]) as f:
+        for line in f:
+            parts = line.split()
+            if len(parts) == 2:
+                stats.on_message(bytes.fromhex(parts[1]), float(parts[0]))
+    print(stats.summary())
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())